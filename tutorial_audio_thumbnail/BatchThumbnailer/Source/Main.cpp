@@ -0,0 +1,236 @@
+/*
+  ==============================================================================
+
+    Main.cpp
+
+    A headless tool that builds thumbnails for every audio file under a
+    directory, using the same thumbnail and cache classes as the app, so that
+    waveforms can be generated on a server before anyone opens the files.
+
+  ==============================================================================
+*/
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+// The shared thumbnail headers include the app's JuceHeader.h as well, which
+// would otherwise declare a second ProjectInfo namespace.
+#define JUCE_DONT_DECLARE_PROJECTINFO 1
+#include "../../Source/MultiResolutionThumbnail.h"
+#include "../../Source/DiskThumbnailCache.h"
+#include "../../Source/Mp3SeekIndex.h"
+
+#include <iostream>
+
+//==============================================================================
+namespace
+{
+    // These have to match the app's thumbnails, or the app won't accept the cached data.
+    enum
+    {
+        finestSamplesPerThumbSample = 64,
+        numThumbnailLevels = 5
+    };
+
+    /** The same directory that the app keeps its cache in. */
+    File getDefaultCacheDirectory()
+    {
+        return File::getSpecialLocation (File::userApplicationDataDirectory)
+                 .getChildFile ("AudioThumbnailTutorial")
+                 .getChildFile ("ThumbnailCache");
+    }
+
+    String getOption (const StringArray& args, const String& name, const String& defaultValue)
+    {
+        const int index = args.indexOf (name);
+        return isPositiveAndBelow (index + 1, args.size()) ? args[index + 1] : defaultValue;
+    }
+
+    void printUsage()
+    {
+        std::cout << "Usage: BatchThumbnailer <directory> [options]" << std::endl
+                  << std::endl
+                  << "  --cache <dir>          where to store thumbnails (default: the app's cache)" << std::endl
+                  << "  --cache-size-mb <n>    disk budget for the cache (default: 1024)" << std::endl
+                  << "  --threads <n>          worker threads (default: one per CPU)" << std::endl
+                  << "  --in-flight <n>        files generated at once (default: twice the threads)" << std::endl
+                  << "  --content-hash         include a hash of the file contents in the cache key" << std::endl
+                  << "  --sidecar              also write <file>.thumb next to each audio file" << std::endl
+                  << "  --verbose              print a line for every file" << std::endl;
+    }
+
+    double getPercentile (const Array<double>& sortedValues, double proportion)
+    {
+        if (sortedValues.size() == 0)
+            return 0.0;
+
+        return sortedValues[roundToInt (proportion * (sortedValues.size() - 1))];
+    }
+
+    //==============================================================================
+    /** A file whose thumbnail is being built. */
+    struct PendingFile
+    {
+        PendingFile (const File& f, AudioFormatManager& formatManager,
+                     AudioThumbnailCache& cache, ThreadPool& threadPool)
+            : file (f),
+              thumbnail (finestSamplesPerThumbSample, numThumbnailLevels, formatManager, cache, threadPool),
+              startTime (Time::getMillisecondCounterHiRes()),
+              wasInCache (false)
+        {
+            // the app only takes thumbnails from the cache if they have the RMS and clip counts
+            thumbnail.setCollectsEnergy (true);
+        }
+
+        const File file;
+        MultiResolutionThumbnail thumbnail;
+        const double startTime;
+        bool wasInCache;
+
+        JUCE_DECLARE_NON_COPYABLE (PendingFile)
+    };
+
+    bool writeSidecar (const PendingFile& pending)
+    {
+        const File sidecar (pending.file.getSiblingFile (pending.file.getFileName() + ".thumb"));
+        sidecar.deleteFile();
+
+        FileOutputStream out (sidecar);
+
+        if (out.failedToOpen())
+            return false;
+
+        pending.thumbnail.saveTo (out);
+        out.flush();
+        return ! out.getStatus().failed();
+    }
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    const StringArray args (argv + 1, argc - 1);
+
+    if (args.size() == 0 || args.contains ("--help"))
+    {
+        printUsage();
+        return 1;
+    }
+
+    const File root (File::getCurrentWorkingDirectory().getChildFile (args[0]));
+
+    if (! root.isDirectory())
+    {
+        std::cerr << "Not a directory: " << root.getFullPathName() << std::endl;
+        return 1;
+    }
+
+    const File cacheDirectory (File::getCurrentWorkingDirectory()
+                                 .getChildFile (getOption (args, "--cache", getDefaultCacheDirectory().getFullPathName())));
+    const int64 cacheBytes  = getOption (args, "--cache-size-mb", "1024").getLargeIntValue() * 1024 * 1024;
+    const int numThreads    = jmax (1, getOption (args, "--threads", String (SystemStats::getNumCpus())).getIntValue());
+    const int maxInFlight   = jmax (1, getOption (args, "--in-flight", String (numThreads * 2)).getIntValue());
+    const bool contentHash  = args.contains ("--content-hash");
+    const bool sidecars     = args.contains ("--sidecar");
+    const bool verbose      = args.contains ("--verbose");
+
+    // The thumbnails send change messages, so there has to be a message manager,
+    // even though nothing here ever dispatches them.
+    ScopedJuceInitialiser_GUI juceInitialiser;
+
+    AudioFormatManager formatManager;
+   #if JUCE_USE_MP3AUDIOFORMAT
+    // each chunk job opens its own reader part way through the file, which for an
+    // MP3 would otherwise mean decoding everything before it
+    formatManager.registerFormat (new IndexedMp3AudioFormat (cacheDirectory.getChildFile ("SeekIndex")), false);
+   #endif
+    formatManager.registerBasicFormats();
+
+    DiskThumbnailCache cache (cacheDirectory, cacheBytes, 1);
+    ThreadPool threadPool (numThreads);
+
+    Array<File> files;
+
+    for (DirectoryIterator iter (root, true, formatManager.getWildcardForAllFormats()); iter.next();)
+        files.add (iter.getFile());
+
+    std::cout << "Thumbnailing " << files.size() << " files under " << root.getFullPathName()
+              << " with " << numThreads << " threads" << std::endl;
+
+    //==============================================================================
+    OwnedArray<PendingFile> inFlight;
+    Array<double> latencies;
+    int nextFile = 0, numFromCache = 0, numFailed = 0;
+    int64 numBytes = 0;
+
+    const double batchStartTime = Time::getMillisecondCounterHiRes();
+
+    while (nextFile < files.size() || inFlight.size() > 0)
+    {
+        while (nextFile < files.size() && inFlight.size() < maxInFlight)
+        {
+            const File& file = files.getReference (nextFile++);
+            PendingFile* const pending = inFlight.add (new PendingFile (file, formatManager, cache, threadPool));
+
+            // a file that's been edited since the last run only has its changed blocks read
+            if (pending->thumbnail.setSource (new FileInputSource (file), DiskThumbnailCache::getHashFor (file, contentHash),
+                                              cache.getLatestVersionOf (file)))
+            {
+                pending->wasInCache = ! pending->thumbnail.isGenerating() && pending->thumbnail.isFullyLoaded();
+            }
+            else
+            {
+                std::cerr << "Couldn't open " << file.getFullPathName() << std::endl;
+                inFlight.removeObject (pending);
+                ++numFailed;
+            }
+        }
+
+        for (int i = inFlight.size(); --i >= 0;)
+        {
+            const PendingFile& pending = *inFlight.getUnchecked (i);
+
+            if (pending.thumbnail.isGenerating())
+                continue;
+
+            const double latency = Time::getMillisecondCounterHiRes() - pending.startTime;
+
+            if (! pending.thumbnail.isFullyLoaded() || (sidecars && ! writeSidecar (pending)))
+            {
+                std::cerr << "Failed: " << pending.file.getFullPathName() << std::endl;
+                ++numFailed;
+            }
+            else
+            {
+                latencies.add (latency);
+                numBytes += pending.file.getSize();
+
+                if (pending.wasInCache)
+                    ++numFromCache;
+
+                if (verbose)
+                    std::cout << String (latency, 2) << " ms" << (pending.wasInCache ? " (cached)  " : "  ")
+                              << pending.file.getFullPathName() << std::endl;
+            }
+
+            inFlight.remove (i);
+        }
+
+        Thread::sleep (1);
+    }
+
+    //==============================================================================
+    const double seconds = jmax (0.001, (Time::getMillisecondCounterHiRes() - batchStartTime) / 1000.0);
+    DefaultElementComparator<double> comparator;
+    latencies.sort (comparator);
+
+    std::cout << "Done: " << latencies.size() << " files (" << numFromCache << " already cached), "
+              << numFailed << " failed, in " << String (seconds, 2) << " s" << std::endl
+              << "  " << String (latencies.size() / seconds, 1) << " files/s, "
+              << String (numBytes / (1024.0 * 1024.0 * seconds), 1) << " MB/s" << std::endl
+              << "  latency ms: p50 " << String (getPercentile (latencies, 0.5), 2)
+              << ", p90 " << String (getPercentile (latencies, 0.9), 2)
+              << ", p99 " << String (getPercentile (latencies, 0.99), 2)
+              << ", max " << String (getPercentile (latencies, 1.0), 2) << std::endl;
+
+    return numFailed > 0 ? 2 : 0;
+}
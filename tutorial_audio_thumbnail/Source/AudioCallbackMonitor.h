@@ -0,0 +1,231 @@
+/*
+  ==============================================================================
+
+    AudioCallbackMonitor.h
+
+  ==============================================================================
+*/
+
+#ifndef AUDIOCALLBACKMONITOR_H_INCLUDED
+#define AUDIOCALLBACKMONITOR_H_INCLUDED
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+/**
+    Measures how long each audio callback takes, compared with the time that the
+    block it produces lasts for.
+
+    The audio thread side never locks or allocates: a ScopedMeasurement reads the
+    high-resolution tick counter at either end of the callback, and the result
+    goes into a fixed-size single-producer, single-consumer ring buffer, or is
+    counted as dropped if that's full. A non-realtime thread calls drain() now and
+    then to move the measurements into histograms, from which getStatistics()
+    works out percentiles.
+
+    Two kinds of trouble are counted:
+      - an overrun is a callback that took longer than its block lasts, so it will
+        have made the device late if it happens more than once in a row
+      - an xrun is a gap between the starts of two callbacks of more than one and
+        a half times the previous block's length, which means that the device
+        missed a deadline, whatever the cause
+*/
+class AudioCallbackMonitor
+{
+public:
+    AudioCallbackMonitor()
+        : sampleRate (0), ticksPerSecond ((double) Time::getHighResolutionTicksPerSecond()),
+          lastStartTicks (0), lastPeriodTicks (0)
+    {
+        loadHistogram.calloc (numLoadBins + 1);
+        durationHistogram.calloc (numDurationBins + 1);
+        resetStatistics();
+    }
+
+    //==============================================================================
+    /** Call this from prepareToPlay(), before any measurements are made. */
+    void prepare (double newSampleRate) noexcept
+    {
+        sampleRate = newSampleRate;
+        lastStartTicks = 0;
+    }
+
+    /** Measures the scope it lives in, as one callback producing numSamples samples. */
+    struct ScopedMeasurement
+    {
+        ScopedMeasurement (AudioCallbackMonitor& m, int numSamplesInBlock) noexcept
+            : monitor (m), numSamples (numSamplesInBlock), startTicks (Time::getHighResolutionTicks())
+        {
+        }
+
+        ~ScopedMeasurement() noexcept
+        {
+            monitor.addMeasurement (startTicks, Time::getHighResolutionTicks(), numSamples);
+        }
+
+    private:
+        AudioCallbackMonitor& monitor;
+        const int numSamples;
+        const int64 startTicks;
+
+        JUCE_DECLARE_NON_COPYABLE (ScopedMeasurement)
+    };
+
+    /** Records one callback. This is realtime-safe, and must only be called from
+        the audio thread.
+    */
+    void addMeasurement (int64 startTicks, int64 endTicks, int numSamples) noexcept
+    {
+        if (sampleRate <= 0 || numSamples <= 0)
+            return;
+
+        const double periodTicks = numSamples * ticksPerSecond / sampleRate;
+        const double durationTicks = (double) (endTicks - startTicks);
+
+        if (durationTicks > periodTicks)
+            ++numOverruns;
+
+        if (lastStartTicks != 0 && (startTicks - lastStartTicks) > lastPeriodTicks * 1.5)
+            ++numXruns;
+
+        lastStartTicks = startTicks;
+        lastPeriodTicks = periodTicks;
+
+        const int writePos = writeIndex.get();
+
+        if (writePos - readIndex.get() >= (int) ringSize)
+        {
+            ++numDropped;
+            return;
+        }
+
+        Measurement& m = ring[writePos & (ringSize - 1)];
+        m.durationMicroseconds = (float) (durationTicks * 1.0e6 / ticksPerSecond);
+        m.loadPercent = (float) (100.0 * durationTicks / periodTicks);
+
+        writeIndex = writePos + 1;
+    }
+
+    //==============================================================================
+    /** Moves any new measurements into the histograms. Call this regularly from a
+        thread that isn't the audio thread; there must only be one such thread.
+    */
+    void drain()
+    {
+        const int end = writeIndex.get();
+
+        for (int pos = readIndex.get(); pos != end; ++pos)
+        {
+            const Measurement& m = ring[pos & (ringSize - 1)];
+
+            ++loadHistogram [jlimit (0, (int) numLoadBins, (int) (m.loadPercent * loadBinsPerPercent))];
+            ++durationHistogram [jlimit (0, (int) numDurationBins, (int) (m.durationMicroseconds / microsecondsPerDurationBin))];
+
+            maxLoadPercent = jmax (maxLoadPercent, (double) m.loadPercent);
+            maxDurationMicroseconds = jmax (maxDurationMicroseconds, (double) m.durationMicroseconds);
+            totalDurationMicroseconds += m.durationMicroseconds;
+            ++numMeasurements;
+        }
+
+        readIndex = end;
+    }
+
+    struct Statistics
+    {
+        int numCallbacks;
+        double p50LoadPercent, p99LoadPercent, maxLoadPercent;
+        double p50Microseconds, p99Microseconds, maxMicroseconds, meanMicroseconds;
+
+        /** These count everything since the monitor was created. */
+        int numOverruns, numXruns, numDropped;
+
+        String toString() const
+        {
+            return String (numCallbacks) + " callbacks, load p50 " + String (p50LoadPercent, 1)
+                    + "% p99 " + String (p99LoadPercent, 1) + "% max " + String (maxLoadPercent, 1)
+                    + "%, time p50 " + String (roundToInt (p50Microseconds)) + " us p99 "
+                    + String (roundToInt (p99Microseconds)) + " us max " + String (roundToInt (maxMicroseconds))
+                    + " us, " + String (numOverruns) + " overruns, " + String (numXruns) + " xruns"
+                    + (numDropped > 0 ? ", " + String (numDropped) + " dropped" : String());
+        }
+    };
+
+    /** Returns the figures for everything drained since resetStatistics(). */
+    Statistics getStatistics() const
+    {
+        Statistics s;
+        s.numCallbacks      = numMeasurements;
+        s.p50LoadPercent    = getPercentile (loadHistogram, numLoadBins, 0.5) / (double) loadBinsPerPercent;
+        s.p99LoadPercent    = getPercentile (loadHistogram, numLoadBins, 0.99) / (double) loadBinsPerPercent;
+        s.maxLoadPercent    = maxLoadPercent;
+        s.p50Microseconds   = getPercentile (durationHistogram, numDurationBins, 0.5) * (double) microsecondsPerDurationBin;
+        s.p99Microseconds   = getPercentile (durationHistogram, numDurationBins, 0.99) * (double) microsecondsPerDurationBin;
+        s.maxMicroseconds   = maxDurationMicroseconds;
+        s.meanMicroseconds  = numMeasurements > 0 ? totalDurationMicroseconds / numMeasurements : 0.0;
+        s.numOverruns       = numOverruns.get();
+        s.numXruns          = numXruns.get();
+        s.numDropped        = numDropped.get();
+        return s;
+    }
+
+    /** Starts a new window for getStatistics(). The overrun, xrun and dropped counts
+        carry on.
+    */
+    void resetStatistics()
+    {
+        loadHistogram.clear ((size_t) numLoadBins + 1);
+        durationHistogram.clear ((size_t) numDurationBins + 1);
+        numMeasurements = 0;
+        maxLoadPercent = 0;
+        maxDurationMicroseconds = 0;
+        totalDurationMicroseconds = 0;
+    }
+
+private:
+    //==============================================================================
+    enum
+    {
+        ringSize = 4096,                    // must be a power of two
+        loadBinsPerPercent = 4,
+        numLoadBins = 400 * loadBinsPerPercent,
+        microsecondsPerDurationBin = 10,
+        numDurationBins = 5000              // up to 50 ms
+    };
+
+    struct Measurement
+    {
+        float durationMicroseconds, loadPercent;
+    };
+
+    // written by the audio thread
+    double sampleRate;
+    const double ticksPerSecond;
+    int64 lastStartTicks;
+    double lastPeriodTicks;
+    Measurement ring[ringSize];
+    Atomic<int> writeIndex, readIndex, numOverruns, numXruns, numDropped;
+
+    // only touched by the draining thread
+    HeapBlock<int> loadHistogram, durationHistogram;
+    int numMeasurements;
+    double maxLoadPercent, maxDurationMicroseconds, totalDurationMicroseconds;
+
+    /** Returns the bin that the given proportion of the measurements fall at or below.
+        The last bin catches everything beyond the range.
+    */
+    double getPercentile (const HeapBlock<int>& histogram, int numBins, double proportion) const
+    {
+        const int target = (int) std::ceil (proportion * numMeasurements);
+        int count = 0;
+
+        for (int i = 0; i <= numBins; ++i)
+            if ((count += histogram[i]) >= target && count > 0)
+                return i + 1;
+
+        return 0;
+    }
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AudioCallbackMonitor)
+};
+
+#endif  // AUDIOCALLBACKMONITOR_H_INCLUDED
@@ -0,0 +1,313 @@
+/*
+  ==============================================================================
+
+    AudioFileOpener.h
+
+  ==============================================================================
+*/
+
+#ifndef AUDIOFILEOPENER_H_INCLUDED
+#define AUDIOFILEOPENER_H_INCLUDED
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "DiskThumbnailCache.h"
+
+//==============================================================================
+/**
+    An AudioFormatReaderSource for a file that's still being written, which can be
+    lengthened while it's being played.
+
+    The reader's lengthInSamples is only changed by the thread that reads from it,
+    at the start of its next block, so it never changes during a read. Other
+    threads get the new length straight away from getTotalLength().
+*/
+class GrowingAudioFormatReaderSource  : public AudioFormatReaderSource
+{
+public:
+    GrowingAudioFormatReaderSource (AudioFormatReader* reader, bool deleteReaderWhenThisIsDeleted)
+        : AudioFormatReaderSource (reader, deleteReaderWhenThisIsDeleted),
+          totalLength (reader->lengthInSamples)
+    {
+    }
+
+    /** Lengthens the source. It never gets shorter. */
+    void setTotalLength (int64 newLength) noexcept
+    {
+        if (newLength > totalLength.get())
+            totalLength = newLength;
+    }
+
+    int64 getTotalLength() const override
+    {
+        return totalLength.get();
+    }
+
+    void getNextAudioBlock (const AudioSourceChannelInfo& info) override
+    {
+        AudioFormatReader* const reader = getAudioFormatReader();
+        const int64 length = totalLength.get();
+
+        if (reader->lengthInSamples != length)
+            reader->lengthInSamples = length;
+
+        AudioFormatReaderSource::getNextAudioBlock (info);
+    }
+
+private:
+    Atomic<int64> totalLength;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (GrowingAudioFormatReaderSource)
+};
+
+//==============================================================================
+/**
+    Opens audio files on a background thread, so that slow disks don't hold up
+    the message thread.
+
+    Everything that touches the file is done on the opener's own thread: hashing
+    it for the thumbnail cache, parsing its header, creating (and if possible
+    memory-mapping) the reader, and wrapping that in an AudioFormatReaderSource.
+    The finished result is handed to the Listener on the message thread, which
+    only has to swap it in.
+
+    Only the most recent request matters. Calling open() again while a file is
+    still being opened cancels the earlier one: the thread checks between steps
+    and gives up as soon as it notices, and if it was stuck in a slow call, its
+    result is thrown away instead of being delivered.
+*/
+class AudioFileOpener  : private Thread,
+                         private AsyncUpdater
+{
+public:
+    //==============================================================================
+    /** A file that's ready to be played. */
+    struct OpenedFile
+    {
+        OpenedFile (const File& f, bool follow) : file (f), followGrowth (follow), hashCode (0), sampleRate (0) {}
+
+        const File file;
+
+        /** True if it was opened to be followed as it grows, in which case it's never
+            memory-mapped, as a mapping can't grow with the file.
+        */
+        const bool followGrowth;
+
+        /** The hash code to look the file's thumbnail up with. */
+        int64 hashCode;
+
+        /** The reader's sample rate, to pass on to AudioTransportSource::setSource(). */
+        double sampleRate;
+
+        /** The reader for playback. If the file was memory-mapped, this refers to
+            mappedReader rather than owning a reader of its own. If it's to be
+            followed, it's a GrowingAudioFormatReaderSource.
+        */
+        ScopedPointer<AudioFormatReaderSource> source;
+
+        /** Set if the file could be memory-mapped, in which case it's up to the
+            listener to keep it alive for as long as the source is used.
+        */
+        ScopedPointer<MemoryMappedAudioFormatReader> mappedReader;
+
+        JUCE_DECLARE_NON_COPYABLE (OpenedFile)
+    };
+
+    //==============================================================================
+    /** Receives the results of open(), always on the message thread. */
+    class Listener
+    {
+    public:
+        virtual ~Listener() {}
+
+        /** Called when a file has been opened. The listener can take whatever it
+            wants out of the OpenedFile; anything left in it is deleted afterwards.
+        */
+        virtual void audioFileOpened (OpenedFile& openedFile) = 0;
+
+        /** Called when a file couldn't be opened. */
+        virtual void audioFileOpenFailed (const File& file) = 0;
+    };
+
+    //==============================================================================
+    AudioFileOpener (AudioFormatManager& formatManagerToUse, Listener& listenerToUse)
+        : Thread ("Audio file opener"),
+          formatManager (formatManagerToUse),
+          listener (listenerToUse),
+          pendingTryMemoryMapping (false),
+          pendingFollowGrowth (false),
+          pendingRequestId (0),
+          finishedRequestId (0)
+    {
+        startThread();
+    }
+
+    ~AudioFileOpener()
+    {
+        cancel();
+        stopThread (4000);
+    }
+
+    //==============================================================================
+    /** Starts opening a file, cancelling any that's still in progress.
+
+        If tryMemoryMapping is true and the file's format supports it, the whole
+        file is mapped and the result's mappedReader is set; otherwise it's read
+        through an ordinary stream. A file that's to be followed as it grows is
+        always streamed, and the result's followGrowth says so.
+    */
+    void open (const File& file, bool tryMemoryMapping, bool followGrowth = false)
+    {
+        {
+            const ScopedLock sl (lock);
+            pendingFile = file;
+            pendingTryMemoryMapping = tryMemoryMapping && ! followGrowth;
+            pendingFollowGrowth = followGrowth;
+            pendingRequestId = ++latestRequestId;
+            finished = nullptr;
+        }
+
+        notify();
+    }
+
+    /** Abandons any file that's being opened; the listener won't hear about it. */
+    void cancel()
+    {
+        const ScopedLock sl (lock);
+        pendingFile = File();
+        ++latestRequestId;
+        finished = nullptr;
+    }
+
+    /** Returns true if a file is being opened, or has been opened and is waiting
+        to be handed to the listener.
+    */
+    bool isOpening() const
+    {
+        const ScopedLock sl (lock);
+        return pendingFile != File() || finished != nullptr;
+    }
+
+private:
+    //==============================================================================
+    AudioFormatManager& formatManager;
+    Listener& listener;
+
+    CriticalSection lock;
+    Atomic<int> latestRequestId;
+    File pendingFile;
+    bool pendingTryMemoryMapping, pendingFollowGrowth;
+    int pendingRequestId, finishedRequestId;
+    ScopedPointer<OpenedFile> finished;
+
+    bool isCancelled (int requestId) const
+    {
+        return threadShouldExit() || requestId != latestRequestId.get();
+    }
+
+    //==============================================================================
+    void run() override
+    {
+        while (! threadShouldExit())
+        {
+            File file;
+            bool tryMemoryMapping, followGrowth;
+            int requestId;
+
+            {
+                const ScopedLock sl (lock);
+                file = pendingFile;
+                tryMemoryMapping = pendingTryMemoryMapping;
+                followGrowth = pendingFollowGrowth;
+                requestId = pendingRequestId;
+                pendingFile = File();
+            }
+
+            if (file == File())
+            {
+                wait (-1);
+                continue;
+            }
+
+            ScopedPointer<OpenedFile> result (openFile (file, tryMemoryMapping, followGrowth, requestId));
+
+            if (result == nullptr)
+                continue;
+
+            const ScopedLock sl (lock);
+
+            if (! isCancelled (requestId))
+            {
+                finished = result;
+                finishedRequestId = requestId;
+                triggerAsyncUpdate();
+            }
+        }
+    }
+
+    /** Does the actual work, returning nullptr if the request was cancelled, or a
+        result without a source if the file couldn't be opened.
+    */
+    OpenedFile* openFile (const File& file, bool tryMemoryMapping, bool followGrowth, int requestId)
+    {
+        ScopedPointer<OpenedFile> result (new OpenedFile (file, followGrowth));
+        result->hashCode = DiskThumbnailCache::getHashFor (file);
+
+        if (isCancelled (requestId))
+            return nullptr;
+
+        if (tryMemoryMapping)
+        {
+            if (AudioFormat* const format = formatManager.findFormatForFileExtension (file.getFileExtension()))
+            {
+                ScopedPointer<MemoryMappedAudioFormatReader> reader (format->createMemoryMappedReader (file));
+
+                if (reader != nullptr && reader->mapEntireFile())
+                {
+                    result->sampleRate = reader->sampleRate;
+                    result->source = new AudioFormatReaderSource (reader, false);
+                    result->mappedReader = reader.release();
+                    return result.release();
+                }
+            }
+
+            if (isCancelled (requestId))
+                return nullptr;
+        }
+
+        if (AudioFormatReader* const reader = formatManager.createReaderFor (file))
+        {
+            result->sampleRate = reader->sampleRate;
+            result->source = followGrowth ? new GrowingAudioFormatReaderSource (reader, true)
+                                          : new AudioFormatReaderSource (reader, true);
+        }
+
+        return result.release();
+    }
+
+    void handleAsyncUpdate() override
+    {
+        ScopedPointer<OpenedFile> result;
+
+        {
+            const ScopedLock sl (lock);
+
+            if (finishedRequestId != latestRequestId.get())
+                return;
+
+            result = finished.release();
+            finishedRequestId = 0;
+        }
+
+        if (result == nullptr)
+            return;
+
+        if (result->source != nullptr)
+            listener.audioFileOpened (*result);
+        else
+            listener.audioFileOpenFailed (result->file);
+    }
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AudioFileOpener)
+};
+
+#endif  // AUDIOFILEOPENER_H_INCLUDED
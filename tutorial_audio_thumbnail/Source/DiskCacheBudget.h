@@ -0,0 +1,165 @@
+/*
+  ==============================================================================
+
+    DiskCacheBudget.h
+
+  ==============================================================================
+*/
+
+#ifndef DISKCACHEBUDGET_H_INCLUDED
+#define DISKCACHEBUDGET_H_INCLUDED
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+/**
+    Keeps the files that a cache writes to a directory within a byte budget, by
+    deleting the ones least recently stored or used.
+
+    A file's modification time doubles as its last-used time, so the cache calls
+    markUsed() whenever it reads one.
+
+    The total is kept up to date as files are written, rather than by listing the
+    directory each time. The directory is only listed when the total is first
+    needed and when it goes over the budget. The oldest files are then deleted
+    until the rest come to three quarters of the budget, so that this only happens
+    once in a while.
+*/
+class DiskCacheBudget
+{
+public:
+    /** The wildcard picks out the cache's files, e.g. "*.thumb;*.latest". */
+    DiskCacheBudget (const File& directoryToUse, const String& wildcardToUse, int64 maxBytesToUse)
+        : directory (directoryToUse),
+          wildcard (wildcardToUse),
+          maxBytes (maxBytesToUse),
+          numBytes (-1)
+    {
+    }
+
+    //==============================================================================
+    int64 getMaxBytes() const
+    {
+        const ScopedLock sl (lock);
+        return maxBytes;
+    }
+
+    void setMaxBytes (int64 newMaxBytes)
+    {
+        const ScopedLock sl (lock);
+        maxBytes = newMaxBytes;
+        countIfNeeded();
+        applyLimit();
+    }
+
+    /** The total size of the cache's files. */
+    int64 getNumBytes() const
+    {
+        const ScopedLock sl (lock);
+        countIfNeeded();
+        return numBytes;
+    }
+
+    /** Counts a file that's just been written, which replaced one of
+        numBytesReplaced, and deletes the oldest files if that's over the budget.
+        Returns true if it had to.
+    */
+    bool fileWritten (int64 numBytesWritten, int64 numBytesReplaced = 0)
+    {
+        const ScopedLock sl (lock);
+
+        // the first count includes the new file
+        if (numBytes >= 0)
+            numBytes += numBytesWritten - numBytesReplaced;
+        else
+            countIfNeeded();
+
+        return applyLimit();
+    }
+
+    /** Uncounts a file that the cache has deleted itself. */
+    void fileDeleted (int64 size)
+    {
+        const ScopedLock sl (lock);
+
+        if (numBytes >= 0)
+            numBytes -= size;
+    }
+
+    /** Notes that a file has just been read, so that it's deleted after the ones that haven't. */
+    static void markUsed (const File& file)
+    {
+        file.setLastModificationTime (Time::getCurrentTime());
+    }
+
+    /** Sorts files so that the least recently stored or used come first. */
+    static void sortOldestFirst (Array<File>& files)
+    {
+        OldestFirst comparator;
+        files.sort (comparator);
+    }
+
+private:
+    //==============================================================================
+    const File directory;
+    const String wildcard;
+
+    CriticalSection lock;
+    int64 maxBytes;
+    mutable int64 numBytes;   // -1 until the directory's been looked at
+
+    struct OldestFirst
+    {
+        static int compareElements (const File& a, const File& b)
+        {
+            const Time ta (a.getLastModificationTime()), tb (b.getLastModificationTime());
+            return ta < tb ? -1 : (tb < ta ? 1 : 0);
+        }
+    };
+
+    /** The lock must be held. */
+    void countIfNeeded() const
+    {
+        if (numBytes >= 0)
+            return;
+
+        Array<File> entries;
+        directory.findChildFiles (entries, File::findFiles, false, wildcard);
+        numBytes = 0;
+
+        for (int i = 0; i < entries.size(); ++i)
+            numBytes += entries.getReference (i).getSize();
+    }
+
+    /** The lock must be held. */
+    bool applyLimit()
+    {
+        if (numBytes <= maxBytes)
+            return false;
+
+        Array<File> entries;
+        directory.findChildFiles (entries, File::findFiles, false, wildcard);
+        sortOldestFirst (entries);
+
+        // recounted, in case anything else has changed the directory
+        numBytes = 0;
+
+        for (int i = 0; i < entries.size(); ++i)
+            numBytes += entries.getReference (i).getSize();
+
+        // a file that's still open or mapped somewhere may refuse to go, so just skip it
+        for (int i = 0; i < entries.size() && numBytes > maxBytes / 4 * 3; ++i)
+        {
+            const int64 size = entries.getReference (i).getSize();
+
+            if (entries.getReference (i).deleteFile())
+                numBytes -= size;
+        }
+
+        return true;
+    }
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (DiskCacheBudget)
+};
+
+#endif  // DISKCACHEBUDGET_H_INCLUDED
@@ -0,0 +1,384 @@
+/*
+  ==============================================================================
+
+    DiskThumbnailCache.h
+
+  ==============================================================================
+*/
+
+#ifndef DISKTHUMBNAILCACHE_H_INCLUDED
+#define DISKTHUMBNAILCACHE_H_INCLUDED
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "MultiResolutionThumbnail.h"
+#include "DiskCacheBudget.h"
+
+//==============================================================================
+/**
+    An AudioThumbnailCache that also keeps every finished thumbnail in a directory
+    on disk, so that they survive restarts and aren't limited to the handful that
+    the in-memory cache holds.
+
+    Each thumbnail is stored in its own file, named after its hash code: a short
+    header, followed by exactly what the thumbnail's saveTo() writes. Thumbnails
+    are loaded by memory-mapping that file; a MultiResolutionThumbnail then reads
+    its levels straight out of the mapping, so reopening a file costs a page-table
+    update rather than a read of either the audio or the thumbnail data.
+
+    When the files in the directory add up to more than the byte budget, the ones
+    least recently stored or loaded are deleted, as DiskCacheBudget describes.
+
+    AudioThumbnailCache's own in-memory list is limited by a number of thumbnails,
+    whatever their size. setMaxBytesInMemory() adds a second one that's limited by
+    bytes instead, for when lots of thumbnails of all sizes come and go: create the
+    cache with a small count, and let the byte budget do the work.
+
+    Use getHashFor() to make the hash codes, so that a file that's been modified
+    doesn't pick up its old thumbnail.
+
+    For each WAV file that a MultiResolutionThumbnail has stored block hashes for,
+    the cache also remembers which version of the file was stored last, in a small
+    file named after its path. When the file changes, getLatestVersionOf() finds
+    the old thumbnail, so that only the blocks that were edited need reading.
+    These files count towards the budget and are deleted by age like the
+    thumbnails, and any that point to a thumbnail that's gone are deleted with it.
+*/
+class DiskThumbnailCache  : public AudioThumbnailCache
+{
+public:
+    DiskThumbnailCache (const File& directoryToUse, int64 maxBytesOnDiskToUse, int maxNumThumbsInMemory)
+        : AudioThumbnailCache (maxNumThumbsInMemory),
+          directory (directoryToUse),
+          diskBudget (directoryToUse, "*" + String (getFileSuffix()) + ";*" + getLatestVersionSuffix(), maxBytesOnDiskToUse),
+          maxBytesInMemory (0),
+          numBytesInMemory (0),
+          memoryUseCounter (0)
+    {
+        directory.createDirectory();
+    }
+
+    //==============================================================================
+    /** Returns a hash code that identifies a particular version of a file: its path,
+        size and modification time.
+
+        If includeContentHash is true, an MD5 of the first and last 64KB of the file
+        is mixed in too, which catches files that were rewritten without their size
+        or time changing, at the cost of two small reads.
+    */
+    static int64 getHashFor (const File& file, bool includeContentHash = false)
+    {
+        String key (file.getFullPathName());
+        key << '|' << file.getSize() << '|' << file.getLastModificationTime().toMilliseconds();
+
+        if (includeContentHash)
+        {
+            FileInputStream in (file);
+
+            if (in.openedOk())
+            {
+                MemoryBlock ends;
+                in.readIntoMemoryBlock (ends, contentHashBlockSize);
+
+                if (in.getTotalLength() > contentHashBlockSize)
+                {
+                    in.setPosition (jmax ((int64) contentHashBlockSize, in.getTotalLength() - contentHashBlockSize));
+                    in.readIntoMemoryBlock (ends, contentHashBlockSize);
+                }
+
+                key << '|' << MD5 (ends).toHexString();
+            }
+        }
+
+        return key.hashCode64();
+    }
+
+    //==============================================================================
+    const File& getDirectory() const noexcept           { return directory; }
+
+    int64 getMaxBytesOnDisk() const                     { return diskBudget.getMaxBytes(); }
+    void setMaxBytesOnDisk (int64 newMaxBytes)          { diskBudget.setMaxBytes (newMaxBytes); }
+
+    /** Returns the total size of the thumbnail files in the directory, and of the
+        files that remember the latest versions.
+    */
+    int64 getNumBytesOnDisk() const                     { return diskBudget.getNumBytes(); }
+
+    /** Returns the file that the thumbnail with this hash code is stored in. */
+    File getFileFor (int64 hashCode) const
+    {
+        return directory.getChildFile (String::toHexString (hashCode) + getFileSuffix());
+    }
+
+    /** Returns the hash code of the last thumbnail with block hashes that was stored
+        for a file at this path, whatever version of the file it was, or 0 if there
+        isn't one. It may have been deleted since, in which case loading it fails.
+    */
+    int64 getLatestVersionOf (const File& audioFile) const
+    {
+        MemoryBlock data;
+
+        if (! getLatestVersionFileFor (audioFile).loadFileAsData (data) || data.getSize() != sizeof (int64))
+            return 0;
+
+        MemoryInputStream in (data, false);
+        return in.readInt64();
+    }
+
+    //==============================================================================
+    /** Sets how many bytes of recently stored or used thumbnails to keep in memory,
+        on top of AudioThumbnailCache's own list. 0 turns this off, which is the default.
+    */
+    void setMaxBytesInMemory (int64 newMaxBytes)
+    {
+        const ScopedLock sl (memoryLock);
+        maxBytesInMemory = newMaxBytes;
+        applyMemoryLimit();
+    }
+
+    int64 getMaxBytesInMemory() const noexcept          { return maxBytesInMemory; }
+
+    /** The size of the thumbnails held under setMaxBytesInMemory()'s budget. */
+    int64 getNumBytesInMemory() const
+    {
+        const ScopedLock sl (memoryLock);
+        return numBytesInMemory;
+    }
+
+    /** Returns true if there's a thumbnail with this hash code in memory or on disk,
+        without loading it.
+    */
+    bool contains (int64 hashCode) const
+    {
+        {
+            const ScopedLock sl (memoryLock);
+
+            if (findMemoryEntry (hashCode) >= 0)
+                return true;
+        }
+
+        return getFileFor (hashCode).existsAsFile();
+    }
+
+protected:
+    //==============================================================================
+    bool loadNewThumb (AudioThumbnailBase& thumb, int64 hashCode) override
+    {
+        {
+            const ScopedLock sl (memoryLock);
+            const int index = findMemoryEntry (hashCode);
+
+            if (index >= 0)
+            {
+                MemoryEntry& entry = *memoryEntries.getUnchecked (index);
+                entry.lastUsed = ++memoryUseCounter;
+
+                MemoryInputStream data (entry.data, false);
+                return thumb.loadFrom (data);
+            }
+        }
+
+        const File file (getFileFor (hashCode));
+
+        if (! file.existsAsFile())
+            return false;
+
+        ScopedPointer<MemoryMappedFile> map (new MemoryMappedFile (file, MemoryMappedFile::readOnly));
+
+        if (map->getData() == nullptr || map->getSize() < (size_t) headerSize)
+            return false;
+
+        MemoryInputStream header (map->getData(), (size_t) headerSize, false);
+        char magic[4];
+
+        if (header.read (magic, 4) != 4 || memcmp (magic, "jtdc", 4) != 0
+             || header.readInt() != formatVersion
+             || header.readInt64() != hashCode
+             || header.readInt64() != (int64) map->getSize() - headerSize)
+            return false;
+
+        DiskCacheBudget::markUsed (file);
+
+        if (MultiResolutionThumbnail* mrt = dynamic_cast<MultiResolutionThumbnail*> (&thumb))
+            return mrt->loadFromMappedFile (map.release(), (size_t) headerSize);
+
+        MemoryInputStream data (addBytesToPointer (map->getData(), (int) headerSize),
+                                map->getSize() - (size_t) headerSize, false);
+        return thumb.loadFrom (data);
+    }
+
+    void saveNewlyFinishedThumbnail (const AudioThumbnailBase& thumb, int64 hashCode) override
+    {
+        if (! thumb.isFullyLoaded())
+            return;
+
+        if (maxBytesInMemory > 0)
+            keepInMemory (thumb, hashCode);
+
+        const File file (getFileFor (hashCode));
+        const int64 oldSize = file.getSize();
+        TemporaryFile temp (file);
+
+        {
+            FileOutputStream out (temp.getFile());
+
+            if (out.failedToOpen())
+                return;
+
+            out.write ("jtdc", 4);
+            out.writeInt (formatVersion);
+            out.writeInt64 (hashCode);
+            out.writeInt64 (0);  // the size of the thumbnail data, filled in below
+            out.writeInt64 (0);  // padding, so that the thumbnail data is 16-byte aligned
+
+            thumb.saveTo (out);
+
+            const int64 dataSize = out.getPosition() - headerSize;
+            out.setPosition (16);
+            out.writeInt64 (dataSize);
+            out.flush();
+
+            if (out.getStatus().failed())
+                return;
+        }
+
+        if (! temp.overwriteTargetFileWithTemporary())
+            return;
+
+        if (const MultiResolutionThumbnail* mrt = dynamic_cast<const MultiResolutionThumbnail*> (&thumb))
+            if (mrt->hasBlockHashes())
+                setLatestVersionOf (mrt->getRawSourceFile(), hashCode);
+
+        if (diskBudget.fileWritten (file.getSize(), oldSize))
+            deleteOrphanedLatestVersions();
+    }
+
+private:
+    //==============================================================================
+    enum
+    {
+        formatVersion = 1,
+        headerSize = 32,
+        contentHashBlockSize = 65536
+    };
+
+    const File directory;
+    DiskCacheBudget diskBudget;
+
+    struct MemoryEntry
+    {
+        int64 hashCode;
+        MemoryBlock data;
+        uint32 lastUsed;
+    };
+
+    CriticalSection memoryLock;
+    OwnedArray<MemoryEntry> memoryEntries;
+    int64 maxBytesInMemory, numBytesInMemory;
+    uint32 memoryUseCounter;
+
+    static const char* getFileSuffix() noexcept             { return ".thumb"; }
+    static const char* getLatestVersionSuffix() noexcept    { return ".latest"; }
+
+    File getLatestVersionFileFor (const File& audioFile) const
+    {
+        return directory.getChildFile (String::toHexString (audioFile.getFullPathName().hashCode64()) + getLatestVersionSuffix());
+    }
+
+    void setLatestVersionOf (const File& audioFile, int64 hashCode)
+    {
+        const File file (getLatestVersionFileFor (audioFile));
+        const int64 oldSize = file.getSize();
+
+        MemoryOutputStream out;
+        out.writeInt64 (hashCode);
+
+        if (file.replaceWithData (out.getData(), out.getDataSize())
+             && diskBudget.fileWritten (file.getSize(), oldSize))
+            deleteOrphanedLatestVersions();
+    }
+
+    /** Deletes the latest-version files whose thumbnails have been deleted, which
+        only needs doing after the budget's deleted some.
+    */
+    void deleteOrphanedLatestVersions()
+    {
+        Array<File> entries;
+        directory.findChildFiles (entries, File::findFiles, false, "*" + String (getLatestVersionSuffix()));
+
+        for (int i = 0; i < entries.size(); ++i)
+        {
+            const File& file = entries.getReference (i);
+            MemoryBlock data;
+
+            if (file.loadFileAsData (data) && data.getSize() == sizeof (int64))
+            {
+                MemoryInputStream in (data, false);
+
+                if (getFileFor (in.readInt64()).existsAsFile())
+                    continue;
+            }
+
+            const int64 size = file.getSize();
+
+            if (file.deleteFile())
+                diskBudget.fileDeleted (size);
+        }
+    }
+
+    //==============================================================================
+    int findMemoryEntry (int64 hashCode) const
+    {
+        for (int i = 0; i < memoryEntries.size(); ++i)
+            if (memoryEntries.getUnchecked (i)->hashCode == hashCode)
+                return i;
+
+        return -1;
+    }
+
+    void keepInMemory (const AudioThumbnailBase& thumb, int64 hashCode)
+    {
+        ScopedPointer<MemoryEntry> entry (new MemoryEntry());
+        entry->hashCode = hashCode;
+
+        {
+            MemoryOutputStream out (entry->data, false);
+            thumb.saveTo (out);
+        }
+
+        const ScopedLock sl (memoryLock);
+        const int existing = findMemoryEntry (hashCode);
+
+        if (existing >= 0)
+        {
+            numBytesInMemory -= (int64) memoryEntries.getUnchecked (existing)->data.getSize();
+            memoryEntries.remove (existing);
+        }
+
+        entry->lastUsed = ++memoryUseCounter;
+        numBytesInMemory += (int64) entry->data.getSize();
+        memoryEntries.add (entry.release());
+        applyMemoryLimit();
+    }
+
+    /** Drops the least recently used entries until they fit the budget; the lock
+        must be held.
+    */
+    void applyMemoryLimit()
+    {
+        while (numBytesInMemory > maxBytesInMemory && memoryEntries.size() > 0)
+        {
+            int oldest = 0;
+
+            for (int i = 1; i < memoryEntries.size(); ++i)
+                if (memoryEntries.getUnchecked (i)->lastUsed < memoryEntries.getUnchecked (oldest)->lastUsed)
+                    oldest = i;
+
+            numBytesInMemory -= (int64) memoryEntries.getUnchecked (oldest)->data.getSize();
+            memoryEntries.remove (oldest);
+        }
+    }
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (DiskThumbnailCache)
+};
+
+#endif  // DISKTHUMBNAILCACHE_H_INCLUDED
@@ -0,0 +1,533 @@
+/*
+  ==============================================================================
+
+    LoopRegionAudioSource.h
+
+  ==============================================================================
+*/
+
+#ifndef LOOPREGIONAUDIOSOURCE_H_INCLUDED
+#define LOOPREGIONAUDIOSOURCE_H_INCLUDED
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "ReadAheadAudioSource.h"
+
+//==============================================================================
+/**
+    Plays a PositionableAudioSource straight through, except that once the play
+    position is inside a loop region, that region is played over and over from a
+    copy in memory.
+
+    When a region is set, it's decoded on a background TimeSliceThread, through a
+    reader of its own, into a single 64-byte aligned block of memory; until that's
+    done, the source just plays on. From then on the audio callback never reads the
+    source while it's in the loop. A block that runs past the end of the loop is
+    split there and carries on from the loop's start, so each wrap lands on exactly
+    the right sample, and nothing is allocated, freed or read from disk to do it.
+
+    Buffers are passed between the threads under a SpinLock that the background
+    thread only holds while it swaps pointers. One that the audio thread has
+    finished with is left for the background thread to delete. When the loop is
+    left, a ReadAheadAudioSource underneath is moved without waking its thread,
+    so that the audio thread never waits on a lock held elsewhere.
+
+    Every wrap is measured. getStatistics() gives the most that the samples between
+    two wraps differed from the loop's length, which shows whether wrapping is
+    sample-accurate and should always be zero; how far apart in time the wraps were
+    compared with the loop's length, which is the jitter that the device's callback
+    timing adds; and how long the callbacks that wrapped took next to the others.
+*/
+class LoopRegionAudioSource  : public PositionableAudioSource,
+                               private TimeSliceClient
+{
+public:
+    /** Creates a LoopRegionAudioSource.
+
+        @param sourceToPlay             the source to play outside the loop
+        @param deleteSourceWhenDeleted  whether this object should take ownership of the source
+        @param formatManagerToUse       used to open the file again, to decode regions from
+        @param fileToDecode             the file that the source is playing
+        @param decodeThreadToUse        the thread that decodes regions; it must already be running
+        @param numChannelsToUse         how many channels to keep, which should match the
+                                        number that the caller asks for
+    */
+    LoopRegionAudioSource (PositionableAudioSource* sourceToPlay, bool deleteSourceWhenDeleted,
+                           AudioFormatManager& formatManagerToUse, const File& fileToDecode,
+                           TimeSliceThread& decodeThreadToUse, int numChannelsToUse = 2)
+        : source (sourceToPlay, deleteSourceWhenDeleted),
+          readAheadSource (dynamic_cast<ReadAheadAudioSource*> (sourceToPlay)),
+          formatManager (formatManagerToUse),
+          file (fileToDecode),
+          decodeThread (decodeThreadToUse),
+          numChannels (numChannelsToUse),
+          sampleRate (0),
+          ticksPerSecond ((double) Time::getHighResolutionTicksPerSecond()),
+          nextPlayPos (0),
+          isSourceInSync (true),
+          requestNumber (0),
+          requestTicks (0),
+          samplesSinceWrap (0),
+          lastWrapTicks (0),
+          lastWrapRequest (-1)
+    {
+        jassert (source != nullptr && numChannels > 0);
+
+        resetStatistics();
+        decodeThread.addTimeSliceClient (this);
+    }
+
+    ~LoopRegionAudioSource()
+    {
+        decodeThread.removeTimeSliceClient (this);
+    }
+
+    //==============================================================================
+    /** Loops the given range of source samples as soon as it's been decoded, or
+        stops looping if the range is empty. The source plays straight through
+        until then.
+
+        Returns false, and stops looping, if the region would take more than
+        maxLoopBytes to hold.
+    */
+    bool setLoopRegion (Range<int64> newRegion)
+    {
+        const bool fits = newRegion.getLength() * numChannels * (int64) sizeof (float) <= (int64) maxLoopBytes;
+
+        {
+            const SpinLock::ScopedLockType sl (bufferLock);
+            requestedRegion = fits ? newRegion.getIntersectionWith (Range<int64> (0, std::numeric_limits<int64>::max()))
+                                   : Range<int64>();
+            ++requestNumber;
+            requestTicks = Time::getHighResolutionTicks();
+        }
+
+        decodeThread.moveToFrontOfQueue (this);
+        return fits;
+    }
+
+    Range<int64> getLoopRegion() const
+    {
+        const SpinLock::ScopedLockType sl (bufferLock);
+        return requestedRegion;
+    }
+
+    /** True once the current region has been decoded and handed to the audio thread. */
+    bool isLoopReady() const
+    {
+        const SpinLock::ScopedLockType sl (bufferLock);
+        return ! requestedRegion.isEmpty() && readyRequest.get() == requestNumber;
+    }
+
+    //==============================================================================
+    void prepareToPlay (int samplesPerBlockExpected, double newSampleRate) override
+    {
+        sampleRate = newSampleRate;
+        source->prepareToPlay (samplesPerBlockExpected, newSampleRate);
+    }
+
+    void releaseResources() override
+    {
+        source->releaseResources();
+    }
+
+    void getNextAudioBlock (const AudioSourceChannelInfo& info) override
+    {
+        const int64 startTicks = Time::getHighResolutionTicks();
+        const SpinLock::ScopedLockType sl (bufferLock);
+
+        takeNewBuffer();
+
+        const LoopBuffer* const loop = (activeBuffer != nullptr && activeBuffer->requestNumber == requestNumber)
+                                         ? activeBuffer.get() : nullptr;
+        bool wrapped = false;
+
+        for (int done = 0; done < info.numSamples;)
+        {
+            const int remaining = info.numSamples - done;
+
+            if (loop != nullptr && loop->region.contains (nextPlayPos))
+            {
+                const int offset = (int) (nextPlayPos - loop->region.getStart());
+                const int num = jmin (remaining, loop->numSamples - offset);
+
+                loop->copyTo (*info.buffer, info.startSample + done, offset, num);
+                done += num;
+                nextPlayPos += num;
+                samplesSinceWrap += num;
+                isSourceInSync = false;
+
+                if (nextPlayPos == loop->region.getEnd())
+                {
+                    nextPlayPos = loop->region.getStart();
+                    recordWrap (*loop, startTicks + (int64) (done * ticksPerSecond / jmax (1.0, sampleRate)));
+                    wrapped = true;
+                }
+            }
+            else
+            {
+                // up to the loop's start if that's in this block; the rest comes from memory
+                const int num = (loop != nullptr && nextPlayPos < loop->region.getStart())
+                                  ? (int) jmin ((int64) remaining, loop->region.getStart() - nextPlayPos)
+                                  : remaining;
+
+                if (! isSourceInSync)
+                {
+                    if (readAheadSource != nullptr)
+                        readAheadSource->setNextReadPositionFromAudioThread (nextPlayPos);
+                    else
+                        source->setNextReadPosition (nextPlayPos);
+
+                    isSourceInSync = true;
+                }
+
+                source->getNextAudioBlock (AudioSourceChannelInfo (info.buffer, info.startSample + done, num));
+                done += num;
+                nextPlayPos += num;
+                samplesSinceWrap += num;
+            }
+        }
+
+        if (loop != nullptr)
+            recordCallback (wrapped, Time::getHighResolutionTicks() - startTicks);
+    }
+
+    //==============================================================================
+    void setNextReadPosition (int64 newPosition) override
+    {
+        // the source is told straight away, so that a read-ahead source can start
+        // buffering from there
+        source->setNextReadPosition (newPosition);
+
+        const SpinLock::ScopedLockType sl (bufferLock);
+        nextPlayPos = newPosition;
+        isSourceInSync = true;
+        lastWrapRequest = -1;
+    }
+
+    int64 getNextReadPosition() const override      { return nextPlayPos; }
+    int64 getTotalLength() const override           { return source->getTotalLength(); }
+    bool isLooping() const override                 { return source->isLooping(); }
+    void setLooping (bool shouldLoop) override      { source->setLooping (shouldLoop); }
+
+    //==============================================================================
+    struct Statistics
+    {
+        int numWraps;
+
+        /** The most that the samples played between two wraps differed from the
+            loop's length. Anything but zero means a wrap wasn't sample-accurate.
+        */
+        int maxWrapErrorSamples;
+
+        /** How far apart in time two wraps were, compared with the loop's length,
+            taking each one at the time its first sample was due in its callback.
+        */
+        double meanWrapJitterMicroseconds, maxWrapJitterMicroseconds;
+
+        /** How long this source's part of the callbacks took while a loop was set. */
+        double meanWrapCallbackMicroseconds, maxWrapCallbackMicroseconds, meanOtherCallbackMicroseconds;
+
+        /** From setLoopRegion() to the region being ready to play. */
+        double lastDecodeMilliseconds;
+
+        String toString() const
+        {
+            return String (numWraps) + " wraps, max error " + String (maxWrapErrorSamples) + " samples, jitter mean "
+                    + String (roundToInt (meanWrapJitterMicroseconds)) + " us max " + String (roundToInt (maxWrapJitterMicroseconds))
+                    + " us, wrapping callbacks mean " + String (meanWrapCallbackMicroseconds, 1) + " us max "
+                    + String (maxWrapCallbackMicroseconds, 1) + " us (others " + String (meanOtherCallbackMicroseconds, 1)
+                    + " us), decoded in " + String (lastDecodeMilliseconds, 1) + " ms";
+        }
+    };
+
+    Statistics getStatistics() const
+    {
+        const int numIntervals = numWrapIntervals.get();
+        const int numWrapping = numWrapCallbacks.get();
+        const int numOthers = numOtherCallbacks.get();
+
+        Statistics s;
+        s.numWraps                      = numWraps.get();
+        s.maxWrapErrorSamples           = maxWrapErrorSamples.get();
+        s.meanWrapJitterMicroseconds    = numIntervals > 0 ? totalWrapJitterMicroseconds.get() / (double) numIntervals : 0.0;
+        s.maxWrapJitterMicroseconds     = (double) maxWrapJitterMicroseconds.get();
+        s.meanWrapCallbackMicroseconds  = numWrapping > 0 ? totalWrapCallbackNanoseconds.get() / (1000.0 * numWrapping) : 0.0;
+        s.maxWrapCallbackMicroseconds   = maxWrapCallbackNanoseconds.get() / 1000.0;
+        s.meanOtherCallbackMicroseconds = numOthers > 0 ? totalOtherCallbackNanoseconds.get() / (1000.0 * numOthers) : 0.0;
+        s.lastDecodeMilliseconds        = lastDecodeMicroseconds.get() / 1000.0;
+        return s;
+    }
+
+    void resetStatistics() noexcept
+    {
+        numWraps = 0;
+        maxWrapErrorSamples = 0;
+        numWrapIntervals = 0;
+        totalWrapJitterMicroseconds = 0;
+        maxWrapJitterMicroseconds = 0;
+        numWrapCallbacks = 0;
+        numOtherCallbacks = 0;
+        totalWrapCallbackNanoseconds = 0;
+        maxWrapCallbackNanoseconds = 0;
+        totalOtherCallbackNanoseconds = 0;
+    }
+
+private:
+    //==============================================================================
+    enum
+    {
+        maxLoopBytes = 256 * 1024 * 1024,
+        decodeSliceSamples = 32768,     // per time slice, so that the read-ahead gets its turns
+        bufferAlignment = 64
+    };
+
+    /** A decoded region, each channel starting on a bufferAlignment boundary. */
+    struct LoopBuffer
+    {
+        LoopBuffer (int channels, Range<int64> regionToHold, int request)
+            : region (regionToHold), numChannels (channels), numSamples ((int) regionToHold.getLength()),
+              channelStride ((numSamples + floatsPerAlignment - 1) / floatsPerAlignment * floatsPerAlignment),
+              requestNumber (request), numDecoded (0), data (nullptr)
+        {
+            memory.malloc ((size_t) numChannels * (size_t) channelStride * sizeof (float) + bufferAlignment);
+
+            if (memory != nullptr)
+                data = reinterpret_cast<float*> (((pointer_sized_int) memory.getData() + bufferAlignment - 1)
+                                                   & ~(pointer_sized_int) (bufferAlignment - 1));
+        }
+
+        float* getChannel (int chan) const noexcept     { return data + (size_t) chan * (size_t) channelStride; }
+
+        void copyTo (AudioSampleBuffer& dest, int destStart, int offset, int num) const noexcept
+        {
+            const int numToCopy = jmin (numChannels, dest.getNumChannels());
+
+            for (int chan = 0; chan < numToCopy; ++chan)
+                FloatVectorOperations::copy (dest.getWritePointer (chan, destStart), getChannel (chan) + offset, num);
+
+            for (int chan = numToCopy; chan < dest.getNumChannels(); ++chan)
+                dest.clear (chan, destStart, num);
+        }
+
+        enum { floatsPerAlignment = bufferAlignment / sizeof (float) };
+
+        const Range<int64> region;
+        const int numChannels, numSamples, channelStride, requestNumber;
+        int numDecoded;
+        HeapBlock<char> memory;
+        float* data;
+
+        JUCE_DECLARE_NON_COPYABLE (LoopBuffer)
+    };
+
+    OptionalScopedPointer<PositionableAudioSource> source;
+    ReadAheadAudioSource* const readAheadSource;   // the source, if that's what it is
+    AudioFormatManager& formatManager;
+    const File file;
+    TimeSliceThread& decodeThread;
+    const int numChannels;
+    double sampleRate;
+    const double ticksPerSecond;
+
+    // the position and the buffers that are handed over are guarded by the lock;
+    // activeBuffer is only used by the audio thread, and the decoding ones by the
+    // background thread
+    SpinLock bufferLock;
+    int64 nextPlayPos;
+    bool isSourceInSync;
+    Range<int64> requestedRegion;
+    int requestNumber;
+    int64 requestTicks;
+    ScopedPointer<LoopBuffer> incomingBuffer, activeBuffer, retiredBuffer;
+    Atomic<int> readyRequest, finishedRequest;
+
+    ScopedPointer<AudioFormatReader> decodeReader;
+    ScopedPointer<LoopBuffer> decodingBuffer;
+
+    // written by the audio thread
+    int64 samplesSinceWrap, lastWrapTicks;
+    int lastWrapRequest;
+    Atomic<int> numWraps, maxWrapErrorSamples, numWrapIntervals, numWrapCallbacks, numOtherCallbacks;
+    Atomic<int64> totalWrapJitterMicroseconds, maxWrapJitterMicroseconds;
+    Atomic<int64> totalWrapCallbackNanoseconds, maxWrapCallbackNanoseconds, totalOtherCallbackNanoseconds;
+    Atomic<int64> lastDecodeMicroseconds;
+
+    //==============================================================================
+    /** Swaps in a newly decoded buffer, or lets go of one that's out of date, as
+        long as the background thread has taken the last one that was let go of.
+        The lock must be held.
+    */
+    void takeNewBuffer() noexcept
+    {
+        if (retiredBuffer != nullptr)
+            return;
+
+        if (incomingBuffer != nullptr)
+        {
+            retiredBuffer = activeBuffer.release();
+            activeBuffer = incomingBuffer.release();
+        }
+        else if (activeBuffer != nullptr && activeBuffer->requestNumber != requestNumber)
+        {
+            retiredBuffer = activeBuffer.release();
+        }
+    }
+
+    void recordWrap (const LoopBuffer& loop, int64 wrapTicks) noexcept
+    {
+        ++numWraps;
+
+        if (lastWrapRequest == loop.requestNumber)
+        {
+            const int error = (int) std::abs (samplesSinceWrap - loop.numSamples);
+
+            if (error > maxWrapErrorSamples.get())
+                maxWrapErrorSamples = error;
+
+            if (sampleRate > 0)
+            {
+                const double expectedTicks = loop.numSamples * ticksPerSecond / sampleRate;
+                const int64 jitter = (int64) (std::abs ((wrapTicks - lastWrapTicks) - expectedTicks) * 1.0e6 / ticksPerSecond);
+
+                totalWrapJitterMicroseconds += jitter;
+                ++numWrapIntervals;
+
+                if (jitter > maxWrapJitterMicroseconds.get())
+                    maxWrapJitterMicroseconds = jitter;
+            }
+        }
+
+        lastWrapRequest = loop.requestNumber;
+        lastWrapTicks = wrapTicks;
+        samplesSinceWrap = 0;
+    }
+
+    void recordCallback (bool wrapped, int64 durationTicks) noexcept
+    {
+        const int64 nanoseconds = (int64) (durationTicks * 1.0e9 / ticksPerSecond);
+
+        if (wrapped)
+        {
+            ++numWrapCallbacks;
+            totalWrapCallbackNanoseconds += nanoseconds;
+
+            if (nanoseconds > maxWrapCallbackNanoseconds.get())
+                maxWrapCallbackNanoseconds = nanoseconds;
+        }
+        else
+        {
+            ++numOtherCallbacks;
+            totalOtherCallbackNanoseconds += nanoseconds;
+        }
+    }
+
+    //==============================================================================
+    int useTimeSlice() override
+    {
+        ScopedPointer<LoopBuffer> finished;   // deleted once the lock's been let go of
+        Range<int64> region;
+        int request;
+
+        {
+            const SpinLock::ScopedLockType sl (bufferLock);
+            finished = retiredBuffer.release();
+            region = requestedRegion;
+            request = requestNumber;
+        }
+
+        if (region.isEmpty() || finishedRequest.get() == request)
+        {
+            decodingBuffer = nullptr;
+            return finished != nullptr ? 1 : 100;
+        }
+
+        if (decodingBuffer == nullptr || decodingBuffer->requestNumber != request)
+            if (! startDecoding (region, request))
+                return 100;
+
+        if (! decodeSlice())
+        {
+            DBG ("Couldn't read a loop region of " << file.getFileName());
+            decodingBuffer = nullptr;
+            finishedRequest = request;   // so that it isn't tried again
+            return 100;
+        }
+
+        if (decodingBuffer->numDecoded < decodingBuffer->numSamples)
+            return 0;
+
+        {
+            const SpinLock::ScopedLockType sl (bufferLock);
+
+            if (request == requestNumber)
+            {
+                // one that the audio thread hasn't got to yet is replaced, and deleted below
+                finished = incomingBuffer.release();
+                incomingBuffer = decodingBuffer.release();
+                readyRequest = request;
+                finishedRequest = request;
+                lastDecodeMicroseconds = (int64) ((Time::getHighResolutionTicks() - requestTicks) * 1.0e6 / ticksPerSecond);
+            }
+        }
+
+        decodingBuffer = nullptr;
+        return 1;
+    }
+
+    bool startDecoding (Range<int64> region, int request)
+    {
+        decodingBuffer = nullptr;
+
+        if (decodeReader == nullptr)
+            decodeReader = formatManager.createReaderFor (file);
+
+        if (decodeReader != nullptr)
+            region = region.getIntersectionWith (Range<int64> (0, decodeReader->lengthInSamples));
+
+        if (decodeReader == nullptr || region.isEmpty())
+        {
+            DBG ("Couldn't decode a loop region of " << file.getFileName());
+            finishedRequest = request;   // so that it isn't tried again
+            return false;
+        }
+
+        decodingBuffer = new LoopBuffer (numChannels, region, request);
+
+        if (decodingBuffer->data == nullptr)
+        {
+            decodingBuffer = nullptr;
+            finishedRequest = request;
+            return false;
+        }
+
+        return true;
+    }
+
+    bool decodeSlice()
+    {
+        LoopBuffer& b = *decodingBuffer;
+        const int num = jmin ((int) decodeSliceSamples, b.numSamples - b.numDecoded);
+
+        HeapBlock<int*> channels ((size_t) b.numChannels);
+
+        for (int chan = 0; chan < b.numChannels; ++chan)
+            channels[chan] = reinterpret_cast<int*> (b.getChannel (chan) + b.numDecoded);
+
+        // a mono file is copied to every channel, as AudioFormatReaderSource does;
+        // integer formats are converted in place
+        if (! decodeReader->read (channels, b.numChannels, b.region.getStart() + b.numDecoded, num, true))
+            return false;
+
+        if (! decodeReader->usesFloatingPointData)
+            for (int chan = 0; chan < b.numChannels; ++chan)
+                FloatVectorOperations::convertFixedToFloat (reinterpret_cast<float*> (channels[chan]), channels[chan],
+                                                            1.0f / 0x7fffffff, num);
+
+        b.numDecoded += num;
+        return true;
+    }
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (LoopRegionAudioSource)
+};
+
+#endif  // LOOPREGIONAUDIOSOURCE_H_INCLUDED
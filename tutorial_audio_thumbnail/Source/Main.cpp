@@ -9,9 +9,13 @@
 */
 
 #include "../JuceLibraryCode/JuceHeader.h"
+#include "StartupTimeline.h"
 
 Component* createMainContentComponent();
 
+// starts the startup timeline's clock as early as possible, where /proc can't tell it
+static StartupTimeline& startupTimeline = StartupTimeline::getInstance();
+
 //==============================================================================
 class Audio_AudioBasics_PlayingSoundFilesApplication  : public JUCEApplication
 {
@@ -28,7 +32,9 @@ public:
     {
         // This method is where you should put your application's initialisation code..
 
+        startupTimeline.mark ("initialise");
         mainWindow = new MainWindow (getApplicationName());
+        startupTimeline.mark ("window shown");
     }
 
     void shutdown() override
@@ -2,132 +2,1149 @@
 #define MAINCOMPONENT_H_INCLUDED
 
 #include "../JuceLibraryCode/JuceHeader.h"
+#include "MultiResolutionThumbnail.h"
+#include "DiskThumbnailCache.h"
+#include "ReadAheadAudioSource.h"
+#include "LoopRegionAudioSource.h"
+#include "AudioFileOpener.h"
+#include "AudioCallbackMonitor.h"
+#include "ThumbnailGenerationQueue.h"
+#include "Mp3SeekIndex.h"
+#include "Spectrogram.h"
+#include "SampleWindow.h"
+#include "SincResampler.h"
+#include "StartupTimeline.h"
+
+/** The part of the file that's shown, shared by the waveform and the overlay
+    that draws the playhead over it. Listeners are told when it changes.
+*/
+class WaveformViewport : public ChangeBroadcaster
+{
+public:
+    WaveformViewport()
+        : totalLength (0.0)
+    {
+    }
+    
+    /** Sets the length of the file, and shows all of it. */
+    void setTotalLength (double newTotalLength)
+    {
+        totalLength = jmax (0.0, newTotalLength);
+        visibleRange = Range<double> (0.0, totalLength);
+        sendChangeMessage();
+    }
+    
+    /** Lengthens the file, for one that's still being written. If the view was
+        showing the whole file it still does, and if it was showing the end, it
+        scrolls along to keep showing it; otherwise it stays where it is.
+    */
+    void extendTotalLength (double newTotalLength)
+    {
+        if (newTotalLength <= totalLength)
+            return;
+        
+        const bool wasShowingStart = visibleRange.getStart() <= 0.0;
+        const bool wasShowingEnd = visibleRange.getEnd() >= totalLength;
+        
+        totalLength = newTotalLength;
+        
+        if (wasShowingStart && wasShowingEnd)
+            visibleRange = Range<double> (0.0, totalLength);
+        else if (wasShowingEnd)
+            visibleRange = visibleRange.movedToEndAt (totalLength);
+        
+        sendChangeMessage();
+    }
+    
+    double getTotalLength() const noexcept              { return totalLength; }
+    Range<double> getVisibleRange() const noexcept      { return visibleRange; }
+    
+    /** Shows the given range, or as near to it as fits inside the file. */
+    void setVisibleRange (Range<double> newRange)
+    {
+        const double length = jlimit (jmin (minVisibleMilliseconds / 1000.0, totalLength), totalLength, newRange.getLength());
+        const double start  = jlimit (0.0, totalLength - length, newRange.getStart());
+        const Range<double> clamped (start, start + length);
+        
+        if (clamped != visibleRange)
+        {
+            visibleRange = clamped;
+            sendChangeMessage();
+        }
+    }
+    
+    /** Zooms in (factor < 1) or out (factor > 1), keeping the given time at the
+        same place on screen.
+    */
+    void zoom (double factor, double anchorTime)
+    {
+        if (visibleRange.isEmpty())
+            return;
+        
+        const double proportion = (anchorTime - visibleRange.getStart()) / visibleRange.getLength();
+        const double newLength  = jlimit (jmin (minVisibleMilliseconds / 1000.0, totalLength), totalLength, visibleRange.getLength() * factor);
+        const double newStart   = anchorTime - proportion * newLength;
+        
+        setVisibleRange (Range<double> (newStart, newStart + newLength));
+    }
+    
+    /** Moves the visible range by a whole number of pixels of a view that's the
+        given width, so that the waveform can be shifted rather than redrawn.
+    */
+    void scrollByPixels (int numPixels, int viewWidth)
+    {
+        if (viewWidth > 0)
+            setVisibleRange (visibleRange + numPixels * visibleRange.getLength() / viewWidth);
+    }
+    
+    double xToTime (float x, int viewWidth) const noexcept
+    {
+        return visibleRange.getStart() + visibleRange.getLength() * x / jmax (1, viewWidth);
+    }
+    
+    float timeToX (double time, int viewWidth) const noexcept
+    {
+        return visibleRange.isEmpty() ? 0.0f
+                                      : (float) ((time - visibleRange.getStart()) * viewWidth / visibleRange.getLength());
+    }
+    
+private:
+    enum
+    {
+        minVisibleMilliseconds = 10
+    };
+    
+    double totalLength;
+    Range<double> visibleRange;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (WaveformViewport)
+};
+
+//end of class WaveformViewport
+//------------------------------------------------------------------------------
 
 class SimpleThumbnailComponent : public Component,
                                  private ChangeListener
 {
 public:
+    enum DrawMode
+    {
+        drawPeaks,              // just the min/max outline
+        drawPeaksWithEnergy     // with the RMS level over it, and clipped columns marked
+    };
+    
+    enum
+    {
+        fitLanesToHeight = 0,   // for setChannelsPerLane()
+        minLaneHeight = 24
+    };
+    
     SimpleThumbnailComponent (int sourceSamplesPerThumbnailSample,
                               AudioFormatManager& formatManager,
-                              AudioThumbnailCache& cache)
-        : thumbnail (sourceSamplesPerThumbnailSample, formatManager, cache)
+                              DiskThumbnailCache& cacheToUse,
+                              ThreadPool& threadPool,
+                              WaveformViewport& viewportToUse)
+        : cache (cacheToUse),
+          thumbnail (sourceSamplesPerThumbnailSample, 5, formatManager, cacheToUse, threadPool), // 5 levels, each 4x coarser
+          sampleWindow (formatManager),
+          viewport (viewportToUse),
+          waveformColour (Colours::red),
+          drawMode (drawPeaks),
+          channelsPerLane (fitLanesToHeight)
     {
+        // everything's painted from the cached image or filled white, so nothing
+        // behind this ever needs repainting
+        setOpaque (true);
+        
+        // half floats take half the memory, with runs of silence stored once, and
+        // their error is far less than a pixel at any size this is shown at
+        thumbnail.setStorage (CompactMinMaxChannel::halfFloatFormat, true);
+        
+        // the RMS and clip counts come out of the same pass as the peaks, so they're
+        // always collected and the draw mode can change without reading anything
+        thumbnail.setCollectsEnergy (true);
         thumbnail.addChangeListener (this);
+        viewport.addChangeListener (this);
+    }
+    
+    ~SimpleThumbnailComponent()
+    {
+        viewport.removeChangeListener (this);
+    }
+    
+    /** Shows a file's thumbnail, from the cache if it's there. If it isn't, but
+        an earlier version of the file was thumbnailed, the file is hashed in blocks
+        and only the ones that have changed since are read.
+    */
+    void setFile (const File& file, int64 hashCode)
+    {
+        placeholderText = String();
+        sampleWindow.setFile (file);
+        thumbnail.setSource (new FileInputSource (file), hashCode, cache.getLatestVersionOf (file));
+    }
+    
+    void setSharedReader (MemoryMappedAudioFormatReader* reader, int64 hashCode)
+    {
+        placeholderText = String();
+        sampleWindow.setSharedReader (reader);
+        thumbnail.setSharedReader (reader, hashCode, reader != nullptr ? cache.getLatestVersionOf (reader->getFile()) : 0);
+    }
+    
+    /** Passes a file that's still being written on to the thumbnail, returning
+        false if it couldn't take it yet.
+    */
+    bool appendFromGrowingFile (const RawPcmReader& grownFile, int64 hashCode)
+    {
+        if (! thumbnail.appendFromGrowingFile (grownFile, hashCode))
+            return false;
+        
+        // the old reader still thinks the file ends where it did
+        sampleWindow.setFile (grownFile.file);
+        return true;
+    }
+    
+    /** Clears the waveform and shows a message instead, e.g. while a file is opening. */
+    void setPlaceholderText (const String& text)
+    {
+        placeholderText = text;
+        sampleWindow.clear();
+        thumbnail.clear();
+        repaint();
+    }
+    
+    void paint (Graphics& g) override
+    {
+        thumbnail.getNumChannels() == 0
+        ? paintIfNoFileLoaded(g)
+        : paintIfFileLoaded(g);
+    }
+    
+    void paintIfNoFileLoaded (Graphics& g)
+    {
+        g.fillAll (Colours::white);
+        g.setColour(Colours::darkgrey);
+        g.drawFittedText(placeholderText.isEmpty() ? "No File Loaded Yet" : placeholderText,
+                         getLocalBounds(), Justification::centred, 1.0f);
+    }
+    
+    /** Blits the cached waveform image, only drawing the waveform again if the
+        image is out of date. When the view has just been scrolled, the image is
+        shifted and only the newly exposed columns are drawn.
+    */
+    void paintIfFileLoaded (Graphics& g)
+    {
+        const Range<double> range (viewport.getVisibleRange().isEmpty() ? Range<double> (0.0, thumbnail.getTotalLength())
+                                                                        : viewport.getVisibleRange());
+        
+        const WaveformImageKey key (getLocalBounds(), g.getInternalContext().getPhysicalPixelScaleFactor(),
+                                    range.getStart(), range.getEnd(), 1.0f, waveformColour, drawMode,
+                                    channelsPerLane == fitLanesToHeight ? thumbnail.getChannelsPerLaneToFit (getHeight(), minLaneHeight)
+                                                                        : channelsPerLane);
+        
+        if (! (key == waveformImageKey) || waveformImage.isNull())
+        {
+            if (waveformImage.isNull() || ! scrollWaveformImage (key))
+                renderWaveformImage (key);
+            
+            waveformImageKey = key;
+        }
+        
+        g.drawImageTransformed (waveformImage, AffineTransform::scale (1.0f / key.scale));
+    }
+    
+    void setWaveformColour (Colour newColour)
+    {
+        if (newColour != waveformColour)
+        {
+            waveformColour = newColour;
+            repaint();
+        }
+    }
+    
+    void setDrawMode (DrawMode newMode)
+    {
+        if (newMode != drawMode)
+        {
+            drawMode = newMode;
+            repaint();
+        }
+    }
+    
+    /** Sets how many neighbouring channels share a lane, or fitLanesToHeight to
+        group just enough of them to keep every lane at least minLaneHeight high.
+    */
+    void setChannelsPerLane (int newChannelsPerLane)
+    {
+        if (newChannelsPerLane != channelsPerLane)
+        {
+            channelsPerLane = newChannelsPerLane;
+            repaint();
+        }
+    }
+    
+    void changeListenerCallback(ChangeBroadcaster* source) override
+    {
+        if(source == &thumbnail)
+            thumbnailChanged();
+        else if(source == &viewport)
+            repaint();
+    }
+    
+private:
+    /** Everything that the cached waveform image depends on, apart from the
+        thumbnail data itself, which invalidates it through thumbnailChanged().
+    */
+    struct WaveformImageKey
+    {
+        WaveformImageKey() : scale (1.0f), startTime (0), endTime (0), verticalZoom (0), mode (drawPeaks), channelsPerLane (1) {}
+        
+        WaveformImageKey (Rectangle<int> b, float s, double start, double end, float zoom, Colour c, DrawMode m, int lanes)
+            : bounds (b), scale (s), startTime (start), endTime (end), verticalZoom (zoom), colour (c), mode (m),
+              channelsPerLane (lanes) {}
+        
+        bool operator== (const WaveformImageKey& other) const noexcept
+        {
+            return startTime == other.startTime && endTime == other.endTime && isSameZoomAs (other);
+        }
+        
+        /** True if the two differ at most in where the visible range starts. */
+        bool isSameZoomAs (const WaveformImageKey& other) const noexcept
+        {
+            return bounds == other.bounds && scale == other.scale
+                    && std::abs ((endTime - startTime) - (other.endTime - other.startTime)) < 1.0e-9 * (endTime - startTime)
+                    && verticalZoom == other.verticalZoom && colour == other.colour && mode == other.mode
+                    && channelsPerLane == other.channelsPerLane;
+        }
+        
+        Rectangle<int> bounds;
+        float scale;
+        double startTime, endTime;
+        float verticalZoom;
+        Colour colour;
+        DrawMode mode;
+        int channelsPerLane;
+    };
+    
+    void renderWaveformImage (const WaveformImageKey& key)
+    {
+        const int width  = jmax (1, roundToInt (key.bounds.getWidth()  * key.scale));
+        const int height = jmax (1, roundToInt (key.bounds.getHeight() * key.scale));
+        
+        if (waveformImage.getWidth() != width || waveformImage.getHeight() != height)
+            waveformImage = Image (Image::RGB, width, height, false);
+        
+        Graphics g (waveformImage);
+        g.addTransform (AffineTransform::scale (key.scale));
+        g.fillAll (Colours::white);
+        
+        g.setColour (key.colour);                                       // [8]
+        drawWaveform (g, key);
+    }
+    
+    /** If the new key is the current image scrolled by a whole number of physical
+        pixels, moves the image's contents across and draws just the columns that
+        have come into view. Returns false if the image needs drawing from scratch.
+    */
+    bool scrollWaveformImage (const WaveformImageKey& key)
+    {
+        if (! key.isSameZoomAs (waveformImageKey))
+            return false;
+        
+        const int width = waveformImage.getWidth();
+        const double pixelsPerSecond = width / (key.endTime - key.startTime);
+        const double exactShift = (key.startTime - waveformImageKey.startTime) * pixelsPerSecond;
+        const int shift = roundToInt (exactShift);
+        
+        if (std::abs (exactShift - shift) > 0.01 || std::abs (shift) >= width)
+            return false;
+        
+        const int height = waveformImage.getHeight();
+        
+        if (shift > 0)
+            waveformImage.moveImageSection (0, 0, shift, 0, width - shift, height);
+        else
+            waveformImage.moveImageSection (-shift, 0, 0, 0, width + shift, height);
+        
+        const Rectangle<int> exposed (shift > 0 ? Rectangle<int> (width - shift, 0, shift, height)
+                                                : Rectangle<int> (0, 0, -shift, height));
+        
+        // the thumbnail only works out the columns inside the clip region
+        Graphics g (waveformImage);
+        g.reduceClipRegion (exposed);
+        g.addTransform (AffineTransform::scale (key.scale));
+        g.fillAll (Colours::white);
+        
+        g.setColour (key.colour);
+        drawWaveform (g, key);
+        return true;
+    }
+    
+    /** Draws from the thumbnail, or, once fewer source samples than its finest
+        points hold are shown per pixel, from the samples themselves, which the
+        sample window keeps a stretch of so that scrolling doesn't read them again.
+    */
+    void drawWaveform (Graphics& g, const WaveformImageKey& key)
+    {
+        const double samplesPerPixel = (key.endTime - key.startTime) * sampleWindow.getSampleRate() / key.bounds.getWidth();
+        
+        if (samplesPerPixel < thumbnail.getSamplesPerPoint (0)
+             && sampleWindow.drawChannels (g, key.bounds, key.startTime, key.endTime, key.verticalZoom, key.channelsPerLane))
+            return;
+        
+        thumbnail.drawChannelGroups (g,                                 // [9]
+                                     key.bounds,
+                                     key.startTime,                     // start time
+                                     key.endTime,                       // end time
+                                     key.verticalZoom,                  // vertical zoom
+                                     key.channelsPerLane);
+        
+        if (key.mode == drawPeaksWithEnergy)
+            thumbnail.drawEnergy (g, key.bounds, key.startTime, key.endTime, key.verticalZoom,
+                                  key.colour.darker (0.6f), Colours::orange, key.channelsPerLane);
+    }
+    
+    void thumbnailChanged()
+    {
+        waveformImage = Image();
+        repaint();
+    }
+    
+    DiskThumbnailCache& cache;
+    MultiResolutionThumbnail thumbnail;
+    SampleWindow sampleWindow;
+    WaveformViewport& viewport;
+    String placeholderText;
+    
+    Colour waveformColour;
+    DrawMode drawMode;
+    int channelsPerLane;
+    Image waveformImage;
+    WaveformImageKey waveformImageKey;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SimpleThumbnailComponent)
+};
+
+//end of class SimpleThumbnailComponent
+//------------------------------------------------------------------------------
+
+/** A lane under the waveform showing the same part of the file as a spectrogram.
+    Tiles are made in the background and drawn as they arrive; the image is only
+    rendered again when the view changes or another tile lands.
+*/
+class SpectrogramComponent : public Component,
+                             private ChangeListener
+{
+public:
+    SpectrogramComponent (AudioFormatManager& formatManager,
+                          SpectrogramTileCache& cache,
+                          ThreadPool& threadPool,
+                          WaveformViewport& viewportToUse)
+        : spectrogram (formatManager, cache, threadPool),
+          viewport (viewportToUse),
+          isImageOutOfDate (true)
+    {
+        setOpaque (true);
+        spectrogram.addChangeListener (this);
+        viewport.addChangeListener (this);
+    }
+    
+    ~SpectrogramComponent()
+    {
+        viewport.removeChangeListener (this);
+        spectrogram.removeChangeListener (this);
+    }
+    
+    void setFile (const File& file, int64 hashCode, double sampleRate, int64 lengthInSamples)
+    {
+        spectrogram.setFile (file, hashCode, sampleRate, lengthInSamples);
+        updateVisibleRange();
+    }
+    
+    void clear()
+    {
+        spectrogram.clear();
+    }
+    
+    void paint (Graphics& g) override
+    {
+        if (spectrogram.getTotalLength() <= 0.0)
+        {
+            g.fillAll (Colours::black);
+            return;
+        }
+        
+        const Range<double> range (getVisibleRange());
+        
+        if (isImageOutOfDate || range != imageRange
+             || image.getWidth() != getWidth() || image.getHeight() != getHeight())
+        {
+            if (image.getWidth() != getWidth() || image.getHeight() != getHeight())
+                image = Image (Image::RGB, jmax (1, getWidth()), jmax (1, getHeight()), false);
+            
+            // once every column has come from the right level, only a change of view
+            // needs it drawing again
+            isImageOutOfDate = ! spectrogram.render (image, range);
+            imageRange = range;
+        }
+        
+        g.drawImageAt (image, 0, 0);
+    }
+    
+    void resized() override
+    {
+        updateVisibleRange();
+    }
+    
+    void changeListenerCallback (ChangeBroadcaster* source) override
+    {
+        if (source == &spectrogram)
+            isImageOutOfDate = true;
+        else if (source == &viewport)
+            updateVisibleRange();
+        
+        repaint();
+    }
+    
+private:
+    Range<double> getVisibleRange() const
+    {
+        return viewport.getVisibleRange().isEmpty() ? Range<double> (0.0, spectrogram.getTotalLength())
+                                                    : viewport.getVisibleRange();
+    }
+    
+    void updateVisibleRange()
+    {
+        spectrogram.setVisibleRange (getVisibleRange(), getWidth());
+    }
+    
+    Spectrogram spectrogram;
+    WaveformViewport& viewport;
+    
+    Image image;
+    Range<double> imageRange;
+    bool isImageOutOfDate;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SpectrogramComponent)
+};
+
+//end of class SpectrogramComponent
+//------------------------------------------------------------------------------
+
+class SimplePositionOverlay : public Component,
+                              private Timer,
+                              private ChangeListener
+{
+public:
+    /** Told when the user selects a loop region, or clears it. */
+    class Listener
+    {
+    public:
+        virtual ~Listener() {}
+        
+        /** The region is in seconds, and is empty when the loop's been cleared. */
+        virtual void loopRegionChanged(Range<double> newRegion) = 0;
+    };
+    
+    SimplePositionOverlay(AudioTransportSource& transportSourceToUse,
+                          WaveformViewport& viewportToUse,
+                          Listener& listenerToUse)
+        : transportSource(transportSourceToUse),
+          viewport(viewportToUse),
+          listener(listenerToUse),
+          playheadX(-1),
+          isDragging(false),
+          isSelectingLoop(false),
+          loopAnchorTime(0.0)
+    {
+        // the timer only runs while the transport's playing
+        transportSource.addChangeListener(this);
+        viewport.addChangeListener(this);
+    }
+    
+    ~SimplePositionOverlay()
+    {
+        viewport.removeChangeListener(this);
+        transportSource.removeChangeListener(this);
+    }
+    
+    /** Moves the playhead to the transport's current position, invalidating only
+        the strips around its old and new positions. This needs calling when the
+        position changes while the transport is stopped.
+    */
+    void updatePlayhead()
+    {
+        const int newX = getPlayheadXForPosition();
+        
+        if (newX != playheadX)
+        {
+            repaintPlayheadStrip(playheadX);
+            playheadX = newX;
+            repaintPlayheadStrip(playheadX);
+        }
+    }
+    
+    /** Shows a loop region, in seconds, without telling the listener. */
+    void setLoopRegion(Range<double> newRegion)
+    {
+        if(newRegion != loopRegion)
+        {
+            loopRegion = newRegion;
+            repaint();
+        }
+    }
+    
+    Range<double> getLoopRegion() const noexcept    { return loopRegion; }
+    
+    void paint(Graphics& g) override
+    {
+        const Range<double> visibleRange (viewport.getVisibleRange());
+        
+        if(! loopRegion.isEmpty() && loopRegion.intersects(visibleRange))
+        {
+            const float startX = (float) viewport.timeToX(jmax(loopRegion.getStart(), visibleRange.getStart()), getWidth());
+            const float endX = (float) viewport.timeToX(jmin(loopRegion.getEnd(), visibleRange.getEnd()), getWidth());
+            
+            g.setColour(Colours::yellow.withAlpha(0.2f));
+            g.fillRect(startX, 0.0f, endX - startX, (float) getHeight());
+        }
+        
+        if(playheadX >= 0)
+        {
+            g.setColour(Colours::green);
+            g.drawLine((float) playheadX, 0.0f, (float) playheadX,
+                       (float) getHeight(), 2.0f);
+        }
+    }
+    
+    void resized() override
+    {
+        playheadX = getPlayheadXForPosition();
+    }
+    
+    //==========================================================================
+    // A click seeks, a drag scrolls, the wheel zooms (or scrolls, if it's a
+    // sideways movement) and a pinch zooms, all around the mouse position.
+    // With shift held, a drag selects a loop region and a click clears it.
+    
+    void mouseDown(const MouseEvent& event) override
+    {
+        isDragging = false;
+        lastDragX = 0;
+        isSelectingLoop = event.mods.isShiftDown() && ! viewport.getVisibleRange().isEmpty();
+        
+        if(isSelectingLoop)
+            loopAnchorTime = getTimeAt(event.position.x);
+    }
+    
+    void mouseDrag(const MouseEvent& event) override
+    {
+        if(! isDragging && std::abs(event.getDistanceFromDragStartX()) >= 3)   // below that, it's still a click
+            isDragging = true;
+        
+        if(isDragging && isSelectingLoop)
+        {
+            const double time = getTimeAt(event.position.x);
+            setLoopRegion(Range<double>(jmin(loopAnchorTime, time), jmax(loopAnchorTime, time)));
+        }
+        else if(isDragging)
+        {
+            // whole pixels, so that the waveform can be shifted instead of redrawn
+            const int dragX = event.getDistanceFromDragStartX();
+            viewport.scrollByPixels(lastDragX - dragX, getWidth());
+            lastDragX = dragX;
+        }
+    }
+    
+    void mouseUp(const MouseEvent& event) override
+    {
+        if(isSelectingLoop)
+        {
+            // the region's only decoded once it's been let go of
+            if(! isDragging)
+                setLoopRegion(Range<double>());
+            
+            listener.loopRegionChanged(loopRegion);
+            return;
+        }
+        
+        if(isDragging || viewport.getVisibleRange().isEmpty())
+            return;
+        
+        transportSource.setPosition(getTimeAt(event.position.x));
+        updatePlayhead();
+    }
+    
+    void mouseWheelMove(const MouseEvent& event, const MouseWheelDetails& wheel) override
+    {
+        const float direction = wheel.isReversed ? -1.0f : 1.0f;
+        
+        if(std::abs(wheel.deltaX) > std::abs(wheel.deltaY))
+            viewport.scrollByPixels(roundToInt(-wheel.deltaX * direction * getWidth() * 0.25f), getWidth());
+        else if(wheel.deltaY != 0.0f)
+            viewport.zoom(std::pow(2.0, -wheel.deltaY * direction * 2.0),
+                          viewport.xToTime(event.position.x, getWidth()));
+    }
+    
+    void mouseMagnify(const MouseEvent& event, float scaleFactor) override
+    {
+        if(scaleFactor > 0.0f)
+            viewport.zoom(1.0 / scaleFactor, viewport.xToTime(event.position.x, getWidth()));
+    }
+
+private:
+    void timerCallback() override
+    {
+        updatePlayhead();
+    }
+    
+    void changeListenerCallback(ChangeBroadcaster* source) override
+    {
+        if(source == &transportSource)
+        {
+            if(transportSource.isPlaying())
+                startTimer(40);
+            else
+                stopTimer();
+        }
+        else if(! loopRegion.isEmpty())
+        {
+            repaint();   // the view's moved
+        }
+        
+        updatePlayhead();
+    }
+    
+    /** Returns the time at an x position, kept within the file. */
+    double getTimeAt(float x) const
+    {
+        return jlimit(0.0, transportSource.getLengthInSeconds(), viewport.xToTime(x, getWidth()));
+    }
+    
+    /** Returns the x position of the playhead, or -1 if it's outside the visible range. */
+    int getPlayheadXForPosition() const
+    {
+        const Range<double> visibleRange (viewport.getVisibleRange());
+        const double position = transportSource.getCurrentPosition();
+        
+        if(visibleRange.isEmpty() || position < visibleRange.getStart() || position > visibleRange.getEnd())
+            return -1;
+        
+        return roundToInt(viewport.timeToX(position, getWidth()));
+    }
+    
+    void repaintPlayheadStrip(int x)
+    {
+        // wide enough for the 2-pixel line, however it lands on the pixel grid
+        if(x >= 0)
+            repaint(x - 2, 0, 5, getHeight());
+    }
+    
+    AudioTransportSource& transportSource;
+    WaveformViewport& viewport;
+    Listener& listener;
+    int playheadX;
+    bool isDragging;
+    int lastDragX;
+    bool isSelectingLoop;
+    double loopAnchorTime;
+    Range<double> loopRegion;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SimplePositionOverlay)
+};
+
+//end of class SimplePositionOverlay
+//------------------------------------------------------------------------------
+
+/** Drains an AudioCallbackMonitor a few times a second, shows the figures for the
+    current window as a line of text, and writes them to the log at the end of
+    each window.
+*/
+class AudioCallbackMonitorDisplay : public Component,
+                                    private Timer
+{
+public:
+    AudioCallbackMonitorDisplay (AudioCallbackMonitor& monitorToUse)
+        : monitor (monitorToUse),
+          windowStartTime (Time::getMillisecondCounter())
+    {
+        setInterceptsMouseClicks (false, false);
+        startTimer (250);
+    }
+    
+    void paint (Graphics& g) override
+    {
+        g.setColour (statistics.numCallbacks > 0 && statistics.maxLoadPercent >= 100.0 ? Colours::red
+                                                                                     : Colours::grey);
+        g.setFont (12.0f);
+        g.drawFittedText ("Audio callback: " + statistics.toString(),
+                          getLocalBounds(), Justification::centredLeft, 1);
     }
     
-    void setFile (const File& file)
+private:
+    enum
+    {
+        logIntervalMs = 10000
+    };
+    
+    void timerCallback() override
+    {
+        monitor.drain();
+        statistics = monitor.getStatistics();
+        repaint();
+        
+        if (Time::getMillisecondCounter() - windowStartTime >= (uint32) logIntervalMs)
+        {
+            if (statistics.numCallbacks > 0)
+                Logger::writeToLog ("Audio callback: " + statistics.toString());
+            
+            monitor.resetStatistics();
+            windowStartTime = Time::getMillisecondCounter();
+        }
+    }
+    
+    AudioCallbackMonitor& monitor;
+    AudioCallbackMonitor::Statistics statistics;
+    uint32 windowStartTime;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AudioCallbackMonitorDisplay)
+};
+
+//end of class AudioCallbackMonitorDisplay
+//------------------------------------------------------------------------------
+
+/** A scrolling list of every audio file in a folder, each with its waveform.
+ 
+    The ListBox only makes components for the rows on screen, and reuses them as
+    it scrolls, so a row's thumbnail is only ever in memory while it's visible.
+    Thumbnails are generated into their own cache by a ThumbnailGenerationQueue,
+    asking for the visible rows first and then a screenful either side, nearest
+    first; rows that scroll too far away are dropped from the queue, and their
+    generation is cancelled. The cache keeps a byte budget of recent thumbnails
+    in memory, on top of the ones on disk.
+*/
+class WaveformBrowser : public Component,
+                        private ListBoxModel,
+                        private ThumbnailGenerationQueue::Listener
+{
+public:
+    class Listener
+    {
+    public:
+        virtual ~Listener() {}
+        
+        /** Called when a row is double-clicked, or return is pressed on it. */
+        virtual void browserFileChosen (const File& file) = 0;
+    };
+    
+    WaveformBrowser (AudioFormatManager& formatManagerToUse, ThreadPool& threadPoolToUse, Listener& listenerToUse)
+      : formatManager (formatManagerToUse),
+        threadPool (threadPoolToUse),
+        listener (listenerToUse),
+        cache (getCacheDirectory(),
+               256 * 1024 * 1024,   // bytes of thumbnails to keep on disk
+               1),                  // the byte budget below does the work
+        generationQueue (finestSamplesPerThumbSample, numThumbnailLevels, formatManager, cache, threadPool,
+                         numFilesGeneratedAtOnce),
+        firstWantedRow (-1),
+        numWantedRows (0)
+    {
+        cache.setMaxBytesInMemory (32 * 1024 * 1024);
+        generationQueue.addListener (this);
+        
+        list.setModel (this);
+        list.setRowHeight (rowHeight);
+        addAndMakeVisible (&list);
+    }
+    
+    ~WaveformBrowser()
+    {
+        generationQueue.removeListener (this);
+    }
+    
+    /** Lists the audio files in a folder and everything below it. */
+    void setDirectory (const File& directory)
+    {
+        files.clearQuick();
+        
+        DirectoryIterator iter (directory, true, formatManager.getWildcardForAllFormats(), File::findFiles);
+        
+        while (iter.next())
+            files.add (iter.getFile());
+        
+        NaturalFileOrder order;
+        files.sort (order);
+        
+        hashCodes.clearQuick();
+        hashCodes.insertMultiple (0, 0, files.size());
+        
+        list.updateContent();
+        list.scrollToEnsureRowIsOnscreen (0);
+        updateWantedFiles (true);
+    }
+    
+    void resized() override
+    {
+        list.setBounds (getLocalBounds());
+        updateWantedFiles (false);
+    }
+    
+private:
+    enum
+    {
+        // much coarser than the main waveform, as rows are short and narrow
+        finestSamplesPerThumbSample = 1024,
+        numThumbnailLevels = 3,
+        numFilesGeneratedAtOnce = 4,
+        rowHeight = 40,
+        nameWidth = 180,
+        minRowLaneHeight = 8    // rows of files with more channels than fit show them in groups
+    };
+    
+    //==========================================================================
+    /** One row of the list: the file's name, and its waveform once that's in the
+        cache. Clicks go through to the ListBox, which selects the row.
+    */
+    class Row : public Component
     {
-        thumbnail.setSource (new FileInputSource (file));
-    }
+    public:
+        Row (WaveformBrowser& ownerToUse)
+          : owner (ownerToUse),
+            thumbnail (finestSamplesPerThumbSample, numThumbnailLevels, owner.formatManager, owner.cache, owner.threadPool),
+            hashCode (0),
+            isLoaded (false)
+        {
+            setInterceptsMouseClicks (false, false);
+        }
+        
+        void setFile (const File& newFile, int64 newHashCode)
+        {
+            if (newHashCode != hashCode)
+            {
+                file = newFile;
+                hashCode = newHashCode;
+                loadFromCache();
+            }
+        }
+        
+        void thumbnailGenerated (int64 generatedHashCode)
+        {
+            if (generatedHashCode == hashCode && ! isLoaded)
+                loadFromCache();
+        }
+        
+        bool needsThumbnail() const noexcept        { return hashCode != 0 && ! isLoaded; }
+        
+        void paint (Graphics& g) override
+        {
+            Rectangle<int> area (getLocalBounds().reduced (4, 2));
+            
+            g.setColour (Colours::black);
+            g.drawFittedText (file.getFileName(), area.removeFromLeft (nameWidth), Justification::centredLeft, 2);
+            
+            if (isLoaded)
+            {
+                g.setColour (Colours::red);
+                thumbnail.drawChannelGroups (g, area, 0.0, thumbnail.getTotalLength(), 1.0f,
+                                             thumbnail.getChannelsPerLaneToFit (area.getHeight(), minRowLaneHeight));
+            }
+            else
+            {
+                g.setColour (Colours::grey);
+                g.drawFittedText ("...", area, Justification::centred, 1);
+            }
+        }
+        
+    private:
+        WaveformBrowser& owner;
+        MultiResolutionThumbnail thumbnail;
+        File file;
+        int64 hashCode;
+        bool isLoaded;
+        
+        /** Only ever loads from the cache; generating is left to the queue. */
+        void loadFromCache()
+        {
+            thumbnail.clear();
+            isLoaded = hashCode != 0 && owner.cache.loadThumb (thumbnail, hashCode);
+            
+            if (isLoaded)
+                thumbnail.setStorage (CompactMinMaxChannel::eightBitFormat, true);
+            
+            repaint();
+        }
+        
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Row)
+    };
     
-    void paint (Graphics& g) override
+    struct NaturalFileOrder
     {
-        thumbnail.getNumChannels() == 0
-        ? paintIfNoFileLoaded(g)
-        : paintIfFileLoaded(g);
-    }
+        static int compareElements (const File& a, const File& b)
+        {
+            return a.getFullPathName().compareNatural (b.getFullPathName());
+        }
+    };
     
-    void paintIfNoFileLoaded (Graphics& g)
+    //==========================================================================
+    AudioFormatManager& formatManager;
+    ThreadPool& threadPool;
+    Listener& listener;
+    DiskThumbnailCache cache;
+    ThumbnailGenerationQueue generationQueue;
+    ListBox list;
+    Array<File> files;
+    Array<int64> hashCodes;     // worked out when a row is first near the view
+    int firstWantedRow, numWantedRows;
+    
+    int64 getHashCodeForRow (int row)
     {
-        g.fillAll (Colours::white);
-        g.setColour(Colours::darkgrey);
-        g.drawFittedText("No File Loaded Yet", getLocalBounds(), Justification::centred, 1.0f);
+        int64& hash = hashCodes.getReference (row);
+        
+        if (hash == 0)
+            hash = DiskThumbnailCache::getHashFor (files.getReference (row));
+        
+        return hash;
     }
     
-    void paintIfFileLoaded (Graphics& g)
+    /** Asks for the visible rows that still need thumbnails, then for a screenful
+        above and below, nearest first. Nothing happens until the view has moved by
+        a whole row.
+    */
+    void updateWantedFiles (bool force)
     {
-        g.fillAll (Colours::white);
+        const int firstVisible = jmax (0, list.getViewport()->getViewPositionY() / rowHeight);
+        const int numVisible = list.getViewport()->getViewHeight() / rowHeight + 1;
         
-        g.setColour (Colours::red);                                     // [8]
-        thumbnail.drawChannels (g,                                      // [9]
-                                getLocalBounds(),
-                                0.0,                                    // start time
-                                thumbnail.getTotalLength(),                            // end time
-                                1.0f);                                  // vertical zoom
+        if (! force && firstVisible == firstWantedRow && numVisible == numWantedRows)
+            return;
+        
+        firstWantedRow = firstVisible;
+        numWantedRows = numVisible;
+        
+        const int endVisible = jmin (files.size(), firstVisible + numVisible);
+        Array<ThumbnailGenerationQueue::Request> wanted;
+        
+        for (int i = firstVisible; i < endVisible; ++i)
+        {
+            Row* const row = dynamic_cast<Row*> (list.getComponentForRowNumber (i));
+            
+            if (row == nullptr || row->needsThumbnail())
+                wanted.add (ThumbnailGenerationQueue::Request (files.getReference (i), getHashCodeForRow (i)));
+        }
+        
+        for (int n = 0; n < numVisible; ++n)
+        {
+            if (endVisible + n < files.size())
+                wanted.add (ThumbnailGenerationQueue::Request (files.getReference (endVisible + n), getHashCodeForRow (endVisible + n)));
+            
+            if (firstVisible - 1 - n >= 0)
+                wanted.add (ThumbnailGenerationQueue::Request (files.getReference (firstVisible - 1 - n), getHashCodeForRow (firstVisible - 1 - n)));
+        }
+        
+        generationQueue.setWantedFiles (wanted);
     }
     
-    void changeListenerCallback(ChangeBroadcaster* source) override
+    //==========================================================================
+    int getNumRows() override
     {
-        if(source == &thumbnail)
-            thumbnailChanged();
+        return files.size();
     }
     
-private:
-    void thumbnailChanged()
+    void paintListBoxItem (int, Graphics& g, int, int, bool rowIsSelected) override
     {
-        repaint();
+        if (rowIsSelected)
+            g.fillAll (Colours::lightblue);
     }
     
-    AudioThumbnail thumbnail;
+    Component* refreshComponentForRow (int rowNumber, bool, Component* existingComponentToUpdate) override
+    {
+        Row* row = static_cast<Row*> (existingComponentToUpdate);  // the ListBox only hands back rows made here
+        
+        if (! isPositiveAndBelow (rowNumber, files.size()))
+        {
+            delete row;
+            return nullptr;
+        }
+        
+        if (row == nullptr)
+            row = new Row (*this);
+        
+        row->setFile (files.getReference (rowNumber), getHashCodeForRow (rowNumber));
+        return row;
+    }
     
-    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SimpleThumbnailComponent)
-};
-
-//end of class SimpleThumbnailComponent
-//------------------------------------------------------------------------------
-
-class SimplePositionOverlay : public Component,
-                              private Timer
-{
-public:
-    SimplePositionOverlay(AudioTransportSource& transportSourceToUse)
-        : transportSource(transportSourceToUse)
+    void listWasScrolled() override
     {
-        startTimer(40);
+        updateWantedFiles (false);
     }
     
-    void paint(Graphics& g) override
+    void listBoxItemDoubleClicked (int row, const MouseEvent&) override
     {
-        const double duration = transportSource.getLengthInSeconds();
-        
-        if(duration > 0.0)
-        {            
-            const double audioPosition = transportSource.getCurrentPosition();
-            const float drawPosition = (audioPosition / duration) * getWidth();
-            
-            g.setColour(Colours::green);
-            g.drawLine(drawPosition, 0.0f, drawPosition,
-                       (float) getHeight(), 2.0f);
-        }
+        if (isPositiveAndBelow (row, files.size()))
+            listener.browserFileChosen (files.getReference (row));
     }
     
-    void mouseDown(const MouseEvent& event) override
+    void returnKeyPressed (int lastRowSelected) override
     {
-        const double duration = transportSource.getLengthInSeconds();
-
-        if(duration > 0.0)
-        {
-            const double clickPosition = event.position.x;
-            const double audioPosition = (clickPosition / getWidth()) * duration;
-
-            transportSource.setPosition(audioPosition);
-        }
+        if (isPositiveAndBelow (lastRowSelected, files.size()))
+            listener.browserFileChosen (files.getReference (lastRowSelected));
     }
-
-private:
-    void timerCallback() override
+    
+    void thumbnailGenerated (const ThumbnailGenerationQueue::Request& request) override
     {
-        repaint();
+        for (int i = firstWantedRow; i < firstWantedRow + numWantedRows; ++i)
+            if (Row* const row = dynamic_cast<Row*> (list.getComponentForRowNumber (i)))
+                row->thumbnailGenerated (request.hashCode);
     }
     
-    AudioTransportSource& transportSource;
+    static File getCacheDirectory()
+    {
+        return File::getSpecialLocation (File::userApplicationDataDirectory)
+                 .getChildFile ("AudioThumbnailTutorial")
+                 .getChildFile ("BrowserThumbnailCache");
+    }
     
-    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SimplePositionOverlay)
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (WaveformBrowser)
 };
 
-//end of class SimplePositionOverlay
+//end of class WaveformBrowser
 //------------------------------------------------------------------------------
 
 class MainContentComponent   : public AudioAppComponent,
                                public ChangeListener,
-                               public ButtonListener
+                               public ButtonListener,
+                               private ComboBoxListener,
+                               private AudioFileOpener::Listener,
+                               private WaveformBrowser::Listener,
+                               private SimplePositionOverlay::Listener,
+                               private Timer,
+                               private AsyncUpdater
 {
 public:
+    /** Unless the app was started with --synchronous-startup, the window is shown
+        straight away, and the audio formats and device are set up on a background
+        thread. Opening files is disabled until they're ready, and then the startup
+        timeline is logged.
+    */
     MainContentComponent()
-      : state (Stopped),
-        thumbnailCache (5),                            // [4]
-        thumbnailComp (512, formatManager, thumbnailCache), // [5]
-        positionOverlay(transportSource)
+      : fileOpener (formatManager, *this),
+        readAheadThread ("Audio read-ahead"),
+        playbackSampleRate (0.0),
+        state (Stopped),
+        followedFileSize (0),
+        thumbnailCache (getThumbnailCacheDirectory(),   // [4]
+                        256 * 1024 * 1024,              // bytes of thumbnails to keep on disk
+                        5),                             // thumbnails to keep in memory
+        thumbnailThreads (SystemStats::getNumCpus()),
+        thumbnailComp (64, formatManager, thumbnailCache, thumbnailThreads, viewport), // [5]
+        positionOverlay(transportSource, viewport, *this),
+        spectrogramCache (getSpectrogramCacheDirectory(),
+                          256 * 1024 * 1024,            // bytes of tiles to keep on disk
+                          32 * 1024 * 1024),            // bytes of tiles to keep in memory
+        spectrogramThreads (jmax (1, SystemStats::getNumCpus() / 2)),
+        spectrogramComp (formatManager, spectrogramCache, spectrogramThreads, viewport),
+        browser (formatManager, thumbnailThreads, *this),
+        callbackMonitorDisplay (callbackMonitor),
+        startupThread (*this)
     {
         setLookAndFeel (&lookAndFeel);
         
@@ -135,6 +1152,10 @@ public:
         openButton.setButtonText ("Open...");
         openButton.addListener (this);
         
+        addAndMakeVisible (&browseButton);
+        browseButton.setButtonText ("Browse folder...");
+        browseButton.addListener (this);
+        
         addAndMakeVisible (&playButton);
         playButton.setButtonText ("Play");
         playButton.addListener (this);
@@ -147,29 +1168,94 @@ public:
         stopButton.setColour (TextButton::buttonColourId, Colours::red);
         stopButton.setEnabled (false);
         
+        addAndMakeVisible (&mapFilesButton);
+        mapFilesButton.setButtonText ("Memory-map WAV and AIFF files");
+        mapFilesButton.setToggleState (true, dontSendNotification);
+        
+        addAndMakeVisible (&channelsPerLaneBox);
+        channelsPerLaneBox.addItem ("Fit channel lanes to the height", fitLanesItem);
+        channelsPerLaneBox.addItem ("One lane per channel", 1);
+        
+        for (int n = 2; n <= maxChannelsPerLaneItem; n *= 2)
+            channelsPerLaneBox.addItem (String (n) + " channels per lane", n);
+        
+        channelsPerLaneBox.setSelectedId (fitLanesItem, dontSendNotification);
+        channelsPerLaneBox.addListener (this);
+        
+        addAndMakeVisible (&readAheadButton);
+        readAheadButton.setButtonText ("Read ahead on a background thread");
+        readAheadButton.setToggleState (true, dontSendNotification);
+        
+        addAndMakeVisible (&resamplerBox);
+        resamplerBox.addItem ("Interpolating resampler", interpolatingResampler);
+        resamplerBox.addItem ("Sinc resampler, draft quality", sincResamplerBase + SincResampler::draftQuality);
+        resamplerBox.addItem ("Sinc resampler, good quality", sincResamplerBase + SincResampler::goodQuality);
+        resamplerBox.addItem ("Sinc resampler, best quality", sincResamplerBase + SincResampler::bestQuality);
+        resamplerBox.setSelectedId (sincResamplerBase + SincResampler::goodQuality, dontSendNotification);
+        resamplerBox.addListener (this);
+        
+        addAndMakeVisible (&followGrowthButton);
+        followGrowthButton.setButtonText ("Follow WAV files that are still being written");
+        
+        addAndMakeVisible (&showEnergyButton);
+        showEnergyButton.setButtonText ("Show RMS and clipping");
+        showEnergyButton.addListener (this);
+        
         addAndMakeVisible(&thumbnailComp);
         addAndMakeVisible(&positionOverlay);
+        addAndMakeVisible (&spectrogramComp);
+        addAndMakeVisible (&browser);
         
-        setSize (600, 400);
+       #if JUCE_DEBUG
+        addAndMakeVisible (&callbackMonitorDisplay);
+       #else
+        addChildComponent (&callbackMonitorDisplay);  // still drains the monitor and writes the log
+       #endif
         
-        formatManager.registerBasicFormats();
+        setSize (600, 700);
+        
+        readAheadThread.startThread (8);  // above normal, so it keeps ahead of a busy message thread
         transportSource.addChangeListener (this);
         
-        setAudioChannels (2, 2);
+        if (JUCEApplicationBase::getCommandLineParameterArray().contains ("--synchronous-startup"))
+        {
+            initialiseFormatsAndAudio();
+            startupFinished();
+        }
+        else
+        {
+            // nothing may use the format manager or the device until this is done
+            openButton.setEnabled (false);
+            browseButton.setEnabled (false);
+            thumbnailComp.setPlaceholderText ("Opening the audio device...");
+            startupThread.startThread();
+        }
     }
     
     ~MainContentComponent()
     {
+        // opening a device can't be interrupted, so this waits for it to finish
+        startupThread.waitForThreadToExit (-1);
+        cancelPendingUpdate();
         shutdownAudio();
     }
     
+    void paint (Graphics&) override
+    {
+        StartupTimeline::getInstance().mark ("first paint");
+        logStartupTimeline();
+    }
+    
     void prepareToPlay (int samplesPerBlockExpected, double sampleRate) override
     {
+        callbackMonitor.prepare (sampleRate);
         transportSource.prepareToPlay (samplesPerBlockExpected, sampleRate);
     }
     
     void getNextAudioBlock (const AudioSourceChannelInfo& bufferToFill) override
     {
+        const AudioCallbackMonitor::ScopedMeasurement measurement (callbackMonitor, bufferToFill.numSamples);
+        
         readerSource == nullptr
             ? bufferToFill.clearActiveBufferRegion()
             : transportSource.getNextAudioBlock (bufferToFill);
@@ -183,13 +1269,25 @@ public:
     
     void resized() override
     {
-        openButton.setBounds (10, 10, getWidth() - 20, 20);
+        openButton.setBounds (10, 10, getWidth() / 2 - 15, 20);
+        browseButton.setBounds (getWidth() / 2 + 5, 10, getWidth() / 2 - 15, 20);
         playButton.setBounds (10, 40, getWidth() - 20, 20);
         stopButton.setBounds (10, 70, getWidth() - 20, 20);
+        mapFilesButton.setBounds (10, 100, getWidth() / 2 - 15, 20);
+        channelsPerLaneBox.setBounds (getWidth() / 2 + 5, 100, getWidth() / 2 - 15, 20);
+        readAheadButton.setBounds (10, 130, getWidth() / 2 - 15, 20);
+        resamplerBox.setBounds (getWidth() / 2 + 5, 130, getWidth() / 2 - 15, 20);
+        followGrowthButton.setBounds (10, 160, getWidth() / 2 - 15, 20);
+        showEnergyButton.setBounds (getWidth() / 2 + 5, 160, getWidth() / 2 - 15, 20);
         
-        const Rectangle<int> thumbnailBounds(10, 100, getWidth() - 20, getHeight() - 120);
+        // the waveform, its spectrogram and the browser share what's left, above the monitor
+        const int laneHeight = (getHeight() - 235) / 5;
+        const Rectangle<int> thumbnailBounds(10, 190, getWidth() - 20, laneHeight * 2);
         thumbnailComp.setBounds(thumbnailBounds);
         positionOverlay.setBounds(thumbnailBounds);
+        spectrogramComp.setBounds (10, thumbnailBounds.getBottom() + 5, getWidth() - 20, laneHeight);
+        browser.setBounds (10, spectrogramComp.getBottom() + 10, getWidth() - 20, getHeight() - 30 - (spectrogramComp.getBottom() + 10));
+        callbackMonitorDisplay.setBounds (10, getHeight() - 20, getWidth() - 20, 20);
     }
     
     void changeListenerCallback (ChangeBroadcaster* source) override
@@ -201,12 +1299,32 @@ public:
     void buttonClicked (Button* button) override
     {
         if (button == &openButton)  openButtonClicked();
+        if (button == &browseButton)  browseButtonClicked();
         if (button == &playButton)  playButtonClicked();
         if (button == &stopButton)  stopButtonClicked();
+        if (button == &showEnergyButton)  showEnergyButtonClicked();
     }
     
     
 private:
+    enum
+    {
+        readAheadMilliseconds = 1000,   // how far ahead of the play position the read-ahead thread keeps the buffer
+        followGrowthMilliseconds = 500  // how often a file that's being followed is checked for new samples
+    };
+    
+    enum
+    {
+        fitLanesItem = 1000,            // the others' IDs are their channels per lane
+        maxChannelsPerLaneItem = 64
+    };
+    
+    enum ResamplerId
+    {
+        interpolatingResampler = 1,     // the transport's own ResamplingAudioSource
+        sincResamplerBase               // plus a SincResampler::Quality
+    };
+    
     enum TransportState
     {
         Stopped,
@@ -227,10 +1345,18 @@ private:
                     stopButton.setEnabled (false);
                     playButton.setEnabled (true);
                     transportSource.setPosition (0.0);
+                    positionOverlay.updatePlayhead();
                     break;
                     
                 case Starting:
                     playButton.setEnabled (false);
+                    
+                    if (readAheadSource != nullptr)
+                        readAheadSource->resetCounters();
+                    
+                    if (loopSource != nullptr)
+                        loopSource->resetStatistics();
+                    
                     transportSource.start();
                     break;
                     
@@ -240,6 +1366,7 @@ private:
                     
                 case Stopping:
                     transportSource.stop();
+                    logPlaybackCounters();
                     break;
                     
                 default:
@@ -256,24 +1383,299 @@ private:
 
     void openButtonClicked()
     {
-        FileChooser chooser ("Select a Wave file to play...",
+        FileChooser chooser ("Select an audio file to play...",
                              File::nonexistent,
-                             "*.wav");
+                             formatManager.getWildcardForAllFormats());
         
         if (chooser.browseForFileToOpen())
+            openFile (chooser.getResult());
+    }
+    
+    void browseButtonClicked()
+    {
+        FileChooser chooser ("Select a folder of audio files to browse...",
+                             File::nonexistent);
+        
+        if (chooser.browseForDirectory())
+            browser.setDirectory (chooser.getResult());
+    }
+    
+    void browserFileChosen (const File& file) override
+    {
+        openFile (file);
+    }
+    
+    /** Registers the formats and opens the audio device, which can take a while
+        as the device types are probed. It's called from the startup thread unless
+        startup is synchronous.
+    */
+    void initialiseFormatsAndAudio()
+    {
+       #if JUCE_USE_MP3AUDIOFORMAT
+        // ahead of the basic formats, so that it's the one that reads MP3 files
+        formatManager.registerFormat (new IndexedMp3AudioFormat (getSeekIndexDirectory()), false);
+       #endif
+        formatManager.registerBasicFormats();
+        StartupTimeline::getInstance().mark ("formats registered");
+        
+        setAudioChannels (2, 2);
+    }
+    
+    void handleAsyncUpdate() override
+    {
+        startupFinished();
+    }
+    
+    /** Lets files be opened, once the formats and device are ready. */
+    void startupFinished()
+    {
+        openButton.setEnabled (true);
+        browseButton.setEnabled (true);
+        
+        if (readerSource == nullptr)
+            thumbnailComp.setPlaceholderText (String());
+        
+        StartupTimeline::getInstance().mark ("audio ready");
+        logStartupTimeline();
+    }
+    
+    void logStartupTimeline()
+    {
+        static const char* const finalStages[] = { "first paint", "audio ready" };
+        StartupTimeline::getInstance().logOnceReached (StringArray (finalStages, numElementsInArray (finalStages)));
+    }
+    
+    void openFile (const File& file)
+    {
+        // the file is opened on the opener's thread, which calls audioFileOpened() when it's done
+        thumbnailComp.setPlaceholderText ("Opening " + file.getFileName() + "...");
+        
+        // the opener streams files that are followed, as a mapping can't grow with the file
+        fileOpener.open (file, mapFilesButton.getToggleState(), followGrowthButton.getToggleState());
+    }
+    
+    /** Swaps in a file that the opener has finished with. If it was memory-mapped,
+        playback and the thumbnail both read from the one mapping.
+    */
+    void audioFileOpened (AudioFileOpener::OpenedFile& openedFile) override
+    {
+        playbackFile = openedFile.file;
+        loopRegionSeconds = Range<double>();
+        positionOverlay.setLoopRegion (loopRegionSeconds);
+        
+        setPlaybackSource (openedFile.source, openedFile.sampleRate);
+        viewport.setTotalLength (transportSource.getLengthInSeconds());
+        positionOverlay.updatePlayhead();
+        playButton.setEnabled (true);
+        
+        if (openedFile.mappedReader != nullptr)
+            thumbnailComp.setSharedReader (openedFile.mappedReader, openedFile.hashCode);
+        else
+            thumbnailComp.setFile (openedFile.file, openedFile.hashCode);          // [7]
+        
+        spectrogramComp.setFile (openedFile.file, openedFile.hashCode, openedFile.sampleRate,
+                                 openedFile.source->getAudioFormatReader()->lengthInSamples);
+        
+        // the old source and thumbnail have both let go of the previous reader by now
+        readerSource = openedFile.source.release();
+        mappedReader = openedFile.mappedReader.release();
+        
+        // decided when the file was opened, as that decided whether it was mapped
+        startFollowing (openedFile.followGrowth && mappedReader == nullptr ? openedFile.file : File());
+    }
+    
+    void audioFileOpenFailed (const File& file) override
+    {
+        thumbnailComp.setPlaceholderText ("Couldn't open " + file.getFileName());
+        spectrogramComp.clear();
+    }
+    
+    /** Hands a new source to the transport, wrapped in a ReadAheadAudioSource if
+        that's switched on, so that the audio callback never waits for the disk.
+        
+        On top of that goes a LoopRegionAudioSource, which plays the loop region
+        from memory once it's been decoded on the read-ahead thread. If a sinc
+        resampler is chosen, that goes on top and the transport is told the source
+        is already at the device's rate, so that the transport's own interpolating
+        resampler is left out.
+    */
+    void setPlaybackSource (AudioFormatReaderSource* newSource, double sampleRate)
+    {
+        ScopedPointer<ReadAheadAudioSource> newReadAhead;
+        ScopedPointer<LoopRegionAudioSource> newLoop;
+        ScopedPointer<SincResamplingAudioSource> newResampler;
+        playbackSampleRate = sampleRate;
+        
+        if (readAheadButton.getToggleState())
+            newReadAhead = new ReadAheadAudioSource (newSource, false, readAheadThread, 2,
+                                                     readAheadMilliseconds / 1000.0);
+        
+        PositionableAudioSource* source = newReadAhead != nullptr ? static_cast<PositionableAudioSource*> (newReadAhead)
+                                                                  : newSource;
+        
+        source = newLoop = new LoopRegionAudioSource (source, false, formatManager, playbackFile, readAheadThread);
+        newLoop->setLoopRegion (getLoopRegionInSamples());
+        
+        const int resamplerId = resamplerBox.getSelectedId();
+        
+        if (resamplerId >= sincResamplerBase)
         {
-            File file (chooser.getResult());
-            AudioFormatReader* reader = formatManager.createReaderFor (file);
-            
-            if (reader != nullptr)
-            {
-                ScopedPointer<AudioFormatReaderSource> newSource = new AudioFormatReaderSource (reader, true);
-                transportSource.setSource (newSource, 0, nullptr, reader->sampleRate);
-                playButton.setEnabled (true);
-                thumbnailComp.setFile (file);          // [7]
-                readerSource = newSource.release();
-            }
+            source = newResampler = new SincResamplingAudioSource (source, false, sampleRate,
+                                                                   (SincResampler::Quality) (resamplerId - sincResamplerBase));
+            sampleRate = 0;
+        }
+        
+        transportSource.setSource (source, 0, nullptr, sampleRate);
+        
+        // the transport has let go of the old ones, which still refer to the old reader source
+        resamplingSource = newResampler;
+        loopSource = newLoop;
+        readAheadSource = newReadAhead;
+    }
+    
+    void loopRegionChanged (Range<double> newRegion) override
+    {
+        loopRegionSeconds = newRegion;
+        
+        if (loopSource != nullptr && ! loopSource->setLoopRegion (getLoopRegionInSamples()))
+        {
+            DBG ("Loop region too long to hold in memory");
+            loopRegionSeconds = Range<double>();
+            positionOverlay.setLoopRegion (loopRegionSeconds);
+        }
+    }
+    
+    Range<int64> getLoopRegionInSamples() const
+    {
+        return Range<int64> ((int64) (loopRegionSeconds.getStart() * playbackSampleRate),
+                             (int64) (loopRegionSeconds.getEnd() * playbackSampleRate));
+    }
+    
+    void comboBoxChanged (ComboBox* box) override
+    {
+        if (box == &resamplerBox)
+            resamplerChanged();
+        else if (box == &channelsPerLaneBox)
+            thumbnailComp.setChannelsPerLane (channelsPerLaneBox.getSelectedId() == fitLanesItem
+                                                ? (int) SimpleThumbnailComponent::fitLanesToHeight
+                                                : channelsPerLaneBox.getSelectedId());
+    }
+    
+    /** Rebuilds the playback chain around the current file with the chosen
+        resampler, carrying on from the same place.
+    */
+    void resamplerChanged()
+    {
+        if (readerSource == nullptr)
+            return;
+        
+        const bool wasPlaying = transportSource.isPlaying();
+        const double position = transportSource.getCurrentPosition();
+        
+        setPlaybackSource (readerSource, playbackSampleRate);
+        transportSource.setPosition (position);
+        
+        if (wasPlaying)
+            transportSource.start();
+    }
+    
+    /** Starts polling a file for samples that have been added to it since it was
+        opened, or stops if it's File(). Only uncompressed WAV files that
+        RawPcmReader understands can be followed.
+    */
+    void startFollowing (const File& file)
+    {
+        stopTimer();
+        followedFile = File();
+        followedFileSize = 0;
+        
+        if (file == File())
+            return;
+        
+        ScopedPointer<RawPcmReader> header (RawPcmReader::createFor (file, true));
+        
+        if (header == nullptr)
+        {
+            DBG ("Can't follow " << file.getFileName() << ": only uncompressed WAV files can be followed");
+            return;
+        }
+        
+        followedFile = file;
+        startTimer (followGrowthMilliseconds);
+        
+        // the header may already be out of date
+        checkFollowedFile();
+    }
+    
+    void timerCallback() override
+    {
+        checkFollowedFile();
+    }
+    
+    /** If the followed file has grown, lengthens the transport and the view, and
+        gets the thumbnail to read just the new samples. Nothing is read again, and
+        nothing about playback is reset.
+    */
+    void checkFollowedFile()
+    {
+        const int64 size = followedFile.getSize();
+        
+        if (size == followedFileSize || readerSource == nullptr)
+            return;
+        
+        ScopedPointer<RawPcmReader> grownFile (RawPcmReader::createFor (followedFile, true));
+        
+        if (grownFile == nullptr)
+            return;
+        
+        // the reader itself is lengthened by the thread that's reading from it
+        GrowingAudioFormatReaderSource* const growingSource = dynamic_cast<GrowingAudioFormatReaderSource*> (readerSource.get());
+        
+        if (growingSource != nullptr && grownFile->lengthInSamples > growingSource->getTotalLength())
+        {
+            growingSource->setTotalLength (grownFile->lengthInSamples);
+            viewport.extendTotalLength (transportSource.getLengthInSeconds());
+            positionOverlay.updatePlayhead();
         }
+        
+        // if the thumbnail is still busy, it's tried again next time, which only
+        // costs another look at the header
+        if (thumbnailComp.appendFromGrowingFile (*grownFile, DiskThumbnailCache::getHashFor (followedFile)))
+            followedFileSize = size;
+    }
+    
+    void logPlaybackCounters()
+    {
+        if (readAheadSource != nullptr)
+            DBG ("Read-ahead: " << readAheadSource->getNumUnderruns() << " underruns ("
+                  << readAheadSource->getNumSamplesMissed() << " samples), "
+                  << readAheadSource->getNumSeekStalls() << " seek stalls, lowest fill "
+                  << readAheadSource->getMinSamplesBuffered() << " of " << readAheadSource->getBufferSize()
+                  << " samples, " << readAheadSource->getNumReadsOffBackgroundThread() << " reads off the read-ahead thread");
+        
+        if (loopSource != nullptr && loopSource->getStatistics().numWraps > 0)
+            DBG ("Loop: " << loopSource->getStatistics().toString());
+    }
+    
+    static File getThumbnailCacheDirectory()
+    {
+        return File::getSpecialLocation (File::userApplicationDataDirectory)
+                 .getChildFile ("AudioThumbnailTutorial")
+                 .getChildFile ("ThumbnailCache");
+    }
+    
+    static File getSpectrogramCacheDirectory()
+    {
+        return File::getSpecialLocation (File::userApplicationDataDirectory)
+                 .getChildFile ("AudioThumbnailTutorial")
+                 .getChildFile ("SpectrogramCache");
+    }
+    
+    static File getSeekIndexDirectory()
+    {
+        return File::getSpecialLocation (File::userApplicationDataDirectory)
+                 .getChildFile ("AudioThumbnailTutorial")
+                 .getChildFile ("SeekIndex");
     }
     
     void playButtonClicked()
@@ -286,18 +1688,72 @@ private:
         changeState (Stopping);
     }
     
+    void showEnergyButtonClicked()
+    {
+        thumbnailComp.setDrawMode (showEnergyButton.getToggleState() ? SimpleThumbnailComponent::drawPeaksWithEnergy
+                                                                     : SimpleThumbnailComponent::drawPeaks);
+    }
+    
+    //==========================================================================
+    /** Runs initialiseFormatsAndAudio() off the message thread, then tells the
+        component that it's done.
+    */
+    class StartupThread  : public Thread
+    {
+    public:
+        StartupThread (MainContentComponent& ownerToUse)  : Thread ("Audio startup"), owner (ownerToUse) {}
+        
+        void run() override
+        {
+            owner.initialiseFormatsAndAudio();
+            owner.triggerAsyncUpdate();
+        }
+        
+    private:
+        MainContentComponent& owner;
+        
+        JUCE_DECLARE_NON_COPYABLE (StartupThread)
+    };
+    
     //==========================================================================
     TextButton openButton;
+    TextButton browseButton;
     TextButton playButton;
     TextButton stopButton;
+    ToggleButton mapFilesButton;
+    ComboBox channelsPerLaneBox;
+    ToggleButton readAheadButton;
+    ComboBox resamplerBox;
+    ToggleButton followGrowthButton;
+    ToggleButton showEnergyButton;
     
     AudioFormatManager formatManager;                    // [3]
+    AudioFileOpener fileOpener;
+    ScopedPointer<MemoryMappedAudioFormatReader> mappedReader;
     ScopedPointer<AudioFormatReaderSource> readerSource;
+    TimeSliceThread readAheadThread;
+    ScopedPointer<ReadAheadAudioSource> readAheadSource;
+    ScopedPointer<LoopRegionAudioSource> loopSource;
+    ScopedPointer<SincResamplingAudioSource> resamplingSource;
+    double playbackSampleRate;
+    File playbackFile;
+    Range<double> loopRegionSeconds;
     AudioTransportSource transportSource;
     TransportState state;
-    AudioThumbnailCache thumbnailCache;                  // [1]
+    File followedFile;
+    int64 followedFileSize;
+    DiskThumbnailCache thumbnailCache;                   // [1]
+    ThreadPool thumbnailThreads;
+    WaveformViewport viewport;
     SimpleThumbnailComponent thumbnailComp;
     SimplePositionOverlay positionOverlay;
+    SpectrogramTileCache spectrogramCache;
+    ThreadPool spectrogramThreads;
+    SpectrogramComponent spectrogramComp;
+    WaveformBrowser browser;
+    AudioCallbackMonitor callbackMonitor;
+    AudioCallbackMonitorDisplay callbackMonitorDisplay;
+    StartupThread startupThread;
     
     LookAndFeel_V3 lookAndFeel;
     
@@ -0,0 +1,476 @@
+/*
+  ==============================================================================
+
+    MinMaxKernels.h
+
+  ==============================================================================
+*/
+
+#ifndef MINMAXKERNELS_H_INCLUDED
+#define MINMAXKERNELS_H_INCLUDED
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+#if JUCE_INTEL
+ #include <immintrin.h>
+#endif
+
+//==============================================================================
+/**
+    Vectorised min/max reduction of interleaved PCM, used to build thumbnail points
+    straight from the sample data in a file.
+
+    The reduction runs on the samples in their stored integer (or float) format,
+    and only the reduced min/max values are converted to float, so a block of
+    64 stereo int16 frames costs a couple of dozen vector compares rather than
+    128 conversions and 256 scalar comparisons.
+
+    The same pass can also add up each channel's squared samples and count its
+    clipped ones, for RMS and clipping displays. Those need the samples as floats,
+    so they cost a conversion per sample; they're only worked out when asked for.
+
+    An SSE2 and an AVX2 version are compiled, and the best one that the CPU
+    supports is picked at runtime.
+*/
+struct MinMaxKernels
+{
+    /** The little-endian sample layouts that the kernels can read directly. */
+    enum SampleFormat
+    {
+        int16Samples,
+        int24Samples,
+        int32Samples,
+        float32Samples
+    };
+
+    enum
+    {
+        /** The most accumulator vectors a kernel keeps; channel layouts that need
+            more than this are reduced with the scalar loop.
+        */
+        maxVectorPeriod = 128
+    };
+
+    static int getBytesPerSample (SampleFormat format) noexcept
+    {
+        switch (format)
+        {
+            case int16Samples:   return 2;
+            case int24Samples:   return 3;
+            default:             return 4;
+        }
+    }
+
+    /** Finds the min and max of each channel over consecutive runs of framesPerPoint
+        frames of interleaved samples.
+
+        For each run, numChannels ranges are written to results, scaled to the
+        usual -1.0 to 1.0 range; the last run may be shorter than framesPerPoint.
+        numBytes is the amount of readable memory at sourceData, which may be more
+        than the frames occupy.
+
+        If sumsOfSquares and numClipped are given, each run also gets the sum of
+        each channel's squared (scaled) samples, and the number of them whose
+        magnitude is at least getClipThreshold(), laid out in the same way.
+    */
+    static void reduceInterleaved (const void* sourceData, size_t numBytes, SampleFormat format,
+                                   int numChannels, int numFrames, int framesPerPoint,
+                                   Range<float>* results,
+                                   float* sumsOfSquares = nullptr, uint32* numClipped = nullptr) noexcept;
+
+    /** The magnitude at which a sample counts as clipped: within one 16-bit step of
+        full scale, so that the loudest value of any integer format qualifies.
+    */
+    static float getClipThreshold() noexcept        { return 32767.0f / 32768.0f; }
+
+    /** Returns the name of the instruction set that reduceInterleaved() will use. */
+    static String getInstructionSetName();
+};
+
+//==============================================================================
+namespace MinMaxKernelsFormats
+{
+    inline int32 readUnaligned32 (const uint8* p) noexcept
+    {
+        int32 v;
+        memcpy (&v, p, sizeof (v));
+        return v;
+    }
+
+    struct Int16Format
+    {
+        typedef int16 Sample;
+        enum { bytesPerSample = 2 };
+
+        static Sample loadScalar (const uint8* p) noexcept      { return (Sample) ByteOrder::littleEndianShort (p); }
+        static Sample highest() noexcept                        { return (Sample) 0x7fff; }
+        static Sample lowest() noexcept                         { return (Sample) -0x8000; }
+        static float scale() noexcept                           { return 1.0f / 0x8000; }
+    };
+
+    struct Int24Format
+    {
+        typedef int32 Sample;
+        enum { bytesPerSample = 3 };
+
+        static Sample loadScalar (const uint8* p) noexcept      { return (int32) (((uint32) p[0] << 8) | ((uint32) p[1] << 16) | ((uint32) p[2] << 24)) >> 8; }
+        static Sample highest() noexcept                        { return 0x7fffff; }
+        static Sample lowest() noexcept                         { return -0x800000; }
+        static float scale() noexcept                           { return 1.0f / 0x800000; }
+    };
+
+    struct Int32Format
+    {
+        typedef int32 Sample;
+        enum { bytesPerSample = 4 };
+
+        static Sample loadScalar (const uint8* p) noexcept      { return (Sample) ByteOrder::littleEndianInt (p); }
+        static Sample highest() noexcept                        { return std::numeric_limits<int32>::max(); }
+        static Sample lowest() noexcept                         { return std::numeric_limits<int32>::min(); }
+        static float scale() noexcept                           { return 1.0f / (float) 0x80000000u; }
+    };
+
+    struct Float32Format
+    {
+        typedef float Sample;
+        enum { bytesPerSample = 4 };
+
+        static Sample loadScalar (const uint8* p) noexcept      { Sample v; memcpy (&v, p, sizeof (v)); return v; }
+        static Sample highest() noexcept                        { return std::numeric_limits<float>::max(); }
+        static Sample lowest() noexcept                         { return -std::numeric_limits<float>::max(); }
+        static float scale() noexcept                           { return 1.0f; }
+    };
+}
+
+//==============================================================================
+#define MINMAX_KERNEL_TARGET
+
+namespace MinMaxKernelsScalar
+{
+    template <class Format>
+    struct ScalarOps  : public Format
+    {
+        typedef typename Format::Sample Sample;
+        typedef Sample Vec;
+        enum { lanes = 1, overreadBytes = 0 };
+
+        static Vec load (const uint8* p) noexcept               { return Format::loadScalar (p); }
+        static Vec min (Vec a, Vec b) noexcept                  { return jmin (a, b); }
+        static Vec max (Vec a, Vec b) noexcept                  { return jmax (a, b); }
+        static void store (Sample* dest, Vec v) noexcept        { *dest = v; }
+        static Vec shiftDown (Vec v, int) noexcept              { return v; }
+
+        enum { floatVectorsPerVector = 1 };
+        static void toFloats (Vec v, float* dest) noexcept      { *dest = (float) v; }
+    };
+
+    struct FloatOps
+    {
+        typedef float FloatVec;
+        enum { lanes = 1 };
+
+        static FloatVec broadcast (float v) noexcept                            { return v; }
+        static FloatVec addSquare (FloatVec total, FloatVec v) noexcept         { return total + v * v; }
+        static FloatVec addIfAtLeast (FloatVec total, FloatVec v, FloatVec threshold) noexcept
+        {
+            return std::abs (v) >= threshold ? total + 1.0f : total;
+        }
+        static void store (float* dest, FloatVec v) noexcept                    { *dest = v; }
+    };
+
+    typedef ScalarOps<MinMaxKernelsFormats::Int16Format>    Int16Ops;
+    typedef ScalarOps<MinMaxKernelsFormats::Int24Format>    Int24Ops;
+    typedef ScalarOps<MinMaxKernelsFormats::Int32Format>    Int32Ops;
+    typedef ScalarOps<MinMaxKernelsFormats::Float32Format>  Float32Ops;
+
+    #include "MinMaxKernelsImpl.h"
+}
+
+#undef MINMAX_KERNEL_TARGET
+
+#if JUCE_INTEL
+//==============================================================================
+#if JUCE_GCC || JUCE_CLANG
+ #define MINMAX_KERNEL_TARGET __attribute__ ((target ("sse2")))
+#else
+ #define MINMAX_KERNEL_TARGET
+#endif
+
+namespace MinMaxKernelsSSE2
+{
+    /** The whole-register operations shared by the integer formats. */
+    template <class Format>
+    struct IntegerOps  : public Format
+    {
+        typedef typename Format::Sample Sample;
+        typedef __m128i Vec;
+
+        MINMAX_KERNEL_TARGET static void store (Sample* dest, Vec v) noexcept   { _mm_storeu_si128 ((__m128i*) dest, v); }
+
+        MINMAX_KERNEL_TARGET static Vec shiftDown (Vec v, int numLanes) noexcept
+        {
+            switch (numLanes * (int) sizeof (Sample))
+            {
+                case 8:   return _mm_srli_si128 (v, 8);
+                case 4:   return _mm_srli_si128 (v, 4);
+                default:  return _mm_srli_si128 (v, 2);
+            }
+        }
+
+        // SSE2 has no 32-bit integer min/max, so they're built from a compare and a blend
+        MINMAX_KERNEL_TARGET static Vec min32 (Vec a, Vec b) noexcept           { return select (_mm_cmpgt_epi32 (a, b), b, a); }
+        MINMAX_KERNEL_TARGET static Vec max32 (Vec a, Vec b) noexcept           { return select (_mm_cmpgt_epi32 (a, b), a, b); }
+
+        MINMAX_KERNEL_TARGET static Vec select (Vec mask, Vec ifTrue, Vec ifFalse) noexcept
+        {
+            return _mm_or_si128 (_mm_and_si128 (mask, ifTrue), _mm_andnot_si128 (mask, ifFalse));
+        }
+    };
+
+    struct FloatOps
+    {
+        typedef __m128 FloatVec;
+        enum { lanes = 4 };
+
+        MINMAX_KERNEL_TARGET static FloatVec broadcast (float v) noexcept                       { return _mm_set1_ps (v); }
+        MINMAX_KERNEL_TARGET static FloatVec addSquare (FloatVec total, FloatVec v) noexcept    { return _mm_add_ps (total, _mm_mul_ps (v, v)); }
+        MINMAX_KERNEL_TARGET static void store (float* dest, FloatVec v) noexcept               { _mm_storeu_ps (dest, v); }
+
+        MINMAX_KERNEL_TARGET static FloatVec addIfAtLeast (FloatVec total, FloatVec v, FloatVec threshold) noexcept
+        {
+            const __m128 magnitude = _mm_andnot_ps (_mm_set1_ps (-0.0f), v);
+            return _mm_add_ps (total, _mm_and_ps (_mm_cmpge_ps (magnitude, threshold), _mm_set1_ps (1.0f)));
+        }
+    };
+
+    struct Int16Ops  : public IntegerOps<MinMaxKernelsFormats::Int16Format>
+    {
+        enum { lanes = 8, overreadBytes = 0, floatVectorsPerVector = 2 };
+
+        MINMAX_KERNEL_TARGET static Vec load (const uint8* p) noexcept          { return _mm_loadu_si128 ((const __m128i*) p); }
+        MINMAX_KERNEL_TARGET static Vec min (Vec a, Vec b) noexcept             { return _mm_min_epi16 (a, b); }
+        MINMAX_KERNEL_TARGET static Vec max (Vec a, Vec b) noexcept             { return _mm_max_epi16 (a, b); }
+
+        // each sample goes into the top half of a 32-bit lane, and the shift sign-extends it
+        MINMAX_KERNEL_TARGET static void toFloats (Vec v, __m128* dest) noexcept
+        {
+            dest[0] = _mm_cvtepi32_ps (_mm_srai_epi32 (_mm_unpacklo_epi16 (v, v), 16));
+            dest[1] = _mm_cvtepi32_ps (_mm_srai_epi32 (_mm_unpackhi_epi16 (v, v), 16));
+        }
+    };
+
+    struct Int24Ops  : public IntegerOps<MinMaxKernelsFormats::Int24Format>
+    {
+        enum { lanes = 4, overreadBytes = 1, floatVectorsPerVector = 1 };
+
+        // four overlapping 32-bit reads put each sample in the low three bytes of a lane,
+        // and the shift pair sign-extends it
+        MINMAX_KERNEL_TARGET static Vec load (const uint8* p) noexcept
+        {
+            using MinMaxKernelsFormats::readUnaligned32;
+            const __m128i v = _mm_setr_epi32 (readUnaligned32 (p), readUnaligned32 (p + 3),
+                                              readUnaligned32 (p + 6), readUnaligned32 (p + 9));
+            return _mm_srai_epi32 (_mm_slli_epi32 (v, 8), 8);
+        }
+
+        MINMAX_KERNEL_TARGET static Vec min (Vec a, Vec b) noexcept             { return min32 (a, b); }
+        MINMAX_KERNEL_TARGET static Vec max (Vec a, Vec b) noexcept             { return max32 (a, b); }
+        MINMAX_KERNEL_TARGET static void toFloats (Vec v, __m128* dest) noexcept    { *dest = _mm_cvtepi32_ps (v); }
+    };
+
+    struct Int32Ops  : public IntegerOps<MinMaxKernelsFormats::Int32Format>
+    {
+        enum { lanes = 4, overreadBytes = 0, floatVectorsPerVector = 1 };
+
+        MINMAX_KERNEL_TARGET static Vec load (const uint8* p) noexcept          { return _mm_loadu_si128 ((const __m128i*) p); }
+        MINMAX_KERNEL_TARGET static Vec min (Vec a, Vec b) noexcept             { return min32 (a, b); }
+        MINMAX_KERNEL_TARGET static Vec max (Vec a, Vec b) noexcept             { return max32 (a, b); }
+        MINMAX_KERNEL_TARGET static void toFloats (Vec v, __m128* dest) noexcept    { *dest = _mm_cvtepi32_ps (v); }
+    };
+
+    struct Float32Ops  : public MinMaxKernelsFormats::Float32Format
+    {
+        typedef __m128 Vec;
+        enum { lanes = 4, overreadBytes = 0, floatVectorsPerVector = 1 };
+
+        MINMAX_KERNEL_TARGET static Vec load (const uint8* p) noexcept          { return _mm_loadu_ps ((const float*) p); }
+        MINMAX_KERNEL_TARGET static Vec min (Vec a, Vec b) noexcept             { return _mm_min_ps (a, b); }
+        MINMAX_KERNEL_TARGET static Vec max (Vec a, Vec b) noexcept             { return _mm_max_ps (a, b); }
+        MINMAX_KERNEL_TARGET static void store (Sample* dest, Vec v) noexcept   { _mm_storeu_ps (dest, v); }
+        MINMAX_KERNEL_TARGET static void toFloats (Vec v, __m128* dest) noexcept    { *dest = v; }
+
+        MINMAX_KERNEL_TARGET static Vec shiftDown (Vec v, int numLanes) noexcept
+        {
+            return numLanes == 2 ? _mm_movehl_ps (v, v)
+                                 : _mm_shuffle_ps (v, v, _MM_SHUFFLE (3, 2, 1, 1));
+        }
+    };
+
+    #include "MinMaxKernelsImpl.h"
+}
+
+#undef MINMAX_KERNEL_TARGET
+
+//==============================================================================
+#if JUCE_GCC || JUCE_CLANG
+ #define MINMAX_KERNEL_TARGET __attribute__ ((target ("avx2")))
+#else
+ #define MINMAX_KERNEL_TARGET
+#endif
+
+namespace MinMaxKernelsAVX2
+{
+    /** The whole-register operations shared by the integer formats. */
+    template <class Format>
+    struct IntegerOps  : public Format
+    {
+        typedef typename Format::Sample Sample;
+        typedef __m256i Vec;
+
+        MINMAX_KERNEL_TARGET static void store (Sample* dest, Vec v) noexcept   { _mm256_storeu_si256 ((__m256i*) dest, v); }
+
+        // after the first fold both halves match, so the per-half byte shifts are enough
+        MINMAX_KERNEL_TARGET static Vec shiftDown (Vec v, int numLanes) noexcept
+        {
+            switch (numLanes * (int) sizeof (Sample))
+            {
+                case 16:  return _mm256_permute2x128_si256 (v, v, 1);
+                case 8:   return _mm256_srli_si256 (v, 8);
+                case 4:   return _mm256_srli_si256 (v, 4);
+                default:  return _mm256_srli_si256 (v, 2);
+            }
+        }
+
+        MINMAX_KERNEL_TARGET static void toFloats (Vec v, __m256* dest) noexcept    { *dest = _mm256_cvtepi32_ps (v); }
+    };
+
+    struct FloatOps
+    {
+        typedef __m256 FloatVec;
+        enum { lanes = 8 };
+
+        MINMAX_KERNEL_TARGET static FloatVec broadcast (float v) noexcept                       { return _mm256_set1_ps (v); }
+        MINMAX_KERNEL_TARGET static FloatVec addSquare (FloatVec total, FloatVec v) noexcept    { return _mm256_add_ps (total, _mm256_mul_ps (v, v)); }
+        MINMAX_KERNEL_TARGET static void store (float* dest, FloatVec v) noexcept               { _mm256_storeu_ps (dest, v); }
+
+        MINMAX_KERNEL_TARGET static FloatVec addIfAtLeast (FloatVec total, FloatVec v, FloatVec threshold) noexcept
+        {
+            const __m256 magnitude = _mm256_andnot_ps (_mm256_set1_ps (-0.0f), v);
+            return _mm256_add_ps (total, _mm256_and_ps (_mm256_cmp_ps (magnitude, threshold, _CMP_GE_OQ),
+                                                        _mm256_set1_ps (1.0f)));
+        }
+    };
+
+    struct Int16Ops  : public IntegerOps<MinMaxKernelsFormats::Int16Format>
+    {
+        enum { lanes = 16, overreadBytes = 0, floatVectorsPerVector = 2 };
+
+        MINMAX_KERNEL_TARGET static Vec load (const uint8* p) noexcept          { return _mm256_loadu_si256 ((const __m256i*) p); }
+        MINMAX_KERNEL_TARGET static Vec min (Vec a, Vec b) noexcept             { return _mm256_min_epi16 (a, b); }
+        MINMAX_KERNEL_TARGET static Vec max (Vec a, Vec b) noexcept             { return _mm256_max_epi16 (a, b); }
+
+        MINMAX_KERNEL_TARGET static void toFloats (Vec v, __m256* dest) noexcept
+        {
+            dest[0] = _mm256_cvtepi32_ps (_mm256_cvtepi16_epi32 (_mm256_castsi256_si128 (v)));
+            dest[1] = _mm256_cvtepi32_ps (_mm256_cvtepi16_epi32 (_mm256_extracti128_si256 (v, 1)));
+        }
+    };
+
+    struct Int24Ops  : public IntegerOps<MinMaxKernelsFormats::Int24Format>
+    {
+        enum { lanes = 8, overreadBytes = 8, floatVectorsPerVector = 1 };
+
+        // reads 32 bytes to unpack 24: the permute gives each 128-bit half the twelve bytes
+        // of its four samples, then the shuffle moves each sample into the top three bytes
+        // of a lane so that an arithmetic shift sign-extends it
+        MINMAX_KERNEL_TARGET static Vec load (const uint8* p) noexcept
+        {
+            const __m256i raw = _mm256_permutevar8x32_epi32 (_mm256_loadu_si256 ((const __m256i*) p),
+                                                             _mm256_setr_epi32 (0, 1, 2, 3, 3, 4, 5, 6));
+
+            const __m256i unpack = _mm256_setr_epi8 (-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+                                                     -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+
+            return _mm256_srai_epi32 (_mm256_shuffle_epi8 (raw, unpack), 8);
+        }
+
+        MINMAX_KERNEL_TARGET static Vec min (Vec a, Vec b) noexcept             { return _mm256_min_epi32 (a, b); }
+        MINMAX_KERNEL_TARGET static Vec max (Vec a, Vec b) noexcept             { return _mm256_max_epi32 (a, b); }
+    };
+
+    struct Int32Ops  : public IntegerOps<MinMaxKernelsFormats::Int32Format>
+    {
+        enum { lanes = 8, overreadBytes = 0, floatVectorsPerVector = 1 };
+
+        MINMAX_KERNEL_TARGET static Vec load (const uint8* p) noexcept          { return _mm256_loadu_si256 ((const __m256i*) p); }
+        MINMAX_KERNEL_TARGET static Vec min (Vec a, Vec b) noexcept             { return _mm256_min_epi32 (a, b); }
+        MINMAX_KERNEL_TARGET static Vec max (Vec a, Vec b) noexcept             { return _mm256_max_epi32 (a, b); }
+    };
+
+    struct Float32Ops  : public MinMaxKernelsFormats::Float32Format
+    {
+        typedef __m256 Vec;
+        enum { lanes = 8, overreadBytes = 0, floatVectorsPerVector = 1 };
+
+        MINMAX_KERNEL_TARGET static Vec load (const uint8* p) noexcept          { return _mm256_loadu_ps ((const float*) p); }
+        MINMAX_KERNEL_TARGET static Vec min (Vec a, Vec b) noexcept             { return _mm256_min_ps (a, b); }
+        MINMAX_KERNEL_TARGET static Vec max (Vec a, Vec b) noexcept             { return _mm256_max_ps (a, b); }
+        MINMAX_KERNEL_TARGET static void store (Sample* dest, Vec v) noexcept   { _mm256_storeu_ps (dest, v); }
+        MINMAX_KERNEL_TARGET static void toFloats (Vec v, __m256* dest) noexcept    { *dest = v; }
+
+        MINMAX_KERNEL_TARGET static Vec shiftDown (Vec v, int numLanes) noexcept
+        {
+            switch (numLanes)
+            {
+                case 4:   return _mm256_permute2f128_ps (v, v, 1);
+                case 2:   return _mm256_shuffle_ps (v, v, _MM_SHUFFLE (3, 2, 3, 2));
+                default:  return _mm256_shuffle_ps (v, v, _MM_SHUFFLE (3, 2, 1, 1));
+            }
+        }
+    };
+
+    #include "MinMaxKernelsImpl.h"
+}
+
+#undef MINMAX_KERNEL_TARGET
+#endif
+
+//==============================================================================
+inline void MinMaxKernels::reduceInterleaved (const void* sourceData, size_t numBytes, SampleFormat format,
+                                              int numChannels, int numFrames, int framesPerPoint,
+                                              Range<float>* results, float* sumsOfSquares, uint32* numClipped) noexcept
+{
+    jassert (numChannels > 0 && framesPerPoint > 0);
+    jassert ((sumsOfSquares == nullptr) == (numClipped == nullptr));
+
+   #if JUCE_INTEL
+    if (SystemStats::hasAVX2())
+    {
+        MinMaxKernelsAVX2::reduceInterleaved (sourceData, numBytes, format, numChannels,
+                                              numFrames, framesPerPoint, results, sumsOfSquares, numClipped);
+        return;
+    }
+
+    if (SystemStats::hasSSE2())
+    {
+        MinMaxKernelsSSE2::reduceInterleaved (sourceData, numBytes, format, numChannels,
+                                              numFrames, framesPerPoint, results, sumsOfSquares, numClipped);
+        return;
+    }
+   #endif
+
+    MinMaxKernelsScalar::reduceInterleaved (sourceData, numBytes, format, numChannels,
+                                            numFrames, framesPerPoint, results, sumsOfSquares, numClipped);
+}
+
+inline String MinMaxKernels::getInstructionSetName()
+{
+   #if JUCE_INTEL
+    if (SystemStats::hasAVX2())  return "AVX2";
+    if (SystemStats::hasSSE2())  return "SSE2";
+   #endif
+
+    return "scalar";
+}
+
+#endif  // MINMAXKERNELS_H_INCLUDED
@@ -0,0 +1,276 @@
+/*
+  ==============================================================================
+
+    MinMaxKernelsImpl.h
+
+    The generic part of the min/max reduction kernels. This has no include guard
+    because MinMaxKernels.h includes it once for each instruction set, inside a
+    namespace that provides the Int16Ops, Int24Ops, Int32Ops, Float32Ops and
+    FloatOps structs it's written against, with MINMAX_KERNEL_TARGET set to the
+    matching target attribute.
+
+  ==============================================================================
+*/
+
+/** The squares and clip counts for reduceFrames(), over the same whole periods.
+    This is a second loop over data that the min/max loop has just brought into
+    the cache, so that the min/max loop stays as tight as it is without them.
+*/
+template <class Ops>
+MINMAX_KERNEL_TARGET inline void addEnergy (const uint8* src, int numPeriods, int periodVectors, int numChannels,
+                                            float clipLevel, float* squares, float* clips) noexcept
+{
+    typedef typename FloatOps::FloatVec FloatVec;
+
+    const int floatsPerVector = Ops::floatVectorsPerVector;
+    const int bytesPerVector  = Ops::lanes * Ops::bytesPerSample;
+    const int numAccumulators = periodVectors * floatsPerVector;
+    const FloatVec threshold (FloatOps::broadcast (clipLevel));
+
+    FloatVec accSquares[2 * MinMaxKernels::maxVectorPeriod], accClips[2 * MinMaxKernels::maxVectorPeriod];
+    FloatVec converted[2];
+
+    for (int i = 0; i < numAccumulators; ++i)
+        accSquares[i] = accClips[i] = FloatOps::broadcast (0.0f);
+
+    for (int p = 0; p < numPeriods; ++p)
+    {
+        const uint8* const periodStart = src + p * periodVectors * bytesPerVector;
+
+        for (int k = 0; k < periodVectors; ++k)
+        {
+            Ops::toFloats (Ops::load (periodStart + k * bytesPerVector), converted);
+
+            for (int j = 0; j < floatsPerVector; ++j)
+            {
+                FloatVec& sq = accSquares[k * floatsPerVector + j];
+                FloatVec& cl = accClips[k * floatsPerVector + j];
+                sq = FloatOps::addSquare (sq, converted[j]);
+                cl = FloatOps::addIfAtLeast (cl, converted[j], threshold);
+            }
+        }
+    }
+
+    // the float vectors hold the lanes in their original order, so lane n of the
+    // whole period is sample n, which belongs to channel n % numChannels
+    float laneSquares[FloatOps::lanes], laneClips[FloatOps::lanes];
+    int chan = 0;
+
+    for (int i = 0; i < numAccumulators; ++i)
+    {
+        FloatOps::store (laneSquares, accSquares[i]);
+        FloatOps::store (laneClips, accClips[i]);
+
+        for (int lane = 0; lane < (int) FloatOps::lanes; ++lane)
+        {
+            squares[chan] += laneSquares[lane];
+            clips[chan] += laneClips[lane];
+
+            if (++chan == numChannels)
+                chan = 0;
+        }
+    }
+}
+
+//==============================================================================
+/** Finds the per-channel min/max of numFrames interleaved frames, merging the
+    results into mins and maxs.
+
+    The vector loop walks the data in periods of lcm (numChannels, lanes) samples,
+    so that each accumulator lane always sees the same channel and nothing needs
+    de-interleaving; the lanes are only folded back into channels once at the end.
+    Ops::shiftDown (v, n) must move lane n of v into lane 0 for any power of two
+    n below the lane count.
+    Vector loads never touch anything at or beyond safeEnd.
+
+    With withEnergy set, each channel's squared samples and its samples at or above
+    clipLevel (both unscaled) are also added to squares and clips. Ops::toFloats()
+    turns a vector into floatVectorsPerVector FloatOps vectors holding the same
+    lanes in the same order, so those accumulators line up with the same channels.
+*/
+template <class Ops, bool withEnergy>
+MINMAX_KERNEL_TARGET inline void reduceFrames (const uint8* src, const uint8* safeEnd, int numChannels, int numFrames,
+                                               typename Ops::Sample* mins, typename Ops::Sample* maxs,
+                                               float clipLevel, float* squares, float* clips) noexcept
+{
+    typedef typename Ops::Sample Sample;
+    typedef typename Ops::Vec Vec;
+
+    const int lanes = Ops::lanes;
+    int period = numChannels;
+
+    while (period % lanes != 0)
+        period += numChannels;
+
+    const int periodVectors   = period / lanes;
+    const int framesPerPeriod = period / numChannels;
+    const int bytesPerVector  = lanes * Ops::bytesPerSample;
+    const int bytesPerPeriod  = periodVectors * bytesPerVector;
+
+    int numPeriods = numFrames / framesPerPeriod;
+
+    while (numPeriods > 0 && src + numPeriods * bytesPerPeriod + Ops::overreadBytes > safeEnd)
+        --numPeriods;
+
+    if (periodVectors > MinMaxKernels::maxVectorPeriod)
+        numPeriods = 0;
+
+    if (numPeriods > 0)
+    {
+        Vec accMin[MinMaxKernels::maxVectorPeriod], accMax[MinMaxKernels::maxVectorPeriod];
+
+        for (int k = 0; k < periodVectors; ++k)
+            accMin[k] = accMax[k] = Ops::load (src + k * bytesPerVector);
+
+        for (int p = 1; p < numPeriods; ++p)
+        {
+            const uint8* const periodStart = src + p * bytesPerPeriod;
+
+            for (int k = 0; k < periodVectors; ++k)
+            {
+                const Vec v (Ops::load (periodStart + k * bytesPerVector));
+                accMin[k] = Ops::min (accMin[k], v);
+                accMax[k] = Ops::max (accMax[k], v);
+            }
+        }
+
+        if (withEnergy)
+            addEnergy<Ops> (src, numPeriods, periodVectors, numChannels, clipLevel, squares, clips);
+
+        Sample laneMins[lanes], laneMaxs[lanes];
+
+        if (periodVectors == 1)
+        {
+            // the channel count divides the lane count, so the lanes can be folded
+            // down in-register until the first numChannels of them hold the results
+            Vec foldedMin (accMin[0]), foldedMax (accMax[0]);
+
+            for (int shift = lanes / 2; shift >= numChannels; shift /= 2)
+            {
+                foldedMin = Ops::min (foldedMin, Ops::shiftDown (foldedMin, shift));
+                foldedMax = Ops::max (foldedMax, Ops::shiftDown (foldedMax, shift));
+            }
+
+            Ops::store (laneMins, foldedMin);
+            Ops::store (laneMaxs, foldedMax);
+
+            for (int chan = 0; chan < numChannels; ++chan)
+            {
+                mins[chan] = jmin (mins[chan], laneMins[chan]);
+                maxs[chan] = jmax (maxs[chan], laneMaxs[chan]);
+            }
+        }
+        else
+        {
+            int chan = 0;
+
+            for (int k = 0; k < periodVectors; ++k)
+            {
+                Ops::store (laneMins, accMin[k]);
+                Ops::store (laneMaxs, accMax[k]);
+
+                for (int lane = 0; lane < lanes; ++lane)
+                {
+                    mins[chan] = jmin (mins[chan], laneMins[lane]);
+                    maxs[chan] = jmax (maxs[chan], laneMaxs[lane]);
+
+                    if (++chan == numChannels)
+                        chan = 0;
+                }
+            }
+        }
+    }
+
+    const uint8* sample = src + numPeriods * bytesPerPeriod;
+
+    for (int frame = numPeriods * framesPerPeriod; frame < numFrames; ++frame)
+    {
+        for (int chan = 0; chan < numChannels; ++chan)
+        {
+            const Sample value = Ops::loadScalar (sample);
+            mins[chan] = jmin (mins[chan], value);
+            maxs[chan] = jmax (maxs[chan], value);
+            sample += Ops::bytesPerSample;
+
+            if (withEnergy)
+            {
+                const float f = (float) value;
+                squares[chan] += f * f;
+
+                if (std::abs (f) >= clipLevel)
+                    ++clips[chan];
+            }
+        }
+    }
+}
+
+template <class Ops>
+MINMAX_KERNEL_TARGET inline void reducePoints (const uint8* src, const uint8* safeEnd, int numChannels, int numFrames,
+                                               int framesPerPoint, Range<float>* results,
+                                               float* sumsOfSquares, uint32* numClipped) noexcept
+{
+    typedef typename Ops::Sample Sample;
+
+    HeapBlock<Sample> mins ((size_t) numChannels), maxs ((size_t) numChannels);
+    HeapBlock<float> squares, clips;
+    const int bytesPerFrame = numChannels * Ops::bytesPerSample;
+    const float scale = Ops::scale();
+    const float clipLevel = MinMaxKernels::getClipThreshold() / scale;
+
+    if (sumsOfSquares != nullptr)
+    {
+        squares.malloc ((size_t) numChannels);
+        clips.malloc ((size_t) numChannels);
+    }
+
+    for (int frame = 0; frame < numFrames; frame += framesPerPoint)
+    {
+        const uint8* const pointStart = src + (size_t) frame * (size_t) bytesPerFrame;
+        const int numPointFrames = jmin (framesPerPoint, numFrames - frame);
+
+        for (int chan = 0; chan < numChannels; ++chan)
+        {
+            mins[chan] = Ops::highest();
+            maxs[chan] = Ops::lowest();
+        }
+
+        if (sumsOfSquares != nullptr)
+        {
+            squares.clear ((size_t) numChannels);
+            clips.clear ((size_t) numChannels);
+
+            reduceFrames<Ops, true> (pointStart, safeEnd, numChannels, numPointFrames, mins, maxs, clipLevel, squares, clips);
+
+            for (int chan = 0; chan < numChannels; ++chan)
+            {
+                *sumsOfSquares++ = squares[chan] * scale * scale;
+                *numClipped++ = (uint32) clips[chan];
+            }
+        }
+        else
+        {
+            reduceFrames<Ops, false> (pointStart, safeEnd, numChannels, numPointFrames, mins, maxs, 0.0f, nullptr, nullptr);
+        }
+
+        for (int chan = 0; chan < numChannels; ++chan)
+            *results++ = Range<float> ((float) mins[chan] * scale,
+                                       (float) maxs[chan] * scale);
+    }
+}
+
+MINMAX_KERNEL_TARGET inline void reduceInterleaved (const void* sourceData, size_t numBytes, MinMaxKernels::SampleFormat format,
+                                                    int numChannels, int numFrames, int framesPerPoint, Range<float>* results,
+                                                    float* sumsOfSquares, uint32* numClipped) noexcept
+{
+    const uint8* const src = static_cast<const uint8*> (sourceData);
+    const uint8* const safeEnd = src + numBytes;
+
+    switch (format)
+    {
+        case MinMaxKernels::int16Samples:    reducePoints<Int16Ops>   (src, safeEnd, numChannels, numFrames, framesPerPoint, results, sumsOfSquares, numClipped); break;
+        case MinMaxKernels::int24Samples:    reducePoints<Int24Ops>   (src, safeEnd, numChannels, numFrames, framesPerPoint, results, sumsOfSquares, numClipped); break;
+        case MinMaxKernels::int32Samples:    reducePoints<Int32Ops>   (src, safeEnd, numChannels, numFrames, framesPerPoint, results, sumsOfSquares, numClipped); break;
+        case MinMaxKernels::float32Samples:  reducePoints<Float32Ops> (src, safeEnd, numChannels, numFrames, framesPerPoint, results, sumsOfSquares, numClipped); break;
+        default:                             jassertfalse; break;
+    }
+}
@@ -0,0 +1,464 @@
+/*
+  ==============================================================================
+
+    Mp3SeekIndex.h
+
+  ==============================================================================
+*/
+
+#ifndef MP3SEEKINDEX_H_INCLUDED
+#define MP3SEEKINDEX_H_INCLUDED
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "DiskThumbnailCache.h"
+
+#if JUCE_USE_MP3AUDIOFORMAT
+
+//==============================================================================
+/**
+    The byte positions of the frames in an MPEG-1 Layer III file, so that decoding
+    can start near any sample rather than at the beginning.
+
+    An MP3 file has no table of where its frames are, and with a variable bit rate
+    there's no working it out, so MP3AudioFormat's reader finds a position by
+    decoding every frame before it. This finds them once, by walking from one frame
+    header to the next without decoding anything, and keeps the position of every
+    framesPerSeekPoint'th frame.
+
+    Other MPEG versions and layers, and free-format streams, aren't handled: build()
+    returns nullptr for them, and they're left to the ordinary reader.
+*/
+class Mp3SeekIndex  : public ReferenceCountedObject
+{
+public:
+    typedef ReferenceCountedObjectPtr<Mp3SeekIndex> Ptr;
+
+    enum
+    {
+        samplesPerFrame = 1152,
+        framesPerSeekPoint = 8
+    };
+
+    //==============================================================================
+    /** Scans a whole file's frame headers. Returns nullptr if it isn't a stream that
+        this can index.
+    */
+    static Mp3SeekIndex* build (InputStream& source, int64 hashCode)
+    {
+        BufferedInputStream in (source, 65536);
+        const int64 totalLength = in.getTotalLength();
+
+        FrameHeader first;
+        int64 pos = findFrame (in, skipID3 (in), totalLength, first, nullptr);
+
+        if (pos < 0)
+            return nullptr;
+
+        ScopedPointer<Mp3SeekIndex> index (new Mp3SeekIndex());
+        index->hashCode = hashCode;
+        index->sampleRate = first.sampleRate;
+        index->numChannels = first.numChannels;
+
+        FrameHeader header (first);
+
+        while (pos >= 0)
+        {
+            if (index->numFrames % framesPerSeekPoint == 0)
+                index->seekPoints.add (pos);
+
+            ++(index->numFrames);
+            pos += header.frameSize;
+            index->endOfFrames = jmin (pos, totalLength);
+
+            if (pos + 4 > totalLength)
+                break;
+
+            // anything between frames is skipped by the decoder too, so it doesn't
+            // upset the numbering; a tag at the end just stops the scan
+            if (! readHeader (in, pos, header) || ! header.matches (first))
+                pos = findFrame (in, pos + 1, totalLength, header, &first);
+        }
+
+        return index.release();
+    }
+
+    /** Reads an index written by writeTo(), or returns nullptr if the stream holds
+        something else, or the index of a different version of the file.
+    */
+    static Mp3SeekIndex* readFrom (InputStream& in, int64 expectedHashCode)
+    {
+        char magic[4];
+
+        if (in.read (magic, 4) != 4 || memcmp (magic, "jmsi", 4) != 0
+             || in.readInt() != formatVersion
+             || in.readInt64() != expectedHashCode
+             || in.readInt() != framesPerSeekPoint)
+            return nullptr;
+
+        ScopedPointer<Mp3SeekIndex> index (new Mp3SeekIndex());
+        index->hashCode = expectedHashCode;
+        index->sampleRate = in.readDouble();
+        index->numChannels = in.readInt();
+        index->numFrames = in.readInt64();
+        index->endOfFrames = in.readInt64();
+
+        const int numSeekPoints = in.readInt();
+
+        if (numSeekPoints <= 0
+             || numSeekPoints != (int) ((index->numFrames + framesPerSeekPoint - 1) / framesPerSeekPoint)
+             || in.getNumBytesRemaining() < numSeekPoints * (int64) sizeof (int64))
+            return nullptr;
+
+        index->seekPoints.ensureStorageAllocated (numSeekPoints);
+
+        for (int i = 0; i < numSeekPoints; ++i)
+            index->seekPoints.add (in.readInt64());
+
+        return index.release();
+    }
+
+    void writeTo (OutputStream& out) const
+    {
+        out.write ("jmsi", 4);
+        out.writeInt (formatVersion);
+        out.writeInt64 (hashCode);
+        out.writeInt (framesPerSeekPoint);
+        out.writeDouble (sampleRate);
+        out.writeInt (numChannels);
+        out.writeInt64 (numFrames);
+        out.writeInt64 (endOfFrames);
+        out.writeInt (seekPoints.size());
+
+        for (int i = 0; i < seekPoints.size(); ++i)
+            out.writeInt64 (seekPoints.getUnchecked (i));
+    }
+
+    //==============================================================================
+    int64 getHashCode() const noexcept              { return hashCode; }
+    double getSampleRate() const noexcept           { return sampleRate; }
+    int getNumChannels() const noexcept             { return numChannels; }
+    int64 getLengthInSamples() const noexcept       { return numFrames * samplesPerFrame; }
+
+    /** The position just after the last frame, which is where any trailing tags start. */
+    int64 getEndOfFrames() const noexcept           { return endOfFrames; }
+
+    /** Returns the byte position of the last seek point at or before the given sample,
+        and sets firstSample to the sample that decoding from there produces first.
+    */
+    int64 findSeekPoint (int64 sample, int64& firstSample) const noexcept
+    {
+        const int point = (int) jlimit ((int64) 0, (int64) seekPoints.size() - 1,
+                                        sample / (samplesPerFrame * framesPerSeekPoint));
+
+        firstSample = point * (int64) (samplesPerFrame * framesPerSeekPoint);
+        return seekPoints.getUnchecked (point);
+    }
+
+private:
+    //==============================================================================
+    enum
+    {
+        formatVersion = 1,
+        maxBytesToSearchForFirstFrame = 65536
+    };
+
+    int64 hashCode;
+    double sampleRate;
+    int numChannels;
+    int64 numFrames, endOfFrames;
+    Array<int64> seekPoints;    // the position of every framesPerSeekPoint'th frame
+
+    Mp3SeekIndex() : hashCode (0), sampleRate (0), numChannels (0), numFrames (0), endOfFrames (0) {}
+
+    struct FrameHeader
+    {
+        FrameHeader() : sampleRate (0), numChannels (0), frameSize (0) {}
+
+        bool parse (const uint8* h) noexcept
+        {
+            // an 11-bit sync word, then MPEG-1 and Layer III
+            if (h[0] != 0xff || (h[1] & 0xfe) != 0xfa)
+                return false;
+
+            const int bitRateIndex = h[2] >> 4;
+            const int sampleRateIndex = (h[2] >> 2) & 3;
+
+            // bit rate 0 is free format, whose frames have no size in their headers
+            if (bitRateIndex == 0 || bitRateIndex == 15 || sampleRateIndex == 3)
+                return false;
+
+            static const int kbitsPerSecond[] = { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 };
+            static const int sampleRates[] = { 44100, 48000, 32000 };
+
+            sampleRate = sampleRates [sampleRateIndex];
+            numChannels = (h[3] >> 6) == 3 ? 1 : 2;
+            frameSize = 144000 * kbitsPerSecond [bitRateIndex] / sampleRate + ((h[2] >> 1) & 1);
+            return true;
+        }
+
+        bool matches (const FrameHeader& other) const noexcept
+        {
+            return sampleRate == other.sampleRate && numChannels == other.numChannels;
+        }
+
+        int sampleRate, numChannels, frameSize;
+    };
+
+    static bool readHeader (InputStream& in, int64 pos, FrameHeader& header)
+    {
+        uint8 bytes[4];
+        return in.setPosition (pos) && in.read (bytes, 4) == 4 && header.parse (bytes);
+    }
+
+    /** Looks for a frame header at or after pos that's followed by another one, so
+        that a stray sync word in a tag or in junk isn't taken for a frame. Returns
+        its position, or -1.
+    */
+    static int64 findFrame (InputStream& in, int64 pos, int64 totalLength,
+                            FrameHeader& found, const FrameHeader* mustMatch)
+    {
+        const int64 searchEnd = jmin (totalLength - 4, pos + maxBytesToSearchForFirstFrame);
+
+        for (; pos <= searchEnd; ++pos)
+        {
+            FrameHeader candidate, next;
+
+            if (readHeader (in, pos, candidate)
+                 && (mustMatch == nullptr || candidate.matches (*mustMatch))
+                 && (pos + candidate.frameSize + 4 > totalLength
+                      || (readHeader (in, pos + candidate.frameSize, next) && next.matches (candidate))))
+            {
+                found = candidate;
+                return pos;
+            }
+        }
+
+        return -1;
+    }
+
+    /** Returns the position just after any ID3v2 tag at the start of the stream. */
+    static int64 skipID3 (InputStream& in)
+    {
+        uint8 bytes[10];
+
+        if (! in.setPosition (0) || in.read (bytes, 10) != 10 || memcmp (bytes, "ID3", 3) != 0)
+            return 0;
+
+        const int64 tagSize = (((int64) bytes[6] & 0x7f) << 21) | ((bytes[7] & 0x7f) << 14)
+                                | ((bytes[8] & 0x7f) << 7) | (bytes[9] & 0x7f);
+
+        return 10 + tagSize + ((bytes[5] & 0x10) != 0 ? 10 : 0);  // plus the footer, if there is one
+    }
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Mp3SeekIndex)
+};
+
+//==============================================================================
+/**
+    Reads an MP3 file using an Mp3SeekIndex to find where to start decoding.
+
+    The decoding is done by an ordinary MP3AudioFormat reader, opened on the part
+    of the file from a seek point onwards. Sequential reads carry on with the same
+    one; a read that jumps backwards, or further ahead than a couple of seek points,
+    opens a new one at the seek point a few frames before it, so a seek costs the
+    decoding of a dozen or so frames wherever it lands in the file.
+*/
+class IndexedMp3Reader  : public AudioFormatReader
+{
+public:
+    /** Takes ownership of the stream, and keeps a reference to the index. */
+    IndexedMp3Reader (FileInputStream* stream, Mp3SeekIndex* indexToUse, AudioFormat& mp3FormatToUse)
+        : AudioFormatReader (stream, "MP3 file"),
+          index (indexToUse),
+          mp3Format (mp3FormatToUse),
+          decoderStart (0),
+          decoderPosition (0),
+          numSeeks (0)
+    {
+        sampleRate = index->getSampleRate();
+        numChannels = (unsigned int) index->getNumChannels();
+        lengthInSamples = index->getLengthInSamples();
+        bitsPerSample = 32;
+        usesFloatingPointData = true;
+    }
+
+    bool readSamples (int** destSamples, int numDestChannels, int startOffsetInDestBuffer,
+                      int64 startSampleInFile, int numSamples) override
+    {
+        if (decoder == nullptr
+             || startSampleInFile < decoderPosition
+             || startSampleInFile > decoderPosition + maxFramesToDecodeThrough * Mp3SeekIndex::samplesPerFrame)
+        {
+            if (! openDecoderFor (startSampleInFile))
+                return false;
+        }
+
+        decoderPosition = startSampleInFile + numSamples;
+
+        return decoder->readSamples (destSamples, numDestChannels, startOffsetInDestBuffer,
+                                     startSampleInFile - decoderStart, numSamples);
+    }
+
+    /** The number of times that a read has needed decoding to start again from a seek point. */
+    int getNumSeeks() const noexcept        { return numSeeks; }
+
+private:
+    //==============================================================================
+    enum
+    {
+        // the bit reservoir and the overlap between frames mean the first frame or
+        // two after a jump don't come out right, so decoding starts a little early
+        prerollFrames = 4,
+        maxFramesToDecodeThrough = 2 * Mp3SeekIndex::framesPerSeekPoint
+    };
+
+    const Mp3SeekIndex::Ptr index;
+    AudioFormat& mp3Format;
+    ScopedPointer<AudioFormatReader> decoder;
+    int64 decoderStart, decoderPosition;
+    int numSeeks;
+
+    bool openDecoderFor (int64 sample)
+    {
+        decoder = nullptr;
+        ++numSeeks;
+
+        const int64 bytePos = index->findSeekPoint (sample - prerollFrames * Mp3SeekIndex::samplesPerFrame, decoderStart);
+        decoderPosition = decoderStart;
+
+        decoder = mp3Format.createReaderFor (new SubregionStream (input, bytePos, index->getEndOfFrames() - bytePos, false), true);
+        return decoder != nullptr;
+    }
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (IndexedMp3Reader)
+};
+
+//==============================================================================
+/**
+    An AudioFormat for MP3 files that reads them with an IndexedMp3Reader.
+
+    Register it with the AudioFormatManager before registerBasicFormats(), so that
+    it's tried ahead of the plain MP3AudioFormat. It only takes files opened through
+    a FileInputStream, so that it can find their index; anything else, and streams
+    that Mp3SeekIndex can't handle, falls through to the next format.
+
+    The first time a file is opened, its index is built and saved in the given
+    directory under the same hash as DiskThumbnailCache uses, and after that it's
+    loaded from there. The most recently used few are kept in memory, and a lock is
+    held while one is found or built, so the chunk jobs of a thumbnail that all open
+    the same new file at once wait for one scan rather than each doing their own.
+*/
+class IndexedMp3AudioFormat  : public AudioFormat
+{
+public:
+    IndexedMp3AudioFormat (const File& indexDirectoryToUse)
+        : AudioFormat ("Indexed MP3 file", ".mp3"),
+          indexDirectory (indexDirectoryToUse)
+    {
+        indexDirectory.createDirectory();
+    }
+
+    //==============================================================================
+    Array<int> getPossibleSampleRates() override    { return mp3Format.getPossibleSampleRates(); }
+    Array<int> getPossibleBitDepths() override      { return mp3Format.getPossibleBitDepths(); }
+    bool canDoStereo() override                     { return true; }
+    bool canDoMono() override                       { return true; }
+    bool isCompressed() override                    { return true; }
+
+    AudioFormatReader* createReaderFor (InputStream* source, bool deleteStreamIfOpeningFails) override
+    {
+        if (FileInputStream* fileStream = dynamic_cast<FileInputStream*> (source))
+        {
+            if (fileStream->getFile().hasFileExtension (getFileExtensions().joinIntoString (";")))
+            {
+                const Mp3SeekIndex::Ptr index (getIndexFor (fileStream->getFile()));
+
+                if (index != nullptr)
+                    return new IndexedMp3Reader (fileStream, index, mp3Format);
+            }
+        }
+
+        if (deleteStreamIfOpeningFails)
+            delete source;
+
+        return nullptr;
+    }
+
+    AudioFormatWriter* createWriterFor (OutputStream*, double, unsigned int, int,
+                                        const StringPairArray&, int) override
+    {
+        return nullptr;
+    }
+
+    //==============================================================================
+    /** Returns the index for a file, loading or building it if need be. */
+    Mp3SeekIndex::Ptr getIndexFor (const File& file)
+    {
+        const int64 hashCode = DiskThumbnailCache::getHashFor (file);
+        const ScopedLock sl (lock);
+
+        for (int i = 0; i < recentIndexes.size(); ++i)
+            if (recentIndexes.getUnchecked (i)->getHashCode() == hashCode)
+                return recentIndexes.getUnchecked (i);
+
+        const File indexFile (indexDirectory.getChildFile (String::toHexString (hashCode) + ".mp3index"));
+        Mp3SeekIndex::Ptr index;
+
+        {
+            FileInputStream in (indexFile);
+
+            if (in.openedOk())
+                index = Mp3SeekIndex::readFrom (in, hashCode);
+        }
+
+        if (index == nullptr)
+        {
+            FileInputStream in (file);
+
+            if (in.openedOk())
+                index = Mp3SeekIndex::build (in, hashCode);
+
+            if (index == nullptr)
+                return nullptr;
+
+            TemporaryFile temp (indexFile);
+            bool written = false;
+
+            {
+                FileOutputStream out (temp.getFile());
+
+                if (! out.failedToOpen())
+                {
+                    index->writeTo (out);
+                    out.flush();
+                    written = out.getStatus().wasOk();
+                }
+            }
+
+            if (written)
+                temp.overwriteTargetFileWithTemporary();
+        }
+
+        recentIndexes.add (index);
+
+        if (recentIndexes.size() > maxRecentIndexes)
+            recentIndexes.remove (0);
+
+        return index;
+    }
+
+private:
+    //==============================================================================
+    enum { maxRecentIndexes = 8 };
+
+    const File indexDirectory;
+    MP3AudioFormat mp3Format;
+    CriticalSection lock;
+    ReferenceCountedArray<Mp3SeekIndex> recentIndexes;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (IndexedMp3AudioFormat)
+};
+
+#endif  // JUCE_USE_MP3AUDIOFORMAT
+
+#endif  // MP3SEEKINDEX_H_INCLUDED
@@ -0,0 +1,2229 @@
+/*
+  ==============================================================================
+
+    MultiResolutionThumbnail.h
+
+  ==============================================================================
+*/
+
+#ifndef MULTIRESOLUTIONTHUMBNAIL_H_INCLUDED
+#define MULTIRESOLUTIONTHUMBNAIL_H_INCLUDED
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "RawPcmReader.h"
+
+//==============================================================================
+/**
+    The lowest and highest sample values seen over a run of source samples.
+
+    An empty pair has its maximum below its minimum, so points that haven't been
+    generated yet can be told apart from silent ones.
+*/
+struct ThumbnailMinMax
+{
+    float minValue, maxValue;
+
+    static ThumbnailMinMax empty() noexcept
+    {
+        const ThumbnailMinMax m = { std::numeric_limits<float>::max(),
+                                    -std::numeric_limits<float>::max() };
+        return m;
+    }
+
+    bool isEmpty() const noexcept        { return maxValue < minValue; }
+
+    void merge (const ThumbnailMinMax& other) noexcept
+    {
+        minValue = jmin (minValue, other.minValue);
+        maxValue = jmax (maxValue, other.maxValue);
+    }
+};
+
+//==============================================================================
+/**
+    The sum of the squares of a run of source samples, from which their RMS level
+    is worked out, and how many of them were clipped.
+
+    Unlike min/max pairs these add up, so a coarser point is the sum of the finer
+    points below it, and a point that's read in two parts is the sum of both.
+*/
+struct ThumbnailEnergy
+{
+    float sumOfSquares;
+    uint32 numClipped;
+
+    static ThumbnailEnergy empty() noexcept
+    {
+        const ThumbnailEnergy e = { 0.0f, 0 };
+        return e;
+    }
+
+    void add (const ThumbnailEnergy& other) noexcept
+    {
+        sumOfSquares += other.sumOfSquares;
+        numClipped += other.numClipped;
+    }
+
+    /** Measures a block of samples. */
+    static ThumbnailEnergy measure (const float* samples, int numSamples) noexcept
+    {
+        const float clipThreshold = MinMaxKernels::getClipThreshold();
+        ThumbnailEnergy e (empty());
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            e.sumOfSquares += samples[i] * samples[i];
+
+            if (std::abs (samples[i]) >= clipThreshold)
+                ++e.numClipped;
+        }
+
+        return e;
+    }
+};
+
+//==============================================================================
+/**
+    One channel of a finished ThumbnailLevel, packed into less memory.
+
+    The points can be stored as 32-bit floats, as 16-bit half floats, or as 8-bit
+    values scaled to the channel's peak. Minimums are always rounded down and
+    maximums up, so the waveform drawn from them never looks quieter than the
+    original, and getMaxError() reports how far any of them moved.
+
+    If compressRuns is set, the points are stored in blocks of pointsPerBlock, and a
+    block whose points are all the same (which is what silence, or a part of the
+    file that hasn't been read, looks like) is stored as a single point. Any point
+    can still be found directly from its block, so reads are decoded on the fly
+    without unpacking anything else.
+*/
+class CompactMinMaxChannel
+{
+public:
+    enum Format
+    {
+        floatFormat,        // 8 bytes per point; lossless
+        halfFloatFormat,    // 4 bytes per point; up to about 0.1% error
+        eightBitFormat      // 2 bytes per point; up to 1/127 of the channel's peak
+    };
+
+    CompactMinMaxChannel (const ThumbnailMinMax* points, int numPointsToUse,
+                          Format formatToUse, bool compressRuns)
+        : format (formatToUse),
+          numPoints (numPointsToUse),
+          bytesPerPoint (format == floatFormat ? 8 : (format == halfFloatFormat ? 4 : 2)),
+          numDataBytes (0),
+          scale (1.0f),
+          maxError (0.0f)
+    {
+        if (format == eightBitFormat)
+        {
+            float peak = 0.0f;
+
+            for (int i = 0; i < numPoints; ++i)
+                if (! points[i].isEmpty())
+                    peak = jmax (peak, std::abs (points[i].minValue), std::abs (points[i].maxValue));
+
+            if (peak > 0.0f)
+                scale = peak;
+        }
+
+        const int numBlocks = (numPoints + pointsPerBlock - 1) / pointsPerBlock;
+        HeapBlock<uint8> encoded ((size_t) jmax (1, numPoints) * (size_t) bytesPerPoint);
+
+        for (int i = 0; i < numPoints; ++i)
+        {
+            uint8* const dest = encoded + (size_t) i * (size_t) bytesPerPoint;
+            encodePoint (points[i], dest);
+
+            if (! points[i].isEmpty())
+            {
+                const ThumbnailMinMax decoded (decodePoint (dest));
+                maxError = jmax (maxError, std::abs (decoded.minValue - points[i].minValue),
+                                           std::abs (decoded.maxValue - points[i].maxValue));
+            }
+        }
+
+        if (! compressRuns)
+        {
+            data.swapWith (encoded);
+            numDataBytes = (size_t) numPoints * (size_t) bytesPerPoint;
+            return;
+        }
+
+        blockOffsets.malloc ((size_t) jmax (1, numBlocks));
+        data.malloc ((size_t) jmax (1, numPoints) * (size_t) bytesPerPoint);
+
+        for (int block = 0; block < numBlocks; ++block)
+        {
+            const int start = block * pointsPerBlock;
+            const int num = jmin ((int) pointsPerBlock, numPoints - start);
+            const uint8* const src = encoded + (size_t) start * (size_t) bytesPerPoint;
+            bool isConstant = true;
+
+            for (int i = 1; i < num && isConstant; ++i)
+                isConstant = memcmp (src, src + (size_t) i * (size_t) bytesPerPoint, (size_t) bytesPerPoint) == 0;
+
+            const size_t numBytes = (size_t) (isConstant ? 1 : num) * (size_t) bytesPerPoint;
+            blockOffsets[block] = (uint32) numDataBytes | (isConstant ? (uint32) constantBlockFlag : 0u);
+            memcpy (data + numDataBytes, src, numBytes);
+            numDataBytes += numBytes;
+        }
+
+        // the runs are only known once they've been found, so give back what they saved
+        data.realloc (jmax ((size_t) 1, numDataBytes));
+    }
+
+    //==============================================================================
+    int getNumPoints() const noexcept       { return numPoints; }
+    Format getFormat() const noexcept       { return format; }
+    bool hasCompressedRuns() const noexcept { return blockOffsets != nullptr; }
+
+    /** The memory that the points take up, including the block table. */
+    size_t getNumBytes() const noexcept
+    {
+        return numDataBytes + (blockOffsets != nullptr ? sizeof (uint32) * (size_t) ((numPoints + pointsPerBlock - 1) / pointsPerBlock)
+                                                       : 0);
+    }
+
+    /** The furthest that any stored value is from the one it was made from. */
+    float getMaxError() const noexcept      { return maxError; }
+
+    /** Merges the points from startPoint up to endPoint. A block that's a single run
+        is only looked at once, however many of its points are in the range.
+    */
+    ThumbnailMinMax getMinMax (int startPoint, int endPoint) const noexcept
+    {
+        ThumbnailMinMax result (ThumbnailMinMax::empty());
+
+        for (int i = jmax (0, startPoint), end = jmin (numPoints, endPoint); i < end;)
+        {
+            const int blockStart = (i / pointsPerBlock) * pointsPerBlock;
+            const int blockEnd = jmin (end, blockStart + (int) pointsPerBlock);
+            bool isConstant;
+            const uint8* const block = getBlock (i / pointsPerBlock, isConstant);
+
+            if (isConstant)
+            {
+                result.merge (decodePoint (block));
+            }
+            else
+            {
+                for (; i < blockEnd; ++i)
+                    result.merge (decodePoint (block + (size_t) (i - blockStart) * (size_t) bytesPerPoint));
+            }
+
+            i = blockEnd;
+        }
+
+        return result;
+    }
+
+    /** Unpacks all the points, e.g. so that the level can be written to again. */
+    void decodeTo (ThumbnailMinMax* dest) const noexcept
+    {
+        for (int i = 0; i < numPoints; ++i)
+            dest[i] = getMinMax (i, i + 1);
+    }
+
+private:
+    //==============================================================================
+    enum
+    {
+        pointsPerBlock = 64
+    };
+
+    static const uint32 constantBlockFlag = 0x80000000u;
+
+    const Format format;
+    const int numPoints, bytesPerPoint;
+    HeapBlock<uint8> data;
+    HeapBlock<uint32> blockOffsets;     // only used if runs are compressed
+    size_t numDataBytes;
+    float scale, maxError;
+
+    const uint8* getBlock (int block, bool& isConstant) const noexcept
+    {
+        if (blockOffsets == nullptr)
+        {
+            isConstant = false;
+            return data + (size_t) block * pointsPerBlock * (size_t) bytesPerPoint;
+        }
+
+        const uint32 offset = blockOffsets[block];
+        isConstant = (offset & constantBlockFlag) != 0;
+        return data + (offset & ~constantBlockFlag);
+    }
+
+    //==============================================================================
+    void encodePoint (const ThumbnailMinMax& point, uint8* dest) const noexcept
+    {
+        switch (format)
+        {
+            case floatFormat:
+                memcpy (dest, &point, sizeof (point));
+                break;
+
+            case halfFloatFormat:
+            {
+                // an empty point becomes the largest half float for its minimum and the
+                // smallest for its maximum, which still reads back as empty
+                const uint16 values[] = { point.isEmpty() ? (uint16) 0x7bff : halfFloatBelow (point.minValue),
+                                          point.isEmpty() ? (uint16) 0xfbff : halfFloatAbove (point.maxValue) };
+                memcpy (dest, values, sizeof (values));
+                break;
+            }
+
+            case eightBitFormat:
+            default:
+            {
+                int8* const values = reinterpret_cast<int8*> (dest);
+                values[0] = point.isEmpty() ? (int8) 127  : (int8) jlimit (-127, 127, (int) std::floor (point.minValue * 127.0f / scale));
+                values[1] = point.isEmpty() ? (int8) -127 : (int8) jlimit (-127, 127, (int) std::ceil  (point.maxValue * 127.0f / scale));
+                break;
+            }
+        }
+    }
+
+    ThumbnailMinMax decodePoint (const uint8* src) const noexcept
+    {
+        ThumbnailMinMax point;
+
+        switch (format)
+        {
+            case floatFormat:
+                memcpy (&point, src, sizeof (point));
+                break;
+
+            case halfFloatFormat:
+            {
+                uint16 values[2];
+                memcpy (values, src, sizeof (values));
+                point.minValue = halfFloatToFloat (values[0]);
+                point.maxValue = halfFloatToFloat (values[1]);
+                break;
+            }
+
+            case eightBitFormat:
+            default:
+            {
+                const int8* const values = reinterpret_cast<const int8*> (src);
+                point.minValue = values[0] * scale / 127.0f;
+                point.maxValue = values[1] * scale / 127.0f;
+                break;
+            }
+        }
+
+        return point;
+    }
+
+    //==============================================================================
+    /** Converts to the nearest IEEE half float, clamping anything too big for one. */
+    static uint16 floatToHalfFloat (float value) noexcept
+    {
+        uint32 bits;
+        memcpy (&bits, &value, sizeof (bits));
+
+        const uint32 sign = (bits >> 16) & 0x8000;
+        const int exponent = (int) ((bits >> 23) & 0xff) - 127 + 15;
+        uint32 mantissa = bits & 0x7fffff;
+
+        if ((bits & 0x7fffffff) > 0x477fe000)   // beyond 65504, the largest half float
+            return (uint16) (sign | 0x7bff);
+
+        if (exponent <= 0)
+        {
+            if (exponent < -10)
+                return (uint16) sign;
+
+            mantissa |= 0x800000;
+            const int shift = 14 - exponent;
+            return (uint16) (sign | ((mantissa >> shift) + ((mantissa >> (shift - 1)) & 1)));
+        }
+
+        // a carry out of the mantissa correctly bumps the exponent
+        return (uint16) ((sign | ((uint32) exponent << 10) | (mantissa >> 13)) + ((mantissa >> 12) & 1));
+    }
+
+    static float halfFloatToFloat (uint16 half) noexcept
+    {
+        const uint32 sign = (uint32) (half & 0x8000) << 16;
+        const int exponent = (half >> 10) & 0x1f;
+        const uint32 mantissa = half & 0x3ff;
+
+        if (exponent == 0)
+        {
+            const float value = std::ldexp ((float) mantissa, -24);
+            return sign != 0 ? -value : value;
+        }
+
+        const uint32 bits = sign | (exponent == 31 ? 0x7f800000 | (mantissa << 13)
+                                                   : ((uint32) (exponent - 15 + 127) << 23) | (mantissa << 13));
+        float value;
+        memcpy (&value, &bits, sizeof (value));
+        return value;
+    }
+
+    /** The half float that's nearest to the value without being above it. */
+    static uint16 halfFloatBelow (float value) noexcept
+    {
+        const uint16 half = floatToHalfFloat (value);
+
+        if (halfFloatToFloat (half) <= value)   return half;
+        if (half == 0x0000)                     return 0x8001;
+        return (half & 0x8000) != 0 ? (uint16) (half + 1) : (uint16) (half - 1);
+    }
+
+    /** The half float that's nearest to the value without being below it. */
+    static uint16 halfFloatAbove (float value) noexcept
+    {
+        const uint16 half = floatToHalfFloat (value);
+
+        if (halfFloatToFloat (half) >= value)   return half;
+        if (half == 0x8000)                     return 0x0001;
+        return (half & 0x8000) != 0 ? (uint16) (half - 1) : (uint16) (half + 1);
+    }
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (CompactMinMaxChannel)
+};
+
+//==============================================================================
+/**
+    One level of a MultiResolutionThumbnail's pyramid: a min/max point for every
+    samplesPerPoint source samples, stored separately for each channel.
+
+    The points either live in a block that the level owns, or in a block of memory
+    that belongs to someone else (such as a memory-mapped cache file), or, once the
+    level is finished, in CompactMinMaxChannels. The last two are only turned back
+    into a block of its own if something tries to write to the level.
+
+    Both kinds of block are channel-planar, each channel's points following the
+    last channel's, which is also how they're laid out in the cache. That keeps a
+    level to one allocation however many channels there are, and lets a whole
+    level be read or written in one go. An owned block leaves room at the end of
+    each channel, so that a file that's still growing doesn't move it every time.
+*/
+class ThumbnailLevel
+{
+public:
+    ThumbnailLevel (int samplesPerPointToUse)
+        : samplesPerPoint (samplesPerPointToUse), numChannels (0), numPoints (0), pointStride (0),
+          externalData (nullptr), externalEnergy (nullptr)
+    {
+    }
+
+    /** Clears the level and sizes it for a source. With withEnergy set, each point
+        gets a ThumbnailEnergy as well as its min/max pair.
+    */
+    void setSize (int newNumChannels, int64 numSourceSamples, bool withEnergy)
+    {
+        compactChannels.clear();
+        energyData.free();
+        externalData = nullptr;
+        externalEnergy = nullptr;
+        numChannels = newNumChannels;
+        numPoints = pointStride = getNumPointsFor (numSourceSamples);
+
+        allocatePoints (pointData, ThumbnailMinMax::empty());
+
+        if (withEnergy)
+            allocatePoints (energyData, ThumbnailEnergy::empty());
+    }
+
+    /** Makes the level read its points from data that it doesn't own, laid out as
+        each channel's points in turn, and likewise its energy if energy isn't
+        null. The data must stay valid until setSize() is next called.
+    */
+    void useExternalData (const ThumbnailMinMax* data, const ThumbnailEnergy* energy,
+                          int newNumChannels, int64 numSourceSamples)
+    {
+        compactChannels.clear();
+        pointData.free();
+        energyData.free();
+        externalData = data;
+        externalEnergy = energy;
+        numChannels = newNumChannels;
+        numPoints = pointStride = getNumPointsFor (numSourceSamples);
+    }
+
+    void ensureSize (int64 numSourceSamples)
+    {
+        const int newNumPoints = getNumPointsFor (numSourceSamples);
+
+        if (newNumPoints > numPoints)
+        {
+            makeWritable();
+
+            // the space past each channel's points is kept empty, so only a block
+            // that's run out of room needs anything doing to it
+            if (newNumPoints > pointStride)
+            {
+                const int newStride = jmax (newNumPoints, pointStride + pointStride / 2);
+
+                growPoints (pointData, ThumbnailMinMax::empty(), newStride);
+
+                if (energyData != nullptr)
+                    growPoints (energyData, ThumbnailEnergy::empty(), newStride);
+
+                pointStride = newStride;
+            }
+
+            numPoints = newNumPoints;
+        }
+    }
+
+    /** Empties every channel's points (and energy) covering a range of source
+        samples that starts on a point boundary, so that it can be read again.
+    */
+    void clearPoints (int64 startSample, int64 endSample)
+    {
+        jassert (startSample % samplesPerPoint == 0);
+
+        const int firstPoint = (int) (startSample / samplesPerPoint);
+        const int endPoint   = jmin (numPoints, getNumPointsFor (endSample));
+
+        if (endPoint <= firstPoint)
+            return;
+
+        makeWritable();
+
+        for (int chan = 0; chan < numChannels; ++chan)
+        {
+            ThumbnailMinMax* const points = pointData + (size_t) chan * (size_t) pointStride;
+            std::fill (points + firstPoint, points + endPoint, ThumbnailMinMax::empty());
+
+            if (energyData != nullptr)
+            {
+                ThumbnailEnergy* const energy = energyData + (size_t) chan * (size_t) pointStride;
+                std::fill (energy + firstPoint, energy + endPoint, ThumbnailEnergy::empty());
+            }
+        }
+    }
+
+    int getNumPointsFor (int64 numSourceSamples) const noexcept
+    {
+        return (int) ((numSourceSamples + samplesPerPoint - 1) / samplesPerPoint);
+    }
+
+    int getNumPoints() const noexcept                        { return numPoints; }
+    int getNumChannels() const noexcept                      { return numChannels; }
+    bool isCompact() const noexcept                          { return compactChannels.size() > 0; }
+    bool hasEnergy() const noexcept                          { return externalEnergy != nullptr || energyData != nullptr; }
+
+    /** Returns the points of a level that isn't compact. */
+    const ThumbnailMinMax* getChannelData (int channel) const noexcept
+    {
+        jassert (! isCompact());
+
+        return (externalData != nullptr ? externalData : pointData.getData()) + (size_t) channel * (size_t) pointStride;
+    }
+
+    ThumbnailMinMax* getWritableChannelData (int channel)
+    {
+        makeWritable();
+        return pointData + (size_t) channel * (size_t) pointStride;
+    }
+
+    /** Returns a channel's energy points; the level must have them. */
+    const ThumbnailEnergy* getEnergyData (int channel) const noexcept
+    {
+        jassert (hasEnergy());
+
+        return (externalEnergy != nullptr ? externalEnergy : energyData.getData()) + (size_t) channel * (size_t) pointStride;
+    }
+
+    ThumbnailEnergy* getWritableEnergyData (int channel)
+    {
+        makeWritable();
+        return energyData + (size_t) channel * (size_t) pointStride;
+    }
+
+    /** Packs the points into CompactMinMaxChannels, freeing the block (or letting go
+        of the external data) that they were in. Returns the largest error this made.
+        Any energy points stay as they are, but are copied if they were external.
+
+        If the level is already stored that way it's left alone, rather than losing
+        more precision by being packed a second time.
+    */
+    float compact (CompactMinMaxChannel::Format format, bool compressRuns)
+    {
+        OwnedArray<CompactMinMaxChannel> newChannels;
+        float maxError = 0.0f;
+
+        if (isCompact() && compactChannels.getFirst()->getFormat() == format
+             && compactChannels.getFirst()->hasCompressedRuns() == compressRuns)
+        {
+            for (int i = 0; i < compactChannels.size(); ++i)
+                maxError = jmax (maxError, compactChannels.getUnchecked (i)->getMaxError());
+
+            return maxError;
+        }
+
+        makeWritable();
+
+        for (int i = 0; i < numChannels; ++i)
+        {
+            CompactMinMaxChannel* const c = newChannels.add (new CompactMinMaxChannel (getChannelData (i), numPoints,
+                                                                                      format, compressRuns));
+            maxError = jmax (maxError, c->getMaxError());
+        }
+
+        pointData.free();
+        compactChannels.swapWith (newChannels);
+        return maxError;
+    }
+
+    /** Unpacks a compact level back into a block of floats. */
+    void expand()
+    {
+        if (isCompact())
+            makeWritable();
+    }
+
+    /** The memory that the points take up, wherever they live. */
+    size_t getNumBytes() const noexcept
+    {
+        size_t total = hasEnergy() ? sizeof (ThumbnailEnergy) * (size_t) numChannels * (size_t) numPoints : 0;
+
+        if (! isCompact())
+            return total + sizeof (ThumbnailMinMax) * (size_t) numChannels * (size_t) numPoints;
+
+        for (int i = 0; i < compactChannels.size(); ++i)
+            total += compactChannels.getUnchecked (i)->getNumBytes();
+
+        return total;
+    }
+
+    /** Writes every channel's points out as floats, one channel after another,
+        however they're stored.
+    */
+    bool writePoints (OutputStream& output) const
+    {
+        if (! isCompact())
+            return writePlanar (output, getChannelData (0));
+
+        HeapBlock<ThumbnailMinMax> points ((size_t) jmax (1, numPoints));
+
+        for (int chan = 0; chan < numChannels; ++chan)
+        {
+            compactChannels.getUnchecked (chan)->decodeTo (points);
+
+            if (! output.write (points, sizeof (ThumbnailMinMax) * (size_t) numPoints))
+                return false;
+        }
+
+        return true;
+    }
+
+    bool writeEnergy (OutputStream& output) const
+    {
+        return writePlanar (output, getEnergyData (0));
+    }
+
+    /** Reads what writePoints() wrote, into a level that's been sized for it. */
+    bool readPoints (InputStream& input)
+    {
+        return readPlanar (input, getWritableChannelData (0));
+    }
+
+    bool readEnergy (InputStream& input)
+    {
+        return readPlanar (input, getWritableEnergyData (0));
+    }
+
+    /** Merges all the points that overlap the given range of source samples. */
+    ThumbnailMinMax getMinMax (int channel, int64 startSample, int64 endSample) const noexcept
+    {
+        const int firstPoint = (int) jmax ((int64) 0, startSample / samplesPerPoint);
+        const int endPoint   = (int) jmin ((int64) numPoints, (endSample + samplesPerPoint - 1) / samplesPerPoint);
+
+        if (isCompact())
+            return compactChannels.getUnchecked (channel)->getMinMax (firstPoint, endPoint);
+
+        ThumbnailMinMax result (ThumbnailMinMax::empty());
+        const ThumbnailMinMax* const data = getChannelData (channel);
+
+        for (int i = firstPoint; i < endPoint; ++i)
+            result.merge (data[i]);
+
+        return result;
+    }
+
+    /** Adds up the energy of all the points that overlap the given range of source
+        samples, and sets numSamplesCovered to how many of the source's samples
+        those points span, for dividing the sum of squares by.
+    */
+    ThumbnailEnergy getEnergy (int channel, int64 startSample, int64 endSample,
+                               int64 numSourceSamples, int64& numSamplesCovered) const noexcept
+    {
+        const int firstPoint = (int) jmax ((int64) 0, startSample / samplesPerPoint);
+        const int endPoint   = (int) jmin ((int64) numPoints, (endSample + samplesPerPoint - 1) / samplesPerPoint);
+
+        ThumbnailEnergy result (ThumbnailEnergy::empty());
+        const ThumbnailEnergy* const data = getEnergyData (channel);
+
+        for (int i = firstPoint; i < endPoint; ++i)
+            result.add (data[i]);
+
+        numSamplesCovered = jmax ((int64) 0, jmin (numSourceSamples, (int64) endPoint * samplesPerPoint)
+                                               - (int64) firstPoint * samplesPerPoint);
+        return result;
+    }
+
+    const int samplesPerPoint;
+
+private:
+    HeapBlock<ThumbnailMinMax> pointData;
+    OwnedArray<CompactMinMaxChannel> compactChannels;
+    HeapBlock<ThumbnailEnergy> energyData;
+    int numChannels, numPoints;
+
+    /** How far apart the channels' points are in the blocks; external data has
+        no room to spare, so it's numPoints there.
+    */
+    int pointStride;
+    const ThumbnailMinMax* externalData;
+    const ThumbnailEnergy* externalEnergy;
+
+    void makeWritable()
+    {
+        if (externalEnergy != nullptr)
+        {
+            energyData.malloc ((size_t) jmax (1, numChannels * pointStride));
+            memcpy (energyData, externalEnergy, sizeof (ThumbnailEnergy) * (size_t) numChannels * (size_t) pointStride);
+            externalEnergy = nullptr;
+        }
+
+        if (isCompact())
+        {
+            allocatePoints (pointData, ThumbnailMinMax::empty());
+
+            for (int i = 0; i < numChannels; ++i)
+                compactChannels.getUnchecked (i)->decodeTo (pointData + (size_t) i * (size_t) pointStride);
+
+            compactChannels.clear();
+        }
+        else if (externalData != nullptr)
+        {
+            pointData.malloc ((size_t) jmax (1, numChannels * pointStride));
+            memcpy (pointData, externalData, sizeof (ThumbnailMinMax) * (size_t) numChannels * (size_t) pointStride);
+            externalData = nullptr;
+        }
+    }
+
+    /** Allocates numChannels * pointStride items, all set to the given value. */
+    template <typename PointType>
+    void allocatePoints (HeapBlock<PointType>& block, const PointType& initialValue)
+    {
+        const size_t total = (size_t) numChannels * (size_t) pointStride;
+        block.malloc (jmax ((size_t) 1, total));
+        std::fill (block.getData(), block.getData() + total, initialValue);
+    }
+
+    /** Spreads a block's channels out to newStride points apiece, filling the space
+        at the end of each with the given value.
+    */
+    template <typename PointType>
+    void growPoints (HeapBlock<PointType>& block, const PointType& emptyValue, int newStride)
+    {
+        HeapBlock<PointType> grown ((size_t) jmax (1, numChannels * newStride));
+
+        for (int chan = 0; chan < numChannels; ++chan)
+        {
+            PointType* const dest = grown + (size_t) chan * (size_t) newStride;
+            memcpy (dest, block + (size_t) chan * (size_t) pointStride, sizeof (PointType) * (size_t) numPoints);
+            std::fill (dest + numPoints, dest + newStride, emptyValue);
+        }
+
+        block.swapWith (grown);
+    }
+
+    /** Writes numPoints from each channel of a block laid out with pointStride,
+        which is one write when there's no room left at the ends.
+    */
+    template <typename PointType>
+    bool writePlanar (OutputStream& output, const PointType* data) const
+    {
+        if (pointStride == numPoints)
+            return output.write (data, sizeof (PointType) * (size_t) numChannels * (size_t) numPoints);
+
+        for (int chan = 0; chan < numChannels; ++chan)
+            if (! output.write (data + (size_t) chan * (size_t) pointStride, sizeof (PointType) * (size_t) numPoints))
+                return false;
+
+        return true;
+    }
+
+    template <typename PointType>
+    bool readPlanar (InputStream& input, PointType* data)
+    {
+        const int numBytes = (int) sizeof (PointType) * numPoints;
+        const int64 totalBytes = (int64) numBytes * numChannels;
+
+        if (pointStride == numPoints && totalBytes < 0x7fffffff)
+            return input.read (data, (int) totalBytes) == (int) totalBytes;
+
+        for (int chan = 0; chan < numChannels; ++chan)
+            if (input.read (data + (size_t) chan * (size_t) pointStride, numBytes) != numBytes)
+                return false;
+
+        return true;
+    }
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ThumbnailLevel)
+};
+
+//==============================================================================
+/**
+    An AudioThumbnailBase that keeps a mipmapped pyramid of min/max levels rather
+    than the single fixed resolution that AudioThumbnail uses.
+
+    Each level is levelRatio times coarser than the one below it, and all of them
+    are filled in the same pass over the source: a block of incoming samples
+    updates the finest level, and the coarser levels are folded up from it for
+    just the range that changed.
+
+    When drawing, the coarsest level that still has at least one point per pixel
+    is used, so the cost of a paint depends on the width being drawn rather than
+    the length of the file.
+
+    If the source is an uncompressed WAV file, the finest level is built by
+    running the vectorised MinMaxKernels over the mapped file data instead of
+    decoding it through an AudioFormatReader.
+
+    The source is split into independent chunks which are generated by jobs on
+    the given ThreadPool, each with a reader of its own. Chunks are merged into
+    the levels as they go, so parts of the waveform appear as soon as they've
+    been read, in whatever order the jobs get to them.
+
+    A MemoryMappedAudioFormatReader that's also being used for playback can be
+    given to setSharedReader(), in which case all the chunk jobs read from that
+    one mapping instead of opening the file again.
+
+    Points are generated as floats, but setStorage() can have the levels packed
+    into smaller CompactMinMaxChannels once the thumbnail is complete. The cache
+    still gets floats, so its files don't depend on the storage that's chosen.
+
+    With setCollectsEnergy(), the same pass also fills in a ThumbnailEnergy for
+    every point, which drawEnergy() uses to show RMS levels and clipping.
+
+    A thumbnail made by the kernels also keeps a hash of each block of the file's
+    sample data, and saves them with its points. When a file has been edited, pass
+    the hash code of the earlier version's thumbnail to setSource() or
+    setSharedReader(): if that's still in the cache and the file's layout and
+    length are the same, it's loaded and each block is hashed again, and only the
+    blocks whose hash has changed are reduced, rather than the whole file.
+*/
+class MultiResolutionThumbnail : public AudioThumbnailBase
+{
+public:
+    MultiResolutionThumbnail (int finestSamplesPerThumbSample,
+                              int numLevelsToUse,
+                              AudioFormatManager& formatManagerToUse,
+                              AudioThumbnailCache& cacheToUse,
+                              ThreadPool& threadPoolToUse)
+        : formatManager (formatManagerToUse),
+          cache (cacheToUse),
+          threadPool (threadPoolToUse),
+          numChannels (0),
+          sampleRate (0.0),
+          totalSamples (0),
+          numSamplesFinished (0),
+          hashCode (0),
+          sharedReader (nullptr),
+          isFollowingGrowth (false),
+          collectsEnergy (false),
+          storageFormat (CompactMinMaxChannel::floatFormat),
+          compressSilentRuns (false),
+          storageError (0.0f),
+          numBlocksReused (0),
+          readStartTime (0),
+          numBytesToRead (0)
+    {
+        jassert (finestSamplesPerThumbSample > 0 && numLevelsToUse > 0);
+
+        for (int i = 0, samplesPerPoint = finestSamplesPerThumbSample; i < numLevelsToUse; ++i)
+        {
+            levels.add (new ThumbnailLevel (samplesPerPoint));
+            samplesPerPoint *= levelRatio;
+        }
+    }
+
+    ~MultiResolutionThumbnail()
+    {
+        clear();
+    }
+
+    //==============================================================================
+    void clear() override
+    {
+        stopReading();
+
+        const ScopedLock sl (lock);
+        hashCode = 0;
+        setDataSize (0, 0.0, 0);
+        sendChangeMessage();
+    }
+
+    bool setSource (InputSource* newSource) override
+    {
+        return setSource (newSource, newSource != nullptr ? newSource->hashCode() : 0);
+    }
+
+    /** Like setSource(), but with a hash code of the caller's choosing, such as
+        DiskThumbnailCache::getHashFor(), to look the thumbnail up in the cache with.
+
+        If the thumbnail isn't in the cache, but one for an earlier version of the
+        same file is, passing that one's hash code as previousVersionHashCode lets
+        its unchanged blocks be reused, as DiskThumbnailCache::getLatestVersionOf()
+        finds.
+    */
+    bool setSource (InputSource* newSource, int64 hashCodeToUse, int64 previousVersionHashCode = 0)
+    {
+        clear();
+
+        return newSource != nullptr
+                && startReading (newSource, nullptr, nullptr, hashCodeToUse, previousVersionHashCode);
+    }
+
+    void setReader (AudioFormatReader* newReader, int64 hashCodeToUse) override
+    {
+        clear();
+
+        if (newReader != nullptr)
+            startReading (nullptr, newReader, nullptr, hashCodeToUse, 0);
+    }
+
+    /** Builds the thumbnail from a memory-mapped reader that's owned by the caller,
+        so that the same mapping can also be used for playback.
+
+        The whole file must already be mapped. Reading a mapped file doesn't change
+        any reader state, so the chunk jobs all read from it at once; the reader
+        must stay alive until clear() is called or another source is set.
+        previousVersionHashCode works as it does for setSource().
+    */
+    void setSharedReader (MemoryMappedAudioFormatReader* newReader, int64 hashCodeToUse,
+                          int64 previousVersionHashCode = 0)
+    {
+        clear();
+
+        if (newReader != nullptr)
+            startReading (nullptr, nullptr, newReader, hashCodeToUse, previousVersionHashCode);
+    }
+
+    /** For a WAV file that's still being written: extends the thumbnail to the
+        file's new length and reads just the samples that have been added, along
+        with the last point from before, which may only have been partly filled.
+
+        Pass in a RawPcmReader made with isGrowing set, which has just re-read the
+        file's header. Returns false if the thumbnail is still being generated, the
+        file hasn't grown, or its layout doesn't match; it's fine to try again later.
+
+        While a file is being followed, the results aren't stored in the cache, as
+        that would mean writing out the whole thumbnail again for every extension.
+    */
+    bool appendFromGrowingFile (const RawPcmReader& grownFile, int64 newHashCode)
+    {
+        if (isGenerating() || grownFile.numChannels != numChannels
+             || grownFile.sampleRate != sampleRate || grownFile.lengthInSamples <= totalSamples)
+            return false;
+
+        const int samplesPerPoint = levels.getUnchecked (0)->samplesPerPoint;
+        int64 appendStart;
+
+        {
+            const ScopedLock sl (lock);
+
+            appendStart = (totalSamples / samplesPerPoint) * samplesPerPoint;
+            totalSamples = grownFile.lengthInSamples;
+
+            for (int i = 0; i < levels.size(); ++i)
+                levels.getUnchecked (i)->ensureSize (totalSamples);
+
+            // energy adds up rather than merging, so the point that's read again
+            // has to start from nothing
+            ThumbnailLevel& finest = *levels.getUnchecked (0);
+
+            if (finest.hasEnergy())
+                for (int chan = 0; chan < numChannels; ++chan)
+                    finest.getWritableEnergyData (chan)[appendStart / samplesPerPoint] = ThumbnailEnergy::empty();
+
+            // the appended samples don't start on a block boundary, and nothing's
+            // stored while a file is followed, so there are no block hashes to keep
+            blockHashes.clearQuick();
+            previousBlockHashes.clearQuick();
+
+            numSamplesFinished = appendStart;
+            hashCode = newHashCode;
+            source = nullptr;
+            sharedReader = nullptr;
+            rawSourceFile = grownFile.file;
+            isFollowingGrowth = true;
+            numChunksRemaining = 1;
+            generating = 1;
+        }
+
+        readStartTime = Time::getMillisecondCounterHiRes();
+        numBytesToRead = (totalSamples - appendStart) * numChannels * MinMaxKernels::getBytesPerSample (grownFile.format);
+
+        threadPool.addJob (new ChunkJob (*this, appendStart, totalSamples, nullptr), true);
+        sendChangeMessage();
+        return true;
+    }
+
+    //==============================================================================
+    bool loadFrom (InputStream& input) override
+    {
+        int newNumChannels, savedFramesPerHashBlock, numSavedBlockHashes;
+        double newSampleRate;
+        int64 newTotalSamples, newNumFinished;
+        bool hasSavedEnergy;
+
+        if (! readHeader (input, newNumChannels, newSampleRate, newTotalSamples, newNumFinished, hasSavedEnergy,
+                          savedFramesPerHashBlock, numSavedBlockHashes)
+             || (collectsEnergy && ! hasSavedEnergy))
+            return false;
+
+        const ScopedLock sl (lock);
+        setDataSize (newNumChannels, newSampleRate, newTotalSamples);
+
+        for (int i = 0; i < levels.size(); ++i)
+        {
+            if (! levels.getUnchecked (i)->readPoints (input))
+            {
+                setDataSize (0, 0.0, 0);
+                return false;
+            }
+        }
+
+        // saved energy is skipped if it isn't wanted
+        if (collectsEnergy)
+        {
+            for (int i = 0; i < levels.size(); ++i)
+            {
+                if (! levels.getUnchecked (i)->readEnergy (input))
+                {
+                    setDataSize (0, 0.0, 0);
+                    return false;
+                }
+            }
+        }
+        else if (hasSavedEnergy)
+        {
+            input.skipNextBytes ((int64) (sizeof (ThumbnailEnergy) * (size_t) numChannels * getNumPointsPerChannel()));
+        }
+
+        readBlockHashes (input, savedFramesPerHashBlock, numSavedBlockHashes);
+        numSamplesFinished = newNumFinished;
+        sendChangeMessage();
+        return true;
+    }
+
+    /** Loads data written by saveTo() from a memory-mapped file without copying it:
+        the levels read their points straight out of the mapping, which the thumbnail
+        takes ownership of.
+
+        The data starts at offsetInMap, and must be 4-byte aligned. Returns false (and
+        deletes the mapping) if it isn't a complete thumbnail of the right shape.
+    */
+    bool loadFromMappedFile (MemoryMappedFile* mapToUse, size_t offsetInMap)
+    {
+        ScopedPointer<MemoryMappedFile> map (mapToUse);
+
+        if (map == nullptr || map->getData() == nullptr || map->getSize() < offsetInMap + (size_t) headerSize)
+            return false;
+
+        const char* const data = static_cast<const char*> (map->getData()) + offsetInMap;
+        jassert (((pointer_sized_int) data & 3) == 0);
+
+        MemoryInputStream header (data, (size_t) headerSize, false);
+        int newNumChannels, savedFramesPerHashBlock, numSavedBlockHashes;
+        double newSampleRate;
+        int64 newTotalSamples, newNumFinished;
+        bool hasSavedEnergy;
+
+        if (! readHeader (header, newNumChannels, newSampleRate, newTotalSamples, newNumFinished, hasSavedEnergy,
+                          savedFramesPerHashBlock, numSavedBlockHashes)
+             || (collectsEnergy && ! hasSavedEnergy))
+            return false;
+
+        size_t numPointsPerChannel = 0;
+
+        for (int i = 0; i < levels.size(); ++i)
+            numPointsPerChannel += (size_t) levels.getUnchecked (i)->getNumPointsFor (newTotalSamples);
+
+        const size_t numMinMaxBytes = sizeof (ThumbnailMinMax) * (size_t) newNumChannels * numPointsPerChannel;
+        const size_t numEnergyBytes = hasSavedEnergy ? sizeof (ThumbnailEnergy) * (size_t) newNumChannels * numPointsPerChannel : 0;
+        const size_t numHashBytes = sizeof (uint64) * (size_t) numSavedBlockHashes;
+
+        if (map->getSize() - offsetInMap < (size_t) headerSize + numMinMaxBytes + numEnergyBytes + numHashBytes)
+            return false;
+
+        {
+            const ScopedLock sl (lock);
+            setDataSize (0, 0.0, 0);
+
+            numChannels = newNumChannels;
+            sampleRate = newSampleRate;
+            totalSamples = newTotalSamples;
+            numSamplesFinished = newNumFinished;
+
+            const ThumbnailMinMax* points = reinterpret_cast<const ThumbnailMinMax*> (data + headerSize);
+            const ThumbnailEnergy* energy = collectsEnergy ? reinterpret_cast<const ThumbnailEnergy*> (data + headerSize + numMinMaxBytes)
+                                                           : nullptr;
+
+            for (int i = 0; i < levels.size(); ++i)
+            {
+                ThumbnailLevel& level = *levels.getUnchecked (i);
+                level.useExternalData (points, energy, numChannels, totalSamples);
+                points += (size_t) numChannels * (size_t) level.getNumPoints();
+
+                if (energy != nullptr)
+                    energy += (size_t) numChannels * (size_t) level.getNumPoints();
+            }
+
+            // the hashes are few enough to copy, and aren't needed for drawing
+            MemoryInputStream hashes (data + headerSize + numMinMaxBytes + numEnergyBytes, numHashBytes, false);
+            readBlockHashes (hashes, savedFramesPerHashBlock, numSavedBlockHashes);
+
+            mappedFile = map.release();
+        }
+
+        sendChangeMessage();
+        return true;
+    }
+
+    void saveTo (OutputStream& output) const override
+    {
+        const ScopedLock sl (lock);
+
+        output.write ("jmrt", 4);
+        output.writeInt (formatVersion);
+        output.writeInt (numChannels);
+        output.writeDouble (sampleRate);
+        output.writeInt64 (totalSamples);
+        output.writeInt64 (numSamplesFinished);
+        output.writeInt (levels.size());
+        output.writeInt (levels.getUnchecked (0)->samplesPerPoint);
+
+        const bool withEnergy = hasEnergy();
+        output.writeInt (withEnergy ? 1 : 0);
+        output.writeInt (blockHashes.size() > 0 ? getFramesPerHashBlock() : 0);
+        output.writeInt (blockHashes.size());
+        output.writeInt64 (0);  // padding, so that the points stay as aligned as the header
+
+        for (int i = 0; i < levels.size(); ++i)
+            levels.getUnchecked (i)->writePoints (output);
+
+        if (withEnergy)
+            for (int i = 0; i < levels.size(); ++i)
+                levels.getUnchecked (i)->writeEnergy (output);
+
+        for (int i = 0; i < blockHashes.size(); ++i)
+            output.writeInt64 ((int64) blockHashes.getUnchecked (i));
+    }
+
+    /** Returns true if the thumbnail has a hash of every block of its source, so
+        that a later version of the file can be updated from it.
+    */
+    bool hasBlockHashes() const noexcept                    { return blockHashes.size() > 0; }
+
+    /** The WAV file that the kernels are reading, or were while the thumbnail was
+        made; File() if it came from a reader.
+    */
+    const File& getRawSourceFile() const noexcept           { return rawSourceFile; }
+
+    //==============================================================================
+    int getNumChannels() const noexcept override            { return numChannels; }
+    double getTotalLength() const noexcept override         { return sampleRate > 0 ? (totalSamples / sampleRate) : 0.0; }
+    bool isFullyLoaded() const noexcept override            { return numSamplesFinished >= totalSamples; }
+    int64 getNumSamplesFinished() const noexcept override   { return numSamplesFinished; }
+    int64 getHashCode() const override                      { return hashCode; }
+
+    /** True while chunk jobs are still working on the source. It only goes false
+        once the result has been stored in the cache, and a change message is sent
+        when it does. If it goes false without isFullyLoaded() becoming true, part
+        of the source couldn't be read.
+    */
+    bool isGenerating() const noexcept                      { return generating.get() != 0; }
+
+    /** Tells the chunk jobs to stop, without waiting for any that are running, so
+        that the message thread never blocks on them. The points they've made are
+        kept until clear() or setSource(), which wait for the jobs, and so are best
+        left until hasChunkJobs() is false. A change message is sent when it goes false.
+    */
+    void stopWithoutWaiting()
+    {
+        ChunkJobSelector selector (*this);
+        threadPool.removeAllJobs (true, 0, &selector);
+    }
+
+    /** True until every chunk job that was started has been deleted. */
+    bool hasChunkJobs() const noexcept                      { return numChunkJobs.get() > 0; }
+
+    //==============================================================================
+    /** Makes the thumbnail work out each point's RMS energy and clip count as well
+        as its min and max, in the same pass. This applies from the next source
+        that's set, and a cached thumbnail that was stored without them counts as
+        a miss, so that they're generated.
+    */
+    void setCollectsEnergy (bool shouldCollect)
+    {
+        const ScopedLock sl (lock);
+        collectsEnergy = shouldCollect;
+    }
+
+    bool isCollectingEnergy() const noexcept                { return collectsEnergy; }
+
+    /** True if the current data includes energy, for drawEnergy() to show. */
+    bool hasEnergy() const noexcept                         { return levels.getUnchecked (0)->hasEnergy() && numChannels > 0; }
+
+    //==============================================================================
+    /** Chooses how the levels are stored once the thumbnail is complete, which is
+        straight away if it already is. Until then, and while a file that's being
+        written is followed, they stay as floats so that they can be added to.
+    */
+    void setStorage (CompactMinMaxChannel::Format newFormat, bool shouldCompressSilentRuns)
+    {
+        const ScopedLock sl (lock);
+        storageFormat = newFormat;
+        compressSilentRuns = shouldCompressSilentRuns;
+
+        if (! isGenerating() && isFullyLoaded())
+            applyStorage();
+    }
+
+    /** The memory that all the levels' points take up, including any that are
+        read from a memory-mapped cache file.
+    */
+    size_t getNumBytesUsed() const
+    {
+        const ScopedLock sl (lock);
+        size_t total = 0;
+
+        for (int i = 0; i < levels.size(); ++i)
+            total += levels.getUnchecked (i)->getNumBytes();
+
+        return total;
+    }
+
+    /** How much memory the levels take up for each hour of each channel of audio. */
+    double getBytesPerChannelHour() const
+    {
+        const double channelHours = numChannels * getTotalLength() / 3600.0;
+        return channelHours > 0 ? getNumBytesUsed() / channelHours : 0.0;
+    }
+
+    /** The furthest that any stored min or max value is from what was read from the
+        source, as a sample value. Multiply it by half a channel's height in pixels
+        to get the most that the drawn waveform can be out by.
+    */
+    float getMaxStorageError() const noexcept               { return storageError; }
+
+    int getNumLevels() const noexcept                       { return levels.size(); }
+    int getSamplesPerPoint (int levelIndex) const noexcept  { return levels.getUnchecked (levelIndex)->samplesPerPoint; }
+
+    /** Returns the index of the coarsest level that still has at least one point
+        for every samplesPerPixel source samples, or the finest level if none do.
+    */
+    int getLevelIndexForDensity (double samplesPerPixel) const noexcept
+    {
+        for (int i = levels.size(); --i > 0;)
+            if (levels.getUnchecked (i)->samplesPerPoint <= samplesPerPixel)
+                return i;
+
+        return 0;
+    }
+
+    //==============================================================================
+    void drawChannel (Graphics& g, const Rectangle<int>& area,
+                      double startTimeSeconds, double endTimeSeconds,
+                      int channelNum, float verticalZoomFactor) override
+    {
+        const ScopedLock sl (lock);
+
+        if (isPositiveAndBelow (channelNum, numChannels))
+            drawLanes (g, area, startTimeSeconds, endTimeSeconds, verticalZoomFactor, channelNum, 1, 1);
+    }
+
+    void drawChannels (Graphics& g, const Rectangle<int>& area,
+                       double startTimeSeconds, double endTimeSeconds,
+                       float verticalZoomFactor) override
+    {
+        drawChannelGroups (g, area, startTimeSeconds, endTimeSeconds, verticalZoomFactor, 1);
+    }
+
+    /** Like drawChannels(), but with channelsPerLane neighbouring channels sharing
+        each lane, which shows the outline of all of them together. It's for sources
+        with too many channels to give each one a lane of its own, and costs the
+        same as drawing the channels separately, since every channel's points are
+        still looked at once per column.
+    */
+    void drawChannelGroups (Graphics& g, const Rectangle<int>& area,
+                            double startTimeSeconds, double endTimeSeconds,
+                            float verticalZoomFactor, int channelsPerLane)
+    {
+        const ScopedLock sl (lock);
+
+        if (numChannels > 0)
+            drawLanes (g, area, startTimeSeconds, endTimeSeconds, verticalZoomFactor,
+                       0, numChannels, jmax (1, channelsPerLane));
+    }
+
+    /** How many lanes drawChannelGroups() splits its area into. */
+    int getNumLanes (int channelsPerLane) const noexcept
+    {
+        channelsPerLane = jmax (1, channelsPerLane);
+        return (numChannels + channelsPerLane - 1) / channelsPerLane;
+    }
+
+    /** Returns the smallest power of two channels per lane that leaves every lane
+        at least minLaneHeight pixels high, or all the channels in one lane if
+        even that doesn't.
+    */
+    int getChannelsPerLaneToFit (int height, int minLaneHeight) const noexcept
+    {
+        int channelsPerLane = 1;
+
+        while (channelsPerLane < numChannels && height < getNumLanes (channelsPerLane) * minLaneHeight)
+            channelsPerLane *= 2;
+
+        return jmin (channelsPerLane, jmax (1, numChannels));
+    }
+
+    /** The part of an area that drawChannelGroups() gives to one of its lanes. */
+    static Rectangle<int> getLaneArea (const Rectangle<int>& area, int laneIndex, int numLanes) noexcept
+    {
+        const int y1 = roundToInt ((laneIndex * area.getHeight()) / (double) numLanes);
+        const int y2 = roundToInt (((laneIndex + 1) * area.getHeight()) / (double) numLanes);
+
+        return Rectangle<int> (area.getX(), area.getY() + y1, area.getWidth(), y2 - y1);
+    }
+
+    /** Draws each channel's RMS level as a band either side of its centre line, and
+        marks the columns that contain clipped samples with a strip along the top
+        and bottom edges of the channel. It's meant to go on top of drawChannels(),
+        with the same area and times, and draws nothing unless hasEnergy() is true.
+        To go on top of drawChannelGroups(), give it the same channelsPerLane.
+
+        Like drawChannels(), only the columns inside the clip region are worked out.
+    */
+    void drawEnergy (Graphics& g, const Rectangle<int>& area,
+                     double startTimeSeconds, double endTimeSeconds,
+                     float verticalZoomFactor, Colour rmsColour, Colour clipColour,
+                     int channelsPerLane = 1)
+    {
+        const ScopedLock sl (lock);
+
+        if (! hasEnergy() || area.isEmpty() || sampleRate <= 0 || endTimeSeconds <= startTimeSeconds)
+            return;
+
+        const Rectangle<int> clip (g.getClipBounds().getIntersection (area));
+
+        if (clip.isEmpty())
+            return;
+
+        const double startSample = startTimeSeconds * sampleRate;
+        const double samplesPerPixel = (endTimeSeconds - startTimeSeconds) * sampleRate / area.getWidth();
+        const ThumbnailLevel& level = *levels.getUnchecked (getLevelIndexForDensity (samplesPerPixel));
+
+        channelsPerLane = jmax (1, channelsPerLane);
+        const int numLanes = getNumLanes (channelsPerLane);
+
+        RectangleList<float> rms, clipped;
+        rms.ensureStorageAllocated (clip.getWidth() * numLanes);
+
+        for (int lane = 0; lane < numLanes; ++lane)
+        {
+            const Rectangle<int> laneArea (getLaneArea (area, lane, numLanes));
+
+            if (! laneArea.intersects (clip))
+                continue;
+
+            const int firstChannel = lane * channelsPerLane;
+            const int endChannel = jmin (numChannels, firstChannel + channelsPerLane);
+            const float topY    = (float) laneArea.getY();
+            const float bottomY = (float) laneArea.getBottom();
+            const float midY    = (topY + bottomY) * 0.5f;
+            const float vscale  = verticalZoomFactor * (bottomY - topY) * 0.5f;
+            const float markerHeight = jmax (2.0f, (bottomY - topY) / 16.0f);
+
+            for (int x = clip.getX() - area.getX(); x < clip.getRight() - area.getX(); ++x)
+            {
+                const int64 columnStart = (int64) (startSample + x * samplesPerPixel);
+                const int64 columnEnd   = jmax (columnStart + 1, (int64) (startSample + (x + 1) * samplesPerPixel));
+
+                // a lane's RMS is over all its channels' samples together
+                ThumbnailEnergy e (ThumbnailEnergy::empty());
+                int64 numSamples = 0;
+
+                for (int chan = firstChannel; chan < endChannel; ++chan)
+                {
+                    int64 numChannelSamples;
+                    e.add (level.getEnergy (chan, columnStart, columnEnd, totalSamples, numChannelSamples));
+                    numSamples += numChannelSamples;
+                }
+
+                if (numSamples <= 0)
+                    continue;
+
+                const float columnX = (float) (area.getX() + x);
+                const float halfHeight = jmin (midY - topY, std::sqrt (e.sumOfSquares / (float) numSamples) * vscale);
+
+                if (halfHeight > 0.0f)
+                    rms.addWithoutMerging (Rectangle<float> (columnX, midY - halfHeight, 1.0f, halfHeight * 2.0f));
+
+                if (e.numClipped > 0)
+                {
+                    clipped.addWithoutMerging (Rectangle<float> (columnX, topY, 1.0f, markerHeight));
+                    clipped.addWithoutMerging (Rectangle<float> (columnX, bottomY - markerHeight, 1.0f, markerHeight));
+                }
+            }
+        }
+
+        g.setColour (rmsColour);
+        g.fillRectList (rms);
+        g.setColour (clipColour);
+        g.fillRectList (clipped);
+    }
+
+    //==============================================================================
+    float getApproximatePeak() const override
+    {
+        const ScopedLock sl (lock);
+
+        if (levels.size() == 0 || numChannels == 0)
+            return 0.0f;
+
+        const ThumbnailLevel& coarsest = *levels.getLast();
+        float peak = 0.0f;
+
+        for (int chan = 0; chan < numChannels; ++chan)
+        {
+            const ThumbnailMinMax mm (coarsest.getMinMax (chan, 0, totalSamples));
+
+            if (! mm.isEmpty())
+                peak = jmax (peak, std::abs (mm.minValue), std::abs (mm.maxValue));
+        }
+
+        return jlimit (0.0f, 1.0f, peak);
+    }
+
+    void getApproximateMinMax (double startTime, double endTime, int channelIndex,
+                               float& minValue, float& maxValue) const noexcept override
+    {
+        const ScopedLock sl (lock);
+        minValue = maxValue = 0.0f;
+
+        if (sampleRate <= 0 || ! isPositiveAndBelow (channelIndex, numChannels))
+            return;
+
+        const int64 startSample = (int64) (startTime * sampleRate);
+        const int64 endSample   = (int64) (endTime * sampleRate);
+
+        // look at no more than a few thousand points, whatever the length of the range
+        const ThumbnailLevel& level = *levels.getUnchecked (getLevelIndexForDensity ((endSample - startSample) / 1024.0));
+        const ThumbnailMinMax mm (level.getMinMax (channelIndex, startSample, endSample));
+
+        if (! mm.isEmpty())
+        {
+            minValue = mm.minValue;
+            maxValue = mm.maxValue;
+        }
+    }
+
+    //==============================================================================
+    void reset (int newNumChannels, double newSampleRate, int64 totalSamplesInSource) override
+    {
+        {
+            const ScopedLock sl (lock);
+            setDataSize (newNumChannels, newSampleRate, totalSamplesInSource);
+        }
+
+        sendChangeMessage();
+    }
+
+    void addBlock (int64 sampleNumberInSource, const AudioSampleBuffer& newData,
+                   int startOffsetInBuffer, int numSamples) override
+    {
+        if (numSamples <= 0)
+            return;
+
+        const int64 endSample = sampleNumberInSource + numSamples;
+
+        {
+            const ScopedLock sl (lock);
+
+            if (endSample > totalSamples)
+            {
+                totalSamples = endSample;
+
+                for (int i = 0; i < levels.size(); ++i)
+                    levels.getUnchecked (i)->ensureSize (totalSamples);
+            }
+
+            mergeBlock (sampleNumberInSource, newData, startOffsetInBuffer, numSamples);
+            numSamplesFinished = jmax (numSamplesFinished, endSample);
+        }
+
+        sendChangeMessage();
+    }
+
+    /** Merges a run of finest-level points, numChannels per point as produced by
+        MinMaxKernels, into the thumbnail. The start sample must be on a point boundary.
+        The sums of squares and clip counts are only used if the thumbnail is
+        collecting energy, and can be left out otherwise.
+    */
+    void addPoints (int64 sampleNumberInSource, int numSamples, const Range<float>* points,
+                    const float* sumsOfSquares = nullptr, const uint32* numClipped = nullptr)
+    {
+        if (numSamples <= 0)
+            return;
+
+        {
+            const ScopedLock sl (lock);
+            mergePoints (sampleNumberInSource, numSamples, points, sumsOfSquares, numClipped);
+            numSamplesFinished = jmax (numSamplesFinished, sampleNumberInSource + numSamples);
+        }
+
+        sendChangeMessage();
+    }
+
+private:
+    //==============================================================================
+    enum
+    {
+        levelRatio = 4,
+        formatVersion = 3,
+        headerSize = 64,
+        /** How many samples a job reads at a time, across all its channels; that's
+            65536 frames of a stereo file, and fewer of a file with more channels, so
+            that a block's buffers stay the same size whatever the layout.
+        */
+        readBlockSamples = 2 * 65536,
+
+        /** Chunks are never made smaller than this many samples (across all the
+            channels, like readBlockSamples), so that short files aren't carved up
+            into more jobs than they're worth.
+        */
+        minSamplesPerChunk = 2 * 1024 * 1024,
+
+        /** How many chunks each pool thread gets, so that threads which finish
+            early have something else to pick up.
+        */
+        chunksPerThread = 4
+    };
+
+    AudioFormatManager& formatManager;
+    AudioThumbnailCache& cache;
+    ThreadPool& threadPool;
+    CriticalSection lock;
+
+    OwnedArray<ThumbnailLevel> levels;
+    int numChannels;
+    double sampleRate;
+    int64 totalSamples, numSamplesFinished, hashCode;
+
+    ScopedPointer<MemoryMappedFile> mappedFile;
+    ScopedPointer<InputSource> source;
+    MemoryMappedAudioFormatReader* sharedReader;
+    File rawSourceFile;
+    bool isFollowingGrowth;
+    Atomic<int> numChunksRemaining, generating, numChunkJobs;
+    bool collectsEnergy;
+
+    CompactMinMaxChannel::Format storageFormat;
+    bool compressSilentRuns;
+    float storageError;
+
+    /** A hash of each getFramesPerHashBlock() frames of a raw source, and while an
+        earlier version is being updated, the hashes that its thumbnail was saved
+        with, for the chunk jobs to compare against.
+    */
+    Array<uint64> blockHashes, previousBlockHashes;
+    int numBlocksReused;
+
+    double readStartTime;
+    int64 numBytesToRead;
+
+    //==============================================================================
+    /** Draws channels [firstChannel, firstChannel + numChannelsToDraw) in lanes of
+        channelsPerLane, merging each lane's channels into one outline. Only the
+        columns inside the clip region are worked out, so repainting a narrow strip,
+        such as the area around a moving playhead, costs very little. The lock must
+        be held.
+    */
+    void drawLanes (Graphics& g, const Rectangle<int>& area,
+                    double startTimeSeconds, double endTimeSeconds, float verticalZoomFactor,
+                    int firstChannel, int numChannelsToDraw, int channelsPerLane)
+    {
+        if (area.isEmpty() || sampleRate <= 0 || endTimeSeconds <= startTimeSeconds)
+            return;
+
+        const Rectangle<int> clip (g.getClipBounds().getIntersection (area));
+
+        if (clip.isEmpty())
+            return;
+
+        const double startSample = startTimeSeconds * sampleRate;
+        const double samplesPerPixel = (endTimeSeconds - startTimeSeconds) * sampleRate / area.getWidth();
+        const ThumbnailLevel& level = *levels.getUnchecked (getLevelIndexForDensity (samplesPerPixel));
+        const int numLanes = (numChannelsToDraw + channelsPerLane - 1) / channelsPerLane;
+
+        RectangleList<float> waveform;
+        waveform.ensureStorageAllocated (clip.getWidth() * numLanes);
+
+        for (int lane = 0; lane < numLanes; ++lane)
+        {
+            const Rectangle<int> laneArea (getLaneArea (area, lane, numLanes));
+
+            if (! laneArea.intersects (clip))
+                continue;
+
+            const int laneStart = firstChannel + lane * channelsPerLane;
+            const int laneEnd = jmin (firstChannel + numChannelsToDraw, laneStart + channelsPerLane);
+            const float topY    = (float) laneArea.getY();
+            const float bottomY = (float) laneArea.getBottom();
+            const float midY    = (topY + bottomY) * 0.5f;
+            const float vscale  = verticalZoomFactor * (bottomY - topY) * 0.5f;
+
+            for (int x = clip.getX() - area.getX(); x < clip.getRight() - area.getX(); ++x)
+            {
+                const int64 columnStart = (int64) (startSample + x * samplesPerPixel);
+                const int64 columnEnd   = jmax (columnStart + 1, (int64) (startSample + (x + 1) * samplesPerPixel));
+                ThumbnailMinMax mm (ThumbnailMinMax::empty());
+
+                for (int chan = laneStart; chan < laneEnd; ++chan)
+                    mm.merge (level.getMinMax (chan, columnStart, columnEnd));
+
+                if (! mm.isEmpty())
+                {
+                    const float top    = jlimit (topY, bottomY, midY - mm.maxValue * vscale);
+                    const float bottom = jlimit (topY, bottomY, midY - mm.minValue * vscale);
+
+                    waveform.addWithoutMerging (Rectangle<float> ((float) (area.getX() + x), top, 1.0f, bottom - top));
+                }
+            }
+        }
+
+        g.fillRectList (waveform);
+    }
+
+    //==============================================================================
+    void setDataSize (int newNumChannels, double newSampleRate, int64 newTotalSamples)
+    {
+        numChannels = newNumChannels;
+        sampleRate = newSampleRate;
+        totalSamples = newTotalSamples;
+        numSamplesFinished = 0;
+        storageError = 0.0f;
+        blockHashes.clearQuick();
+        previousBlockHashes.clearQuick();
+
+        for (int i = 0; i < levels.size(); ++i)
+            levels.getUnchecked (i)->setSize (numChannels, totalSamples, collectsEnergy);
+
+        mappedFile = nullptr;
+    }
+
+    /** Packs every level into the chosen storage; the lock must be held. Levels
+        that were read from a mapped cache file stop using it, so it's released.
+    */
+    void applyStorage()
+    {
+        storageError = 0.0f;
+
+        if (storageFormat == CompactMinMaxChannel::floatFormat && ! compressSilentRuns)
+        {
+            for (int i = 0; i < levels.size(); ++i)
+                levels.getUnchecked (i)->expand();
+
+            return;
+        }
+
+
+        for (int i = 0; i < levels.size(); ++i)
+            storageError = jmax (storageError, levels.getUnchecked (i)->compact (storageFormat, compressSilentRuns));
+
+        mappedFile = nullptr;
+
+        DBG ("Thumbnail stored in " << String (getBytesPerChannelHour() / 1024.0, 1)
+              << " KB per channel-hour, largest error " << String (storageError, 5));
+    }
+
+    /** Reads the fixed-size header that saveTo() writes before the level data. */
+    bool readHeader (InputStream& input, int& newNumChannels, double& newSampleRate,
+                     int64& newTotalSamples, int64& newNumFinished, bool& newHasEnergy,
+                     int& newFramesPerHashBlock, int& newNumBlockHashes) const
+    {
+        char magic[4];
+
+        if (input.read (magic, 4) != 4 || memcmp (magic, "jmrt", 4) != 0
+             || input.readInt() != formatVersion)
+            return false;
+
+        newNumChannels  = input.readInt();
+        newSampleRate   = input.readDouble();
+        newTotalSamples = input.readInt64();
+        newNumFinished  = input.readInt64();
+
+        const int savedNumLevels = input.readInt();
+        const int savedSamplesPerPoint = input.readInt();
+        const bool layoutMatches = savedNumLevels == levels.size()
+                                    && savedSamplesPerPoint == levels.getUnchecked (0)->samplesPerPoint;
+
+        newHasEnergy = input.readInt() != 0;
+        newFramesPerHashBlock = input.readInt();
+        newNumBlockHashes = input.readInt();
+        input.readInt64();  // padding
+
+        return layoutMatches && newNumChannels > 0 && newTotalSamples >= 0 && newNumBlockHashes >= 0;
+    }
+
+    /** Reads the block hashes that saveTo() writes after the levels, once the rest
+        has been loaded. Hashes made with a different block size, e.g. by a build
+        that read more at a time, can't be compared, so they're dropped.
+    */
+    void readBlockHashes (InputStream& input, int savedFramesPerHashBlock, int numSavedBlockHashes)
+    {
+        blockHashes.clearQuick();
+
+        if (numSavedBlockHashes == 0 || savedFramesPerHashBlock != getFramesPerHashBlock()
+             || numSavedBlockHashes != getNumHashBlocks())
+            return;
+
+        blockHashes.ensureStorageAllocated (numSavedBlockHashes);
+
+        for (int i = 0; i < numSavedBlockHashes; ++i)
+            blockHashes.add ((uint64) input.readInt64());
+    }
+
+    /** The number of points in all the levels together, for each channel. */
+    size_t getNumPointsPerChannel() const noexcept
+    {
+        size_t total = 0;
+
+        for (int i = 0; i < levels.size(); ++i)
+            total += (size_t) levels.getUnchecked (i)->getNumPoints();
+
+        return total;
+    }
+
+    /** Merges a block of samples into the finest level and refreshes the levels above it.
+        The lock must be held, and the levels must already cover the block.
+    */
+    void mergeBlock (int64 sampleNumberInSource, const AudioSampleBuffer& newData,
+                     int startOffsetInBuffer, int numSamples)
+    {
+        const int64 endSample = sampleNumberInSource + numSamples;
+        ThumbnailLevel& finest = *levels.getUnchecked (0);
+        const int samplesPerPoint = finest.samplesPerPoint;
+
+        for (int chan = jmin (numChannels, newData.getNumChannels()); --chan >= 0;)
+        {
+            const float* const samples = newData.getReadPointer (chan, startOffsetInBuffer);
+            ThumbnailMinMax* const points = finest.getWritableChannelData (chan);
+            ThumbnailEnergy* const energy = finest.hasEnergy() ? finest.getWritableEnergyData (chan) : nullptr;
+
+            for (int64 pos = sampleNumberInSource; pos < endSample;)
+            {
+                const int64 pointIndex = pos / samplesPerPoint;
+                const int64 pointEnd = jmin (endSample, (pointIndex + 1) * samplesPerPoint);
+                const float* const blockStart = samples + (pos - sampleNumberInSource);
+
+                ThumbnailMinMax block;
+                FloatVectorOperations::findMinAndMax (blockStart, (int) (pointEnd - pos),
+                                                      block.minValue, block.maxValue);
+                points[pointIndex].merge (block);
+
+                // the block's just been read, so this is a second look at cached data
+                if (energy != nullptr)
+                    energy[pointIndex].add (ThumbnailEnergy::measure (blockStart, (int) (pointEnd - pos)));
+
+                pos = pointEnd;
+            }
+        }
+
+        updateCoarserLevels (sampleNumberInSource, endSample);
+    }
+
+    /** The addPoints() counterpart of mergeBlock(); the lock must be held. */
+    void mergePoints (int64 sampleNumberInSource, int numSamples, const Range<float>* points,
+                      const float* sumsOfSquares, const uint32* numClipped)
+    {
+        ThumbnailLevel& finest = *levels.getUnchecked (0);
+        const int samplesPerPoint = finest.samplesPerPoint;
+        jassert (sampleNumberInSource % samplesPerPoint == 0);
+
+        const int firstPoint = (int) (sampleNumberInSource / samplesPerPoint);
+        const int numPoints = jmin (finest.getNumPoints() - firstPoint,
+                                    (numSamples + samplesPerPoint - 1) / samplesPerPoint);
+
+        for (int chan = 0; chan < numChannels; ++chan)
+        {
+            ThumbnailMinMax* const dest = finest.getWritableChannelData (chan) + firstPoint;
+
+            for (int i = 0; i < numPoints; ++i)
+            {
+                const Range<float>& r = points[i * numChannels + chan];
+                const ThumbnailMinMax mm = { r.getStart(), r.getEnd() };
+                dest[i].merge (mm);
+            }
+
+            if (sumsOfSquares != nullptr && finest.hasEnergy())
+            {
+                ThumbnailEnergy* const energy = finest.getWritableEnergyData (chan) + firstPoint;
+
+                for (int i = 0; i < numPoints; ++i)
+                {
+                    const ThumbnailEnergy e = { sumsOfSquares[i * numChannels + chan], numClipped[i * numChannels + chan] };
+                    energy[i].add (e);
+                }
+            }
+        }
+
+        updateCoarserLevels (sampleNumberInSource, sampleNumberInSource + numSamples);
+    }
+
+    /** Re-folds every level above the finest from the one below it, for just the
+        points that cover the given range of source samples.
+    */
+    void updateCoarserLevels (int64 startSample, int64 endSample)
+    {
+        for (int i = 1; i < levels.size(); ++i)
+        {
+            const ThumbnailLevel& finer = *levels.getUnchecked (i - 1);
+            ThumbnailLevel& coarser = *levels.getUnchecked (i);
+
+            const int firstPoint = (int) (startSample / coarser.samplesPerPoint);
+            const int endPoint   = (int) jmin ((int64) coarser.getNumPoints(),
+                                               (endSample + coarser.samplesPerPoint - 1) / coarser.samplesPerPoint);
+
+            for (int chan = 0; chan < numChannels; ++chan)
+            {
+                const ThumbnailMinMax* const src = finer.getChannelData (chan);
+                ThumbnailMinMax* const dest = coarser.getWritableChannelData (chan);
+
+                for (int p = firstPoint; p < endPoint; ++p)
+                {
+                    ThumbnailMinMax mm (ThumbnailMinMax::empty());
+
+                    for (int j = p * levelRatio, end = jmin (j + (int) levelRatio, finer.getNumPoints()); j < end; ++j)
+                        mm.merge (src[j]);
+
+                    dest[p] = mm;
+                }
+
+                if (coarser.hasEnergy())
+                {
+                    const ThumbnailEnergy* const srcEnergy = finer.getEnergyData (chan);
+                    ThumbnailEnergy* const destEnergy = coarser.getWritableEnergyData (chan);
+
+                    for (int p = firstPoint; p < endPoint; ++p)
+                    {
+                        ThumbnailEnergy e (ThumbnailEnergy::empty());
+
+                        for (int j = p * levelRatio, end = jmin (j + (int) levelRatio, finer.getNumPoints()); j < end; ++j)
+                            e.add (srcEnergy[j]);
+
+                        destEnergy[p] = e;
+                    }
+                }
+            }
+        }
+    }
+
+    //==============================================================================
+    /** Reads one chunk of the source and merges it into the thumbnail, a block at a
+        time so that the pool can stop it between blocks.
+    */
+    class ChunkJob  : public ThreadPoolJob
+    {
+    public:
+        ChunkJob (MultiResolutionThumbnail& ownerToUse, int64 start, int64 end, AudioFormatReader* readerToOwn)
+            : ThreadPoolJob ("Thumbnail chunk"), owner (ownerToUse),
+              nextSample (start), endSample (end), ownedReader (readerToOwn), reader (readerToOwn),
+              withEnergy (ownerToUse.levels.getUnchecked (0)->hasEnergy())
+        {
+            ++owner.numChunkJobs;
+        }
+
+        ~ChunkJob()
+        {
+            // stopReading() waits for this, so the owner's still there
+            if (--owner.numChunkJobs == 0)
+                owner.sendChangeMessage();
+        }
+
+        JobStatus runJob() override
+        {
+            // stopped without waiting, so the chunk is abandoned
+            if (shouldExit())
+                return jobHasFinished;
+
+            if (nextSample >= endSample || (reader == nullptr && rawReader == nullptr && ! openReader()))
+                return finished();
+
+            const int64 startSample = nextSample;
+
+            if (rawReader != nullptr)
+            {
+                // a hash block at a time, so that every block starts on a point boundary
+                // and has a hash of its own
+                const int samplesPerPoint = owner.levels.getUnchecked (0)->samplesPerPoint;
+                const int blockSize = owner.getFramesPerHashBlock();
+                const int numToRead = (int) jmin ((int64) blockSize, endSample - startSample);
+                const int blockIndex = (int) (startSample / blockSize);
+
+                // the arrays don't change size while the jobs are running
+                const bool isHashing = blockIndex < owner.blockHashes.size();
+                uint64 hash = 0;
+
+                if (isHashing && ! rawReader->hashFrames (startSample, numToRead, hash))
+                    return finished();
+
+                const bool isUnchanged = isHashing && blockIndex < owner.previousBlockHashes.size()
+                                          && owner.previousBlockHashes.getUnchecked (blockIndex) == hash;
+
+                if (! isUnchanged)
+                {
+                    const size_t numResults = (size_t) (((numToRead + samplesPerPoint - 1) / samplesPerPoint) * rawReader->numChannels);
+                    points.malloc (numResults);
+
+                    if (withEnergy)
+                    {
+                        sumsOfSquares.malloc (numResults);
+                        numClipped.malloc (numResults);
+                    }
+
+                    if (! rawReader->reduce (startSample, numToRead, samplesPerPoint, points, sumsOfSquares, numClipped))
+                        return finished();
+                }
+
+                {
+                    const ScopedLock sl (owner.lock);
+
+                    if (isUnchanged)
+                    {
+                        ++owner.numBlocksReused;
+                    }
+                    else
+                    {
+                        // an earlier version's points would be merged with, so they go first
+                        if (owner.previousBlockHashes.size() > 0)
+                            owner.levels.getUnchecked (0)->clearPoints (startSample, startSample + numToRead);
+
+                        owner.mergePoints (startSample, numToRead, points, sumsOfSquares, numClipped);
+                    }
+
+                    if (isHashing)
+                        owner.blockHashes.set (blockIndex, hash);
+
+                    owner.numSamplesFinished += numToRead;
+                }
+
+                nextSample += numToRead;
+            }
+            else
+            {
+                const int numToRead = (int) jmin ((int64) owner.getFramesPerBlock(), endSample - startSample);
+                const int numChannels = (int) reader->numChannels;
+
+                buffer.setSize (numChannels, numToRead, false, false, true);
+
+                // the AudioSampleBuffer version of read() doesn't say whether it worked,
+                // so this one's used; integer formats are converted in place
+                float** const channels = buffer.getArrayOfWritePointers();
+
+                if (! reader->read (reinterpret_cast<int* const*> (channels), numChannels, startSample, numToRead, false))
+                    return finished();
+
+                if (! reader->usesFloatingPointData)
+                    for (int chan = 0; chan < numChannels; ++chan)
+                        FloatVectorOperations::convertFixedToFloat (channels[chan], reinterpret_cast<const int*> (channels[chan]),
+                                                                    1.0f / 0x7fffffff, numToRead);
+
+                {
+                    const ScopedLock sl (owner.lock);
+                    owner.mergeBlock (startSample, buffer, 0, numToRead);
+                    owner.numSamplesFinished += numToRead;
+                }
+
+                nextSample += numToRead;
+            }
+
+            owner.sendChangeMessage();
+
+            return nextSample < endSample ? jobNeedsRunningAgain : finished();
+        }
+
+        MultiResolutionThumbnail& owner;
+
+    private:
+        int64 nextSample;
+        const int64 endSample;
+        ScopedPointer<AudioFormatReader> ownedReader;
+        AudioFormatReader* reader;
+        ScopedPointer<RawPcmReader> rawReader;
+        AudioSampleBuffer buffer;
+        HeapBlock<Range<float> > points;
+        const bool withEnergy;
+        HeapBlock<float> sumsOfSquares;
+        HeapBlock<uint32> numClipped;
+
+        bool openReader()
+        {
+            if (owner.rawSourceFile != File())
+                rawReader = RawPcmReader::createFor (owner.rawSourceFile, owner.isFollowingGrowth);
+            else if (owner.sharedReader != nullptr)
+                reader = owner.sharedReader;
+            else if (InputStream* stream = owner.source->createInputStream())
+                reader = ownedReader = owner.formatManager.createReaderFor (stream);
+
+            return reader != nullptr || rawReader != nullptr;
+        }
+
+        JobStatus finished()
+        {
+            ownedReader = nullptr;
+            reader = nullptr;
+            rawReader = nullptr;
+            owner.chunkFinished();
+            return jobHasFinished;
+        }
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ChunkJob)
+    };
+
+    struct ChunkJobSelector  : public ThreadPool::JobSelector
+    {
+        ChunkJobSelector (MultiResolutionThumbnail& t) : thumbnail (t) {}
+
+        bool isJobSuitable (ThreadPoolJob* job) override
+        {
+            ChunkJob* const chunkJob = dynamic_cast<ChunkJob*> (job);
+            return chunkJob != nullptr && &(chunkJob->owner) == &thumbnail;
+        }
+
+        MultiResolutionThumbnail& thumbnail;
+    };
+
+    //==============================================================================
+    bool startReading (InputSource* newSource, AudioFormatReader* newReader,
+                       MemoryMappedAudioFormatReader* newSharedReader, int64 newHashCode,
+                       int64 previousVersionHashCode)
+    {
+        ScopedPointer<InputSource> sourceHolder (newSource);
+        ScopedPointer<AudioFormatReader> readerHolder (newReader);
+
+        readStartTime = Time::getMillisecondCounterHiRes();
+
+        if (cache.loadThumb (*this, newHashCode) && numChannels > 0 && isFullyLoaded())
+        {
+            DBG ("Thumbnail loaded from cache in "
+                  << String (Time::getMillisecondCounterHiRes() - readStartTime, 3) << " ms");
+
+            const ScopedLock sl (lock);
+            hashCode = newHashCode;
+            applyStorage();
+            return true;
+        }
+
+        // this first reader is only used to find the layout of the source; the
+        // chunk jobs each open their own
+        ScopedPointer<RawPcmReader> rawReader;
+
+        if (newSharedReader != nullptr)
+        {
+            // the kernels are still quicker than the reader for the WAV layouts they
+            // handle, and their mapping of the file shares its pages with the reader's
+            rawReader = RawPcmReader::createFor (newSharedReader->getFile());
+        }
+        else if (readerHolder == nullptr && sourceHolder != nullptr)
+        {
+            if (InputStream* stream = sourceHolder->createInputStream())
+            {
+                // a plain WAV file can be reduced straight from its mapped sample data
+                if (FileInputStream* fileStream = dynamic_cast<FileInputStream*> (stream))
+                    rawReader = RawPcmReader::createFor (fileStream->getFile());
+
+                if (rawReader != nullptr)
+                    delete stream;
+                else
+                    readerHolder = formatManager.createReaderFor (stream);
+            }
+        }
+
+        numBlocksReused = 0;
+
+        if (rawReader != nullptr)
+        {
+            if (! loadPreviousVersion (*rawReader, previousVersionHashCode))
+            {
+                reset (rawReader->numChannels, rawReader->sampleRate, rawReader->lengthInSamples);
+
+                const ScopedLock sl (lock);
+                blockHashes.insertMultiple (0, 0, getNumHashBlocks());
+            }
+
+            numBytesToRead = rawReader->getDataLength();
+        }
+        else if (AudioFormatReader* r = (newSharedReader != nullptr ? newSharedReader : readerHolder.get()))
+        {
+            reset ((int) r->numChannels, r->sampleRate, r->lengthInSamples);
+            numBytesToRead = r->lengthInSamples * r->numChannels * (r->bitsPerSample / 8);
+        }
+        else
+        {
+            return false;
+        }
+
+        // a reader that was handed in can't be duplicated, so it gets one chunk to itself
+        const int64 chunkSize = (newReader != nullptr) ? jmax ((int64) 1, totalSamples)
+                                                       : getChunkSize();
+        const int numChunks = (int) jmax ((int64) 1, (totalSamples + chunkSize - 1) / chunkSize);
+
+        {
+            const ScopedLock sl (lock);
+            hashCode = newHashCode;
+            source = sourceHolder.release();
+            sharedReader = (rawReader == nullptr) ? newSharedReader : nullptr;
+            rawSourceFile = rawReader != nullptr ? rawReader->file : File();
+            numChunksRemaining = numChunks;
+            generating = 1;
+        }
+
+        for (int i = 0; i < numChunks; ++i)
+            threadPool.addJob (new ChunkJob (*this, i * chunkSize, jmin (totalSamples, (i + 1) * chunkSize),
+                                             i == 0 ? readerHolder.release() : nullptr), true);
+
+        return true;
+    }
+
+    /** Loads the thumbnail of an earlier version of a file to be updated, keeping
+        its block hashes for the chunk jobs to check the new version's against.
+
+        That can only be done if it was saved with block hashes and the file's layout
+        and length haven't changed, as the points of every block that matches stay
+        where they are. Returns false if it can't be used, in which case the
+        thumbnail needs resetting.
+    */
+    bool loadPreviousVersion (const RawPcmReader& rawReader, int64 previousVersionHashCode)
+    {
+        if (previousVersionHashCode == 0 || ! cache.loadThumb (*this, previousVersionHashCode))
+            return false;
+
+        const ScopedLock sl (lock);
+
+        if (! (isFullyLoaded() && blockHashes.size() > 0
+                && numChannels == rawReader.numChannels
+                && sampleRate == rawReader.sampleRate
+                && totalSamples == rawReader.lengthInSamples))
+            return false;
+
+        previousBlockHashes.swapWith (blockHashes);
+        blockHashes.insertMultiple (0, 0, previousBlockHashes.size());
+        numSamplesFinished = 0;
+
+        DBG ("Updating the thumbnail of an earlier version of " << rawReader.file.getFileName());
+        return true;
+    }
+
+    void stopReading()
+    {
+        ChunkJobSelector selector (*this);
+        threadPool.removeAllJobs (true, -1, &selector);
+
+        // a job that's been taken out of the pool may still be on its way to being deleted
+        while (numChunkJobs.get() > 0)
+            Thread::yield();
+
+        numChunksRemaining = 0;
+        generating = 0;
+
+        source = nullptr;
+        sharedReader = nullptr;
+        rawSourceFile = File();
+        isFollowingGrowth = false;
+    }
+
+    /** Splits the source into a few chunks per pool thread, each a whole number of
+        hash blocks long so that the kernels can start every chunk on a point
+        boundary, and every block hashes the same frames however it's chunked.
+    */
+    int getFramesPerBlock() const noexcept
+    {
+        return readBlockSamples / jmax (2, numChannels);
+    }
+
+    /** getFramesPerBlock() rounded down to whole points, which the kernels read at
+        a time and which each block hash covers.
+    */
+    int getFramesPerHashBlock() const noexcept
+    {
+        const int samplesPerPoint = levels.getUnchecked (0)->samplesPerPoint;
+        return jmax (1, getFramesPerBlock() / samplesPerPoint) * samplesPerPoint;
+    }
+
+    int getNumHashBlocks() const noexcept
+    {
+        const int64 blockSize = getFramesPerHashBlock();
+        return (int) ((totalSamples + blockSize - 1) / blockSize);
+    }
+
+    int64 getChunkSize() const noexcept
+    {
+        const int64 blockSize = getFramesPerHashBlock();
+        const int64 numJobs = jmax (1, threadPool.getNumThreads() * (int) chunksPerThread);
+        const int64 minChunkSize = minSamplesPerChunk / jmax (2, numChannels);
+        const int64 chunkSize = jmax (minChunkSize, (totalSamples + numJobs - 1) / numJobs);
+
+        return ((chunkSize + blockSize - 1) / blockSize) * blockSize;
+    }
+
+    /** Called by each job when its chunk is done. The last one stores the result,
+        and packs the levels under the same lock as the one that setStorage() takes,
+        so that a new storage format can't slip in between.
+    */
+    void chunkFinished()
+    {
+        if (--numChunksRemaining > 0)
+            return;
+
+        const bool shouldStore = isFullyLoaded() && ! isFollowingGrowth;
+
+       #if JUCE_DEBUG
+        if (isFullyLoaded())
+        {
+            const double seconds = (Time::getMillisecondCounterHiRes() - readStartTime) / 1000.0;
+
+            DBG ("Thumbnail built in " << String (seconds * 1000.0, 1) << " ms, "
+                  << String (numBytesToRead / (1024.0 * 1024.0 * jmax (seconds, 0.001)), 1) << " MB/s ("
+                  << (rawSourceFile != File() ? MinMaxKernels::getInstructionSetName() + " kernels" : String ("reader"))
+                  << ", " << threadPool.getNumThreads() << " threads)");
+
+            if (previousBlockHashes.size() > 0)
+                DBG ("  " << numBlocksReused << " of " << previousBlockHashes.size()
+                      << " blocks were unchanged from the earlier version");
+        }
+       #endif
+
+        if (shouldStore)
+            cache.storeThumb (*this, hashCode);
+
+        {
+            const ScopedLock sl (lock);
+
+            if (shouldStore)
+                applyStorage();
+
+            generating = 0;
+        }
+
+        sendChangeMessage();
+    }
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MultiResolutionThumbnail)
+};
+
+#endif  // MULTIRESOLUTIONTHUMBNAIL_H_INCLUDED
@@ -0,0 +1,272 @@
+/*
+  ==============================================================================
+
+    RawPcmReader.h
+
+  ==============================================================================
+*/
+
+#ifndef RAWPCMREADER_H_INCLUDED
+#define RAWPCMREADER_H_INCLUDED
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "MinMaxKernels.h"
+
+//==============================================================================
+/**
+    Gives the min/max kernels direct access to the interleaved sample data of an
+    uncompressed WAV file.
+
+    Rather than decoding blocks into float buffers as an AudioFormatReader does,
+    this memory-maps the data chunk a window at a time and hands the raw bytes to
+    MinMaxKernels::reduceInterleaved(), so the samples are only ever touched in
+    their stored format.
+
+    Only the layouts that the kernels understand are accepted (16, 24 and 32-bit
+    integer and 32-bit float, little-endian, with no padding in the frames);
+    createFor() returns nullptr for anything else, and the caller should fall back
+    to a normal reader.
+*/
+class RawPcmReader
+{
+public:
+    /** Parses the header of a RIFF or RF64 WAVE file, returning nullptr if it isn't
+        one whose samples can be reduced directly.
+
+        If the file is still being written, pass true for isGrowing: the data chunk
+        is then taken to run to the end of the file, as recorders often don't fill
+        in its size until they've finished.
+    */
+    static RawPcmReader* createFor (const File& file, bool isGrowing = false)
+    {
+        FileInputStream in (file);
+
+        if (in.failedToOpen())
+            return nullptr;
+
+        const int riffType = in.readInt();
+        in.readInt();  // riff size
+        const int waveType = in.readInt();
+
+        if ((riffType != chunkName ("RIFF") && riffType != chunkName ("RF64")) || waveType != chunkName ("WAVE"))
+            return nullptr;
+
+        int formatTag = 0, numChannels = 0, bitsPerSample = 0, blockAlign = 0;
+        double sampleRate = 0;
+        int64 dataStart = 0, dataLength = 0, ds64DataLength = -1;
+
+        while (! in.isExhausted())
+        {
+            const int chunkType = in.readInt();
+            const int64 chunkLength = (int64) (uint32) in.readInt();
+            const int64 chunkEnd = in.getPosition() + chunkLength + (chunkLength & 1);
+
+            if (chunkType == chunkName ("fmt "))
+            {
+                formatTag     = (uint16) in.readShort();
+                numChannels   = (uint16) in.readShort();
+                sampleRate    = (double) (uint32) in.readInt();
+                in.readInt();  // bytes per second
+                blockAlign    = (uint16) in.readShort();
+                bitsPerSample = (uint16) in.readShort();
+
+                if (formatTag == waveFormatExtensible && chunkLength >= 40)
+                {
+                    in.skipNextBytes (8);  // extension size, valid bits, channel mask
+                    formatTag = (uint16) in.readShort();  // the first two bytes of the sub-format GUID
+                }
+            }
+            else if (chunkType == chunkName ("ds64"))
+            {
+                in.readInt64();  // riff size
+                ds64DataLength = in.readInt64();
+            }
+            else if (chunkType == chunkName ("data"))
+            {
+                dataStart = in.getPosition();
+                dataLength = (riffType == chunkName ("RF64") && ds64DataLength >= 0) ? ds64DataLength
+                                                                                   : chunkLength;
+                break;
+            }
+
+            in.setPosition (chunkEnd);
+        }
+
+        MinMaxKernels::SampleFormat format;
+
+        if (formatTag == waveFormatPcm && bitsPerSample == 16)           format = MinMaxKernels::int16Samples;
+        else if (formatTag == waveFormatPcm && bitsPerSample == 24)      format = MinMaxKernels::int24Samples;
+        else if (formatTag == waveFormatPcm && bitsPerSample == 32)      format = MinMaxKernels::int32Samples;
+        else if (formatTag == waveFormatFloat && bitsPerSample == 32)    format = MinMaxKernels::float32Samples;
+        else                                                             return nullptr;
+
+        if (dataStart <= 0 || numChannels <= 0 || sampleRate <= 0
+             || blockAlign != numChannels * MinMaxKernels::getBytesPerSample (format))
+            return nullptr;
+
+        // a file that's still being written, or was truncated, may claim more data than it has
+        dataLength = isGrowing ? file.getSize() - dataStart
+                               : jmin (dataLength, file.getSize() - dataStart);
+
+        return new RawPcmReader (file, format, numChannels, sampleRate, dataStart, dataLength / blockAlign);
+    }
+
+    //==============================================================================
+    /** Reduces numFrames frames from startFrame into min/max ranges, numChannels of
+        them for every framesPerPoint frames, as MinMaxKernels::reduceInterleaved() does,
+        along with the sums of squares and clip counts if those are asked for.
+
+        Returns false if that part of the file couldn't be mapped.
+    */
+    bool reduce (int64 startFrame, int numFrames, int framesPerPoint, Range<float>* results,
+                 float* sumsOfSquares = nullptr, uint32* numClipped = nullptr)
+    {
+        jassert (startFrame >= 0 && startFrame + numFrames <= lengthInSamples);
+
+        const int64 startByte = dataStart + startFrame * bytesPerFrame;
+        const int64 endByte   = startByte + numFrames * bytesPerFrame;
+
+        if (! mapWindowCovering (startByte, endByte))
+            return false;
+
+        const int64 offsetInMap = startByte - map->getRange().getStart();
+
+        MinMaxKernels::reduceInterleaved (addBytesToPointer (map->getData(), offsetInMap),
+                                          (size_t) (map->getSize() - offsetInMap),
+                                          format, numChannels, numFrames, framesPerPoint, results,
+                                          sumsOfSquares, numClipped);
+        return true;
+    }
+
+    /** Hashes the stored bytes of numFrames frames from startFrame, for telling
+        whether that part of the file has changed since it was last reduced.
+
+        This is a single pass over the mapped data that does far less work per byte
+        than reduce(), so checking a block costs a fraction of reducing it again.
+        Returns false if that part of the file couldn't be mapped.
+    */
+    bool hashFrames (int64 startFrame, int numFrames, uint64& result)
+    {
+        jassert (startFrame >= 0 && startFrame + numFrames <= lengthInSamples);
+
+        const int64 startByte = dataStart + startFrame * bytesPerFrame;
+        const int64 endByte   = startByte + numFrames * bytesPerFrame;
+
+        if (! mapWindowCovering (startByte, endByte))
+            return false;
+
+        result = hashBytes (addBytesToPointer (map->getData(), startByte - map->getRange().getStart()),
+                            (size_t) (endByte - startByte));
+        return true;
+    }
+
+    /** The number of bytes of sample data that a reduction of the whole file reads. */
+    int64 getDataLength() const noexcept        { return lengthInSamples * bytesPerFrame; }
+
+    const File file;
+    const MinMaxKernels::SampleFormat format;
+    const int numChannels;
+    const double sampleRate;
+    const int64 lengthInSamples;
+
+private:
+    //==============================================================================
+    enum
+    {
+        waveFormatPcm = 1,
+        waveFormatFloat = 3,
+        waveFormatExtensible = 0xfffe,
+
+        /** How much of the file is mapped at once. The kernels read a window
+            front-to-back, so a big window just means fewer calls to mmap.
+        */
+        mapWindowSize = 64 * 1024 * 1024,
+
+        /** Room past the requested bytes for the kernels' wide loads. */
+        mapOverhang = 64
+    };
+
+    const int64 dataStart, bytesPerFrame;
+    ScopedPointer<MemoryMappedFile> map;
+
+    RawPcmReader (const File& f, MinMaxKernels::SampleFormat sampleFormat, int channels,
+                  double rate, int64 dataStartInFile, int64 numFrames)
+        : file (f), format (sampleFormat), numChannels (channels), sampleRate (rate),
+          lengthInSamples (numFrames), dataStart (dataStartInFile),
+          bytesPerFrame (channels * MinMaxKernels::getBytesPerSample (sampleFormat))
+    {
+    }
+
+    static int chunkName (const char* name) noexcept     { return (int) ByteOrder::littleEndianInt (name); }
+
+    //==============================================================================
+    // A 64-bit hash in the style of xxHash64: four independent lanes of 8-byte
+    // words, so that their multiplies overlap, then the tail and a final mix.
+    static uint64 rotateLeft (uint64 x, int bits) noexcept      { return (x << bits) | (x >> (64 - bits)); }
+
+    static uint64 readWord (const uint8* p) noexcept
+    {
+        uint64 word;
+        memcpy (&word, p, sizeof (word));
+        return ByteOrder::swapIfBigEndian (word);
+    }
+
+    static uint64 mixLane (uint64 lane, uint64 word) noexcept
+    {
+        return rotateLeft (lane + word * hashPrime2, 31) * hashPrime1;
+    }
+
+    static uint64 hashBytes (const void* data, size_t numBytes) noexcept
+    {
+        const uint8* p = static_cast<const uint8*> (data);
+        const uint8* const end = p + numBytes;
+
+        uint64 lanes[4] = { hashPrime1 + hashPrime2, hashPrime2, 0, 0 - hashPrime1 };
+
+        for (; end - p >= 32; p += 32)
+            for (int i = 0; i < 4; ++i)
+                lanes[i] = mixLane (lanes[i], readWord (p + 8 * i));
+
+        uint64 h = (uint64) numBytes * hashPrime3;
+
+        for (int i = 0; i < 4; ++i)
+            h = rotateLeft (h ^ mixLane (0, lanes[i]), 27) * hashPrime1 + hashPrime2;
+
+        for (; end - p >= 8; p += 8)
+            h = rotateLeft (h ^ mixLane (0, readWord (p)), 27) * hashPrime1 + hashPrime2;
+
+        for (; p < end; ++p)
+            h = rotateLeft (h ^ (*p * hashPrime3), 11) * hashPrime1;
+
+        h ^= h >> 33;
+        h *= hashPrime2;
+        h ^= h >> 29;
+        h *= hashPrime3;
+        return h ^ (h >> 32);
+    }
+
+    static const uint64 hashPrime1 = 0x9e3779b185ebca87ULL;
+    static const uint64 hashPrime2 = 0xc2b2ae3d27d4eb4fULL;
+    static const uint64 hashPrime3 = 0x165667b19e3779f9ULL;
+
+    bool mapWindowCovering (int64 startByte, int64 endByte)
+    {
+        if (map != nullptr && map->getRange().contains (startByte) && map->getRange().getEnd() >= endByte)
+            return true;
+
+        const int64 windowEnd = jmin (dataStart + getDataLength() + mapOverhang,
+                                      jmax (endByte, startByte + (int64) mapWindowSize));
+
+        map = new MemoryMappedFile (file, Range<int64> (startByte, windowEnd), MemoryMappedFile::readOnly);
+
+        if (map->getData() != nullptr && map->getRange().getEnd() >= endByte)
+            return true;
+
+        map = nullptr;
+        return false;
+    }
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (RawPcmReader)
+};
+
+#endif  // RAWPCMREADER_H_INCLUDED
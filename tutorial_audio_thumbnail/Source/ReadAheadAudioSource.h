@@ -0,0 +1,385 @@
+/*
+  ==============================================================================
+
+    ReadAheadAudioSource.h
+
+  ==============================================================================
+*/
+
+#ifndef READAHEADAUDIOSOURCE_H_INCLUDED
+#define READAHEADAUDIOSOURCE_H_INCLUDED
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+/**
+    Reads a PositionableAudioSource ahead of the playback position on a
+    background TimeSliceThread, so that the audio callback only ever copies
+    from memory.
+
+    This works like JUCE's BufferingAudioSource, but sizes its buffer from the
+    device's block size and sample rate in prepareToPlay(), and keeps counters
+    that show whether it's keeping up: how often a block had to be padded with
+    silence because the data hadn't been read yet, how full the buffer is, and
+    whether the wrapped source has ever been read from anywhere other than the
+    background thread.
+
+    The lock shared with the background thread is only held while positions are
+    swapped, never while the source is being read.
+*/
+class ReadAheadAudioSource  : public PositionableAudioSource,
+                              private TimeSliceClient
+{
+public:
+    /** Creates a ReadAheadAudioSource.
+
+        @param sourceToRead             the source to read from
+        @param deleteSourceWhenDeleted  whether this object should take ownership of the source
+        @param readAheadThread          the thread that does the reading; it must already be running
+        @param numChannelsToBuffer      how many channels to keep, which should match the
+                                        number that the caller asks for
+        @param secondsToReadAhead       how far ahead of the playback position to keep the buffer filled
+    */
+    ReadAheadAudioSource (PositionableAudioSource* sourceToRead, bool deleteSourceWhenDeleted,
+                          TimeSliceThread& readAheadThread, int numChannelsToBuffer,
+                          double secondsToReadAhead = 1.0)
+        : source (sourceToRead, deleteSourceWhenDeleted),
+          backgroundThread (readAheadThread),
+          numChannels (numChannelsToBuffer),
+          readAheadSeconds (secondsToReadAhead),
+          bufferValidStart (0), bufferValidEnd (0), nextPlayPos (0),
+          sampleRate (0), isPrepared (false), refillingAfterSeek (false),
+          minSamplesBuffered (std::numeric_limits<int>::max())
+    {
+        jassert (source != nullptr);
+        jassert (numChannels > 0 && readAheadSeconds > 0);
+    }
+
+    ~ReadAheadAudioSource()
+    {
+        releaseResources();
+    }
+
+    //==============================================================================
+    /** Returns the buffer size used for a device with this block size and sample
+        rate: enough for the read-ahead time, rounded up to a whole number of
+        blocks, and never less than a few blocks however short the time is.
+    */
+    static int chooseBufferSize (int samplesPerBlockExpected, double sampleRate, double secondsToReadAhead)
+    {
+        const int blockSize = jmax (1, samplesPerBlockExpected);
+        const int numBlocks = (int) std::ceil (secondsToReadAhead * sampleRate / blockSize);
+
+        return jmax ((int) minBlocksAhead, numBlocks) * blockSize;
+    }
+
+    void prepareToPlay (int samplesPerBlockExpected, double newSampleRate) override
+    {
+        const int newBufferSize = chooseBufferSize (samplesPerBlockExpected, newSampleRate, readAheadSeconds);
+
+        if (newSampleRate != sampleRate || newBufferSize != buffer.getNumSamples() || ! isPrepared)
+        {
+            backgroundThread.removeTimeSliceClient (this);
+
+            isPrepared = true;
+            sampleRate = newSampleRate;
+
+            source->prepareToPlay (samplesPerBlockExpected, newSampleRate);
+            buffer.setSize (numChannels, newBufferSize);
+            buffer.clear();
+
+            {
+                const SpinLock::ScopedLockType sl (positionLock);
+                bufferValidStart = 0;
+                bufferValidEnd = 0;
+
+                // this doesn't wait for the thread to fill the buffer, so that it can be
+                // called on the message thread; any blocks played before then count as a stall
+                refillingAfterSeek = true;
+            }
+
+            backgroundThread.addTimeSliceClient (this);
+            backgroundThread.moveToFrontOfQueue (this);
+        }
+    }
+
+    void releaseResources() override
+    {
+        isPrepared = false;
+        backgroundThread.removeTimeSliceClient (this);
+
+        buffer.setSize (numChannels, 0);
+        source->releaseResources();
+    }
+
+    void getNextAudioBlock (const AudioSourceChannelInfo& info) override
+    {
+        const SpinLock::ScopedLockType sl (positionLock);
+
+        const int validStart = (int) (jlimit (bufferValidStart, bufferValidEnd, nextPlayPos) - nextPlayPos);
+        const int validEnd   = (int) (jlimit (bufferValidStart, bufferValidEnd, nextPlayPos + info.numSamples) - nextPlayPos);
+
+        if (validStart > 0)
+            info.buffer->clear (info.startSample, validStart);
+
+        if (validEnd < info.numSamples)
+            info.buffer->clear (info.startSample + validEnd, info.numSamples - validEnd);
+
+        if (validStart < validEnd)
+        {
+            const int bufferSize = buffer.getNumSamples();
+
+            for (int chan = numChannels; chan < info.buffer->getNumChannels(); ++chan)
+                info.buffer->clear (chan, info.startSample + validStart, validEnd - validStart);
+
+            for (int chan = jmin (numChannels, info.buffer->getNumChannels()); --chan >= 0;)
+            {
+                const int startIndex = (int) ((validStart + nextPlayPos) % bufferSize);
+                const int endIndex   = (int) ((validEnd   + nextPlayPos) % bufferSize);
+
+                if (startIndex < endIndex)
+                {
+                    info.buffer->copyFrom (chan, info.startSample + validStart, buffer, chan, startIndex, validEnd - validStart);
+                }
+                else
+                {
+                    const int initialSize = bufferSize - startIndex;
+
+                    info.buffer->copyFrom (chan, info.startSample + validStart, buffer, chan, startIndex, initialSize);
+                    info.buffer->copyFrom (chan, info.startSample + validStart + initialSize, buffer, chan, 0, (validEnd - validStart) - initialSize);
+                }
+            }
+        }
+
+        updateCounters (nextPlayPos >= bufferValidStart ? (int) jmax ((int64) 0, bufferValidEnd - nextPlayPos) : 0,
+                        validEnd - validStart, info.numSamples);
+        nextPlayPos += info.numSamples;
+    }
+
+    //==============================================================================
+    void setNextReadPosition (int64 newPosition) override
+    {
+        setNextReadPositionFromAudioThread (newPosition);
+        backgroundThread.moveToFrontOfQueue (this);
+    }
+
+    /** Moves the play position like setNextReadPosition(), but without waking the
+        read-ahead thread, as that takes a lock the audio thread mustn't wait on.
+        The thread notices within idleMilliseconds.
+    */
+    void setNextReadPositionFromAudioThread (int64 newPosition) noexcept
+    {
+        const SpinLock::ScopedLockType sl (positionLock);
+        nextPlayPos = newPosition;
+        refillingAfterSeek = ! (newPosition >= bufferValidStart && newPosition < bufferValidEnd);
+    }
+
+    int64 getNextReadPosition() const override
+    {
+        const int64 totalLength = source->getTotalLength();
+
+        return (source->isLooping() && nextPlayPos > 0 && totalLength > 0) ? nextPlayPos % totalLength
+                                                                           : nextPlayPos;
+    }
+
+    int64 getTotalLength() const override           { return source->getTotalLength(); }
+    bool isLooping() const override                 { return source->isLooping(); }
+    void setLooping (bool shouldLoop) override      { source->setLooping (shouldLoop); }
+
+    //==============================================================================
+    /** The number of samples that are currently read and waiting to be played. */
+    int getNumSamplesBuffered() const
+    {
+        const SpinLock::ScopedLockType sl (positionLock);
+        return (int) jmax ((int64) 0, bufferValidEnd - jmax (nextPlayPos, bufferValidStart));
+    }
+
+    /** The proportion of the buffer that's read and waiting to be played, from 0 to 1. */
+    float getFillLevel() const
+    {
+        const int bufferSize = buffer.getNumSamples();
+        return bufferSize > 0 ? getNumSamplesBuffered() / (float) bufferSize : 0.0f;
+    }
+
+    /** The size of the buffer chosen by the last prepareToPlay(), in samples. */
+    int getBufferSize() const noexcept                          { return buffer.getNumSamples(); }
+
+    /** The number of blocks that had to be padded with silence during playback,
+        because the thread hadn't read that far yet.
+    */
+    int getNumUnderruns() const noexcept                        { return numUnderruns.get(); }
+
+    /** The total number of samples that were replaced by silence in those blocks. */
+    int64 getNumSamplesMissed() const noexcept                  { return numSamplesMissed.get(); }
+
+    /** The number of blocks that were played silent while the buffer was filled
+        after prepareToPlay() or refilled after a jump to an unbuffered position.
+        These aren't counted as underruns.
+    */
+    int getNumSeekStalls() const noexcept                       { return numSeekStalls.get(); }
+
+    /** The lowest number of samples that were buffered at the start of a block,
+        not counting refills after a seek or the end of the source.
+    */
+    int getMinSamplesBuffered() const noexcept                  { return minSamplesBuffered.get(); }
+
+    /** The number of times the wrapped source was read from a thread other than the
+        read-ahead thread. Anything but zero means the audio callback may have waited
+        on the disk.
+    */
+    int getNumReadsOffBackgroundThread() const noexcept         { return numReadsOffBackgroundThread.get(); }
+
+    void resetCounters() noexcept
+    {
+        numUnderruns = 0;
+        numSamplesMissed = 0;
+        numSeekStalls = 0;
+        minSamplesBuffered = std::numeric_limits<int>::max();
+        numReadsOffBackgroundThread = 0;
+    }
+
+private:
+    //==============================================================================
+    enum
+    {
+        minBlocksAhead = 4,
+        maxChunkSize = 2048,
+        idleMilliseconds = 10   // how long the thread waits once the buffer's full
+    };
+
+    OptionalScopedPointer<PositionableAudioSource> source;
+    TimeSliceThread& backgroundThread;
+    const int numChannels;
+    const double readAheadSeconds;
+
+    AudioSampleBuffer buffer;
+    SpinLock positionLock;
+    int64 bufferValidStart, bufferValidEnd, nextPlayPos;
+    double sampleRate;
+    bool isPrepared, refillingAfterSeek;
+
+    Atomic<int> numUnderruns, numSeekStalls, minSamplesBuffered, numReadsOffBackgroundThread;
+    Atomic<int64> numSamplesMissed;
+
+    /** Called by getNextAudioBlock() with the position lock held, before the play
+        position moves on.
+    */
+    void updateCounters (int samplesAhead, int samplesCopied, int numSamples) noexcept
+    {
+        // running off the end of the source isn't an underrun
+        const int64 totalLength = source->getTotalLength();
+        const int numWanted = source->isLooping() ? numSamples
+                                                  : (int) jlimit ((int64) 0, (int64) numSamples, totalLength - nextPlayPos);
+
+        if (samplesCopied >= numWanted)
+        {
+            refillingAfterSeek = false;
+
+            if (numWanted == numSamples && samplesAhead < minSamplesBuffered.get())
+                minSamplesBuffered = samplesAhead;
+        }
+        else if (refillingAfterSeek)
+        {
+            ++numSeekStalls;
+        }
+        else
+        {
+            ++numUnderruns;
+            numSamplesMissed += numWanted - samplesCopied;
+            minSamplesBuffered = 0;
+        }
+    }
+
+    //==============================================================================
+    int useTimeSlice() override
+    {
+        return readNextBufferChunk() ? 1 : idleMilliseconds;
+    }
+
+    bool readNextBufferChunk()
+    {
+        int64 newBVS, newBVE, sectionToReadStart, sectionToReadEnd;
+
+        // Nothing past the end of the source is buffered unless it loops. The reader
+        // would only pad it with silence, which would then be played even if the
+        // source has grown by the time the play position gets there.
+        const int64 sourceEnd = source->isLooping() ? std::numeric_limits<int64>::max()
+                                                    : source->getTotalLength();
+
+        {
+            const SpinLock::ScopedLockType sl (positionLock);
+
+            newBVS = jmax ((int64) 0, nextPlayPos);
+            newBVE = jmin (newBVS + buffer.getNumSamples() - 4, jmax (newBVS, sourceEnd));
+            sectionToReadStart = 0;
+            sectionToReadEnd = 0;
+
+            if (newBVS < bufferValidStart || newBVS >= bufferValidEnd)
+            {
+                // the play position has jumped outside the buffer, so start again from there
+                newBVE = jmin (newBVE, newBVS + maxChunkSize);
+
+                sectionToReadStart = newBVS;
+                sectionToReadEnd = newBVE;
+
+                bufferValidStart = 0;
+                bufferValidEnd = 0;
+            }
+            else if (std::abs ((int) (newBVS - bufferValidStart)) > 512
+                      || std::abs ((int) (newBVE - bufferValidEnd)) > 512
+                      || (newBVE == sourceEnd && newBVE > bufferValidEnd))
+            {
+                newBVE = jmin (newBVE, bufferValidEnd + maxChunkSize);
+
+                sectionToReadStart = bufferValidEnd;
+                sectionToReadEnd = newBVE;
+
+                bufferValidStart = newBVS;
+                bufferValidEnd = jmin (bufferValidEnd, newBVE);
+            }
+        }
+
+        if (sectionToReadStart == sectionToReadEnd)
+            return false;
+
+        const int bufferSize = buffer.getNumSamples();
+        const int bufferIndexStart = (int) (sectionToReadStart % bufferSize);
+        const int bufferIndexEnd   = (int) (sectionToReadEnd % bufferSize);
+
+        if (bufferIndexStart < bufferIndexEnd)
+        {
+            readBufferSection (sectionToReadStart, (int) (sectionToReadEnd - sectionToReadStart), bufferIndexStart);
+        }
+        else
+        {
+            const int initialSize = bufferSize - bufferIndexStart;
+
+            readBufferSection (sectionToReadStart, initialSize, bufferIndexStart);
+            readBufferSection (sectionToReadStart + initialSize, (int) (sectionToReadEnd - sectionToReadStart) - initialSize, 0);
+        }
+
+        {
+            const SpinLock::ScopedLockType sl (positionLock);
+            bufferValidStart = newBVS;
+            bufferValidEnd = newBVE;
+        }
+
+        return true;
+    }
+
+    void readBufferSection (int64 start, int length, int bufferOffset)
+    {
+        if (Thread::getCurrentThreadId() != backgroundThread.getThreadId())
+            ++numReadsOffBackgroundThread;
+
+        if (source->getNextReadPosition() != start)
+            source->setNextReadPosition (start);
+
+        const AudioSourceChannelInfo info (&buffer, bufferOffset, length);
+        source->getNextAudioBlock (info);
+    }
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ReadAheadAudioSource)
+};
+
+#endif  // READAHEADAUDIOSOURCE_H_INCLUDED
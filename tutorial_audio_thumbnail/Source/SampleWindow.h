@@ -0,0 +1,241 @@
+/*
+  ==============================================================================
+
+    SampleWindow.h
+
+  ==============================================================================
+*/
+
+#ifndef SAMPLEWINDOW_H_INCLUDED
+#define SAMPLEWINDOW_H_INCLUDED
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "MultiResolutionThumbnail.h"
+
+//==============================================================================
+/**
+    Holds a short stretch of a source's samples in memory, for drawing a waveform
+    sample by sample once it's zoomed in further than a thumbnail's finest level.
+
+    The samples are read straight from a reader: either one that's shared, such as
+    the memory-mapped reader that playback uses, or one that this opens on the file
+    the first time it's needed. Each read takes a few times as much as was asked
+    for, centred on it, so that scrolling along at that zoom is drawn from memory
+    until the view gets near the edge of the window. Nothing longer than
+    maxWindowSamples is ever read, so reads are small enough for the message thread.
+*/
+class SampleWindow
+{
+public:
+    enum
+    {
+        minWindowSamples = 4096,
+        maxWindowSamples = 262144,
+        windowSizeMultiple = 3
+    };
+
+    SampleWindow (AudioFormatManager& formatManagerToUse)
+        : formatManager (formatManagerToUse),
+          reader (nullptr),
+          windowStart (0),
+          numSamplesInWindow (0)
+    {
+    }
+
+    //==============================================================================
+    /** Reads from a file, opening a reader on it when it's first needed. */
+    void setFile (const File& newFile)
+    {
+        clear();
+        file = newFile;
+    }
+
+    /** Reads from a reader that the caller keeps alive for as long as this uses it. */
+    void setSharedReader (AudioFormatReader* newReader)
+    {
+        clear();
+        reader = newReader;
+    }
+
+    void clear()
+    {
+        reader = nullptr;
+        ownedReader = nullptr;
+        file = File();
+        invalidate();
+    }
+
+    /** Forgets the samples that are held, e.g. because the file has been added to. */
+    void invalidate() noexcept
+    {
+        windowStart = 0;
+        numSamplesInWindow = 0;
+    }
+
+    /** Returns the source's sample rate, or 0 if there's nothing to read. */
+    double getSampleRate()
+    {
+        return getReader() != nullptr ? reader->sampleRate : 0.0;
+    }
+
+    //==============================================================================
+    /** Draws the samples in the given time range as a line through each channel's
+        lane, laid out the same way as MultiResolutionThumbnail::drawChannelGroups(),
+        with the channels that share a lane drawn over each other. When the samples
+        are far enough apart to pick out, each one gets a dot as well.
+
+        Only the part inside the clip region is drawn. Returns false, having drawn
+        nothing, if the range is too long to hold or the source can't be read, so
+        that the caller can fall back to the thumbnail.
+    */
+    bool drawChannels (Graphics& g, const Rectangle<int>& area,
+                       double startTimeSeconds, double endTimeSeconds, float verticalZoomFactor,
+                       int channelsPerLane = 1)
+    {
+        const Rectangle<int> clip (g.getClipBounds().getIntersection (area));
+
+        if (getReader() == nullptr || area.isEmpty() || endTimeSeconds <= startTimeSeconds)
+            return false;
+
+        if (clip.isEmpty())
+            return true;
+
+        const double rate = reader->sampleRate;
+        const double pixelsPerSample = area.getWidth() / ((endTimeSeconds - startTimeSeconds) * rate);
+        const double startSample = startTimeSeconds * rate;
+
+        // one sample beyond each edge, so that the line runs off the clip region
+        const int64 firstSample = jmax ((int64) 0, (int64) std::floor (startSample + (clip.getX() - area.getX()) / pixelsPerSample) - 1);
+        const int64 endSample = jmin (reader->lengthInSamples,
+                                      (int64) std::ceil (startSample + (clip.getRight() - area.getX()) / pixelsPerSample) + 2);
+
+        if (endSample <= firstSample)
+            return true;
+
+        if (! ensureCovers (firstSample, endSample))
+            return false;
+
+        const int numChannels = buffer.getNumChannels();
+        const bool drawDots = pixelsPerSample >= minPixelsPerSampleForDots;
+
+        channelsPerLane = jmax (1, channelsPerLane);
+        const int numLanes = (numChannels + channelsPerLane - 1) / channelsPerLane;
+
+        for (int chan = 0; chan < numChannels; ++chan)
+        {
+            const Rectangle<int> laneArea (MultiResolutionThumbnail::getLaneArea (area, chan / channelsPerLane, numLanes));
+
+            if (! laneArea.intersects (clip))
+                continue;
+
+            const float midY = (laneArea.getY() + laneArea.getBottom()) * 0.5f;
+            const float vscale = verticalZoomFactor * laneArea.getHeight() * 0.5f;
+
+            const float* const samples = buffer.getReadPointer (chan, (int) (firstSample - windowStart));
+            const int numSamples = (int) (endSample - firstSample);
+
+            Path line;
+            line.preallocateSpace (numSamples * 3);
+            RectangleList<float> dots;
+
+            for (int i = 0; i < numSamples; ++i)
+            {
+                const float x = (float) (area.getX() + (firstSample + i - startSample) * pixelsPerSample);
+                const float y = midY - jlimit (-1.0f, 1.0f, samples[i]) * vscale;
+
+                if (i == 0)
+                    line.startNewSubPath (x, y);
+                else
+                    line.lineTo (x, y);
+
+                if (drawDots)
+                    dots.addWithoutMerging (Rectangle<float> (x - dotSize * 0.5f, y - dotSize * 0.5f, (float) dotSize, (float) dotSize));
+            }
+
+            g.strokePath (line, PathStrokeType (1.0f));
+            g.fillRectList (dots);
+        }
+
+        return true;
+    }
+
+    //==============================================================================
+    /** Makes sure that the given samples are held, reading a window around them if
+        they aren't. Returns false if there are too many, or nothing to read from.
+    */
+    bool ensureCovers (int64 start, int64 end)
+    {
+        if (start >= windowStart && end <= windowStart + numSamplesInWindow)
+            return true;
+
+        if (getReader() == nullptr || end - start > maxWindowSamples)
+            return false;
+
+        const int64 length = jlimit ((int64) minWindowSamples, (int64) maxWindowSamples, (end - start) * windowSizeMultiple);
+        const int64 newStart = jmax ((int64) 0, start - (length - (end - start)) / 2);
+        const int numToRead = (int) jmin (length, reader->lengthInSamples - newStart);
+
+        if (numToRead <= 0)
+            return false;
+
+        const int numChannels = (int) reader->numChannels;
+        buffer.setSize (numChannels, numToRead, false, false, true);
+
+        // like AudioFormatReader::read (AudioSampleBuffer*...), but for every channel
+        // rather than the first two; integer formats are converted in place
+        float** const channels = buffer.getArrayOfWritePointers();
+
+        if (! reader->read (reinterpret_cast<int* const*> (channels), numChannels, newStart, numToRead, false))
+        {
+            invalidate();
+            return false;
+        }
+
+        if (! reader->usesFloatingPointData)
+            for (int chan = 0; chan < numChannels; ++chan)
+                FloatVectorOperations::convertFixedToFloat (channels[chan], reinterpret_cast<const int*> (channels[chan]),
+                                                            1.0f / 0x7fffffff, numToRead);
+
+        windowStart = newStart;
+        numSamplesInWindow = numToRead;
+        return true;
+    }
+
+    int64 getWindowStart() const noexcept           { return windowStart; }
+    int getNumSamplesInWindow() const noexcept      { return numSamplesInWindow; }
+
+private:
+    //==============================================================================
+    enum
+    {
+        minPixelsPerSampleForDots = 6,
+        dotSize = 3
+    };
+
+    AudioFormatManager& formatManager;
+    File file;
+    ScopedPointer<AudioFormatReader> ownedReader;
+    AudioFormatReader* reader;
+
+    AudioSampleBuffer buffer;
+    int64 windowStart;
+    int numSamplesInWindow;
+
+    AudioFormatReader* getReader()
+    {
+        if (reader == nullptr && file != File())
+        {
+            reader = ownedReader = formatManager.createReaderFor (file);
+
+            // don't keep trying a file that can't be read
+            if (reader == nullptr)
+                file = File();
+        }
+
+        return reader;
+    }
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SampleWindow)
+};
+
+#endif  // SAMPLEWINDOW_H_INCLUDED
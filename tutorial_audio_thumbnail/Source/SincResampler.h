@@ -0,0 +1,578 @@
+/*
+  ==============================================================================
+
+    SincResampler.h
+
+  ==============================================================================
+*/
+
+#ifndef SINCRESAMPLER_H_INCLUDED
+#define SINCRESAMPLER_H_INCLUDED
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+#if JUCE_INTEL
+ #include <immintrin.h>
+#endif
+
+//==============================================================================
+/**
+    The inner loops of SincResampler: one channel of output samples, each the dot
+    product of the history around its position with two neighbouring rows of the
+    polyphase table, blended by how far the position lies between them.
+
+    src[0] is the first tap of the first output sample, position is relative to
+    it, and the table has numPhases + 1 rows of numTaps coefficients. numTaps is
+    always a multiple of 8, so the vector loops need no tail.
+*/
+namespace SincResamplerScalar
+{
+    inline void resampleChannel (const float* src, float* dest, int numOutputSamples,
+                                 double position, double ratio,
+                                 const float* table, int numTaps, int numPhases) noexcept
+    {
+        for (int n = 0; n < numOutputSamples; ++n)
+        {
+            const double pos = position + n * ratio;
+            const int index = (int) pos;
+            const double phase = (pos - index) * numPhases;
+            const int row = (int) phase;
+            const float blend = (float) (phase - row);
+
+            const float* const x = src + index;
+            const float* const h0 = table + row * numTaps;
+            const float* const h1 = h0 + numTaps;
+            float sum0 = 0, sum1 = 0;
+
+            for (int k = 0; k < numTaps; ++k)
+            {
+                sum0 += x[k] * h0[k];
+                sum1 += x[k] * h1[k];
+            }
+
+            dest[n] = sum0 + blend * (sum1 - sum0);
+        }
+    }
+}
+
+#if JUCE_INTEL
+//==============================================================================
+#if JUCE_GCC || JUCE_CLANG
+ #define SINC_KERNEL_TARGET __attribute__ ((target ("sse2")))
+#else
+ #define SINC_KERNEL_TARGET
+#endif
+
+namespace SincResamplerSSE2
+{
+    SINC_KERNEL_TARGET inline float horizontalSum (__m128 v) noexcept
+    {
+        v = _mm_add_ps (v, _mm_movehl_ps (v, v));
+        v = _mm_add_ss (v, _mm_shuffle_ps (v, v, 1));
+        return _mm_cvtss_f32 (v);
+    }
+
+    SINC_KERNEL_TARGET inline void resampleChannel (const float* src, float* dest, int numOutputSamples,
+                                                    double position, double ratio,
+                                                    const float* table, int numTaps, int numPhases) noexcept
+    {
+        for (int n = 0; n < numOutputSamples; ++n)
+        {
+            const double pos = position + n * ratio;
+            const int index = (int) pos;
+            const double phase = (pos - index) * numPhases;
+            const int row = (int) phase;
+            const float blend = (float) (phase - row);
+
+            const float* const x = src + index;
+            const float* const h0 = table + row * numTaps;
+            const float* const h1 = h0 + numTaps;
+            __m128 sum0 = _mm_setzero_ps(), sum1 = _mm_setzero_ps();
+
+            for (int k = 0; k < numTaps; k += 4)
+            {
+                const __m128 v = _mm_loadu_ps (x + k);
+                sum0 = _mm_add_ps (sum0, _mm_mul_ps (v, _mm_loadu_ps (h0 + k)));
+                sum1 = _mm_add_ps (sum1, _mm_mul_ps (v, _mm_loadu_ps (h1 + k)));
+            }
+
+            const float s0 = horizontalSum (sum0);
+            dest[n] = s0 + blend * (horizontalSum (sum1) - s0);
+        }
+    }
+}
+
+#undef SINC_KERNEL_TARGET
+
+//==============================================================================
+#if JUCE_GCC || JUCE_CLANG
+ #define SINC_KERNEL_TARGET __attribute__ ((target ("avx")))
+#else
+ #define SINC_KERNEL_TARGET
+#endif
+
+namespace SincResamplerAVX
+{
+    SINC_KERNEL_TARGET inline float horizontalSum (__m256 v) noexcept
+    {
+        __m128 s = _mm_add_ps (_mm256_castps256_ps128 (v), _mm256_extractf128_ps (v, 1));
+        s = _mm_add_ps (s, _mm_movehl_ps (s, s));
+        s = _mm_add_ss (s, _mm_shuffle_ps (s, s, 1));
+        return _mm_cvtss_f32 (s);
+    }
+
+    SINC_KERNEL_TARGET inline void resampleChannel (const float* src, float* dest, int numOutputSamples,
+                                                    double position, double ratio,
+                                                    const float* table, int numTaps, int numPhases) noexcept
+    {
+        for (int n = 0; n < numOutputSamples; ++n)
+        {
+            const double pos = position + n * ratio;
+            const int index = (int) pos;
+            const double phase = (pos - index) * numPhases;
+            const int row = (int) phase;
+            const float blend = (float) (phase - row);
+
+            const float* const x = src + index;
+            const float* const h0 = table + row * numTaps;
+            const float* const h1 = h0 + numTaps;
+            __m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps();
+
+            for (int k = 0; k < numTaps; k += 8)
+            {
+                const __m256 v = _mm256_loadu_ps (x + k);
+                sum0 = _mm256_add_ps (sum0, _mm256_mul_ps (v, _mm256_loadu_ps (h0 + k)));
+                sum1 = _mm256_add_ps (sum1, _mm256_mul_ps (v, _mm256_loadu_ps (h1 + k)));
+            }
+
+            const float s0 = horizontalSum (sum0);
+            dest[n] = s0 + blend * (horizontalSum (sum1) - s0);
+        }
+
+        _mm256_zeroupper();
+    }
+}
+
+#undef SINC_KERNEL_TARGET
+#endif
+
+//==============================================================================
+/**
+    A streaming windowed-sinc resampler with a choice of quality.
+
+    Each output sample is a Kaiser-windowed sinc of numTaps input samples. The
+    filter is kept as a polyphase table of numPhases + 1 rows, and the two rows
+    either side of a sample's position are blended, so the table stays small
+    enough to sit in the cache while the fractional positions are still exact.
+    The cutoff follows the ratio, so going down in rate filters out what the new
+    rate can't hold rather than letting it alias.
+
+    The dot products use AVX or SSE2 where the CPU has them. Each output sample
+    costs the same whatever the ratio, 2 * numTaps multiply-adds per channel, so
+    the load on the audio thread is predictable.
+
+    Input is pushed in, and process() makes as many output samples as asked for
+    once getNumInputSamplesNeeded() samples have been pushed.
+*/
+class SincResampler
+{
+public:
+    enum Quality
+    {
+        draftQuality,
+        goodQuality,
+        bestQuality,
+        numQualities
+    };
+
+    enum
+    {
+        numPhases = 256
+    };
+
+    SincResampler (Quality qualityToUse, int numChannelsToUse)
+        : quality (qualityToUse),
+          numChannels (numChannelsToUse),
+          numTaps (getNumTaps (qualityToUse)),
+          ratio (0.0),
+          position (0.0),
+          numBuffered (0)
+    {
+        jassert (numChannels > 0);
+        setRatio (1.0);
+        prepare (512);
+    }
+
+    //==============================================================================
+    static const char* getQualityName (Quality q) noexcept
+    {
+        switch (q)
+        {
+            case draftQuality:  return "draft";
+            case goodQuality:   return "good";
+            default:            return "best";
+        }
+    }
+
+    static int getNumTaps (Quality q) noexcept
+    {
+        switch (q)
+        {
+            case draftQuality:  return 8;
+            case goodQuality:   return 16;
+            default:            return 32;
+        }
+    }
+
+    static String getInstructionSetName()
+    {
+       #if JUCE_INTEL
+        if (SystemStats::hasAVX())   return "AVX";
+        if (SystemStats::hasSSE2())  return "SSE2";
+       #endif
+
+        return "scalar";
+    }
+
+    Quality getQuality() const noexcept         { return quality; }
+    int getNumChannels() const noexcept         { return numChannels; }
+
+    //==============================================================================
+    /** Sets how many input samples there are to each output sample, e.g. 44100 / 48000.
+        The table is only rebuilt if its cutoff changes, which it doesn't while the
+        ratio stays below 1.
+    */
+    void setRatio (double inputSamplesPerOutputSample)
+    {
+        jassert (inputSamplesPerOutputSample > 0);
+
+        if (inputSamplesPerOutputSample == ratio)
+            return;
+
+        const double oldCutoff = getCutoff (ratio);
+        ratio = inputSamplesPerOutputSample;
+
+        if (getCutoff (ratio) != oldCutoff || table == nullptr)
+            buildTable();
+    }
+
+    double getRatio() const noexcept            { return ratio; }
+
+    /** Allocates enough history for blocks of up to this many output samples, so
+        that nothing is allocated on the audio thread after this.
+    */
+    void prepare (int maxOutputSamplesPerBlock)
+    {
+        const int capacity = getMaxInputSamples (maxOutputSamplesPerBlock) + numTaps;
+
+        if (capacity > history.getNumSamples())
+            history.setSize (numChannels, capacity, true, true, false);
+
+        reset();
+    }
+
+    /** The most input samples that a block of this many output samples can need. */
+    int getMaxInputSamples (int numOutputSamples) const noexcept
+    {
+        return (int) std::ceil (numOutputSamples * ratio) + numTaps + 1;
+    }
+
+    /** Forgets the input, as after a seek. The first taps / 2 - 1 samples before the
+        next input are silence.
+    */
+    void reset() noexcept
+    {
+        history.clear();
+        numBuffered = numTaps / 2 - 1;
+        position = 0.0;
+    }
+
+    //==============================================================================
+    /** How many more input samples must be pushed before process() can make this
+        many output samples.
+    */
+    int getNumInputSamplesNeeded (int numOutputSamples) const noexcept
+    {
+        if (numOutputSamples <= 0)
+            return 0;
+
+        const int required = (int) (position + (numOutputSamples - 1) * ratio) + numTaps;
+        return jmax (0, required - numBuffered);
+    }
+
+    /** Adds input, one array per channel. */
+    void pushInput (const float* const* input, int numSamples)
+    {
+        if (numBuffered + numSamples > history.getNumSamples())
+            history.setSize (numChannels, numBuffered + numSamples, true, false, true);   // not expected after prepare()
+
+        for (int chan = 0; chan < numChannels; ++chan)
+            history.copyFrom (chan, numBuffered, input[chan], numSamples);
+
+        numBuffered += numSamples;
+    }
+
+    /** Makes numOutputSamples samples for each channel, which needs at least
+        getNumInputSamplesNeeded() samples to have been pushed first.
+    */
+    void process (float* const* output, int numOutputSamples) noexcept
+    {
+        jassert (getNumInputSamplesNeeded (numOutputSamples) == 0);
+
+        for (int chan = 0; chan < numChannels; ++chan)
+            resampleChannel (history.getReadPointer (chan), output[chan], numOutputSamples);
+
+        position += numOutputSamples * ratio;
+
+        // drop the history that no later output sample reaches back to
+        const int consumed = jmin (numBuffered, (int) position);
+
+        if (consumed > 0)
+        {
+            for (int chan = 0; chan < numChannels; ++chan)
+            {
+                float* const data = history.getWritePointer (chan);
+                memmove (data, data + consumed, sizeof (float) * (size_t) (numBuffered - consumed));
+            }
+
+            numBuffered -= consumed;
+            position -= consumed;
+        }
+    }
+
+private:
+    //==============================================================================
+    const Quality quality;
+    const int numChannels, numTaps;
+    double ratio, position;
+
+    HeapBlock<float> table;
+    AudioSampleBuffer history;
+    int numBuffered;
+
+    /** The cutoff as a fraction of the input's Nyquist frequency: a little below the
+        lower of the two rates' Nyquist frequencies, with the shorter filters needing
+        a wider transition band.
+    */
+    double getCutoff (double r) const noexcept
+    {
+        static const double rolloffs[] = { 0.80, 0.90, 0.95 };
+        return rolloffs[quality] * jmin (1.0, r > 0 ? 1.0 / r : 1.0);
+    }
+
+    static double besselI0 (double x) noexcept
+    {
+        double sum = 1.0, term = 1.0;
+
+        for (int k = 1; k < 32; ++k)
+        {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+        }
+
+        return sum;
+    }
+
+    void buildTable()
+    {
+        static const double betas[] = { 5.0, 7.0, 9.5 };
+        const double beta = betas[quality];
+        const double cutoff = getCutoff (ratio);
+        const double halfLength = numTaps / 2.0;
+        const double i0Beta = besselI0 (beta);
+
+        table.malloc ((size_t) ((numPhases + 1) * numTaps));
+
+        for (int row = 0; row <= numPhases; ++row)
+        {
+            float* const h = table + row * numTaps;
+            const double frac = row / (double) numPhases;
+            double sum = 0.0;
+
+            for (int k = 0; k < numTaps; ++k)
+            {
+                // how far this tap's input sample is from the output sample's position
+                const double d = (k - (numTaps / 2 - 1)) - frac;
+                const double x = double_Pi * cutoff * d;
+                const double sinc = std::abs (x) < 1.0e-9 ? 1.0 : std::sin (x) / x;
+                const double w = d / halfLength;
+                const double window = std::abs (w) >= 1.0 ? 0.0 : besselI0 (beta * std::sqrt (1.0 - w * w)) / i0Beta;
+
+                h[k] = (float) (sinc * window);
+                sum += h[k];
+            }
+
+            // unity gain at DC for every phase, so the blend between rows doesn't ripple
+            for (int k = 0; k < numTaps; ++k)
+                h[k] = (float) (h[k] / sum);
+        }
+    }
+
+    void resampleChannel (const float* src, float* dest, int numOutputSamples) const noexcept
+    {
+       #if JUCE_INTEL
+        if (SystemStats::hasAVX())
+        {
+            SincResamplerAVX::resampleChannel (src, dest, numOutputSamples, position, ratio, table, numTaps, numPhases);
+            return;
+        }
+
+        if (SystemStats::hasSSE2())
+        {
+            SincResamplerSSE2::resampleChannel (src, dest, numOutputSamples, position, ratio, table, numTaps, numPhases);
+            return;
+        }
+       #endif
+
+        SincResamplerScalar::resampleChannel (src, dest, numOutputSamples, position, ratio, table, numTaps, numPhases);
+    }
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SincResampler)
+};
+
+//==============================================================================
+/**
+    Plays a PositionableAudioSource at whatever rate it's prepared with, using a
+    SincResampler to convert from the rate the source was recorded at.
+
+    It's meant to go between a file's source and an AudioTransportSource that's
+    given no rate to correct for, so that the transport's own interpolating
+    resampler is never used. Positions and lengths are in samples at the device
+    rate, which is what the transport expects from a source at that rate.
+
+    If the source moves its own position, as a LoopRegionAudioSource does when it
+    wraps, the position here moves by the same amount.
+
+    setNextReadPosition() can be called on any thread while this is playing. The
+    source is moved straight away, but the resampler's history belongs to the
+    audio thread, so it's only reset at the start of the next block.
+*/
+class SincResamplingAudioSource  : public PositionableAudioSource
+{
+public:
+    SincResamplingAudioSource (PositionableAudioSource* sourceToResample, bool deleteSourceWhenDeleted,
+                               double sourceSampleRateToUse, SincResampler::Quality quality,
+                               int numChannelsToUse = 2)
+        : source (sourceToResample, deleteSourceWhenDeleted),
+          sourceSampleRate (sourceSampleRateToUse),
+          resampler (quality, jlimit (1, (int) maxChannels, numChannelsToUse)),
+          nextPlayPos (0),
+          pendingPosition (-1)
+    {
+        jassert (source != nullptr && sourceSampleRate > 0);
+        jassert (numChannelsToUse <= maxChannels);   // any more are left silent
+    }
+
+    SincResampler::Quality getQuality() const noexcept      { return resampler.getQuality(); }
+
+    //==============================================================================
+    void prepareToPlay (int samplesPerBlockExpected, double sampleRate) override
+    {
+        resampler.setRatio (sourceSampleRate / sampleRate);
+        resampler.prepare (samplesPerBlockExpected);
+
+        const int maxInputSamples = resampler.getMaxInputSamples (samplesPerBlockExpected);
+        inputBuffer.setSize (resampler.getNumChannels(), maxInputSamples);
+        source->prepareToPlay (maxInputSamples, sourceSampleRate);
+    }
+
+    void releaseResources() override
+    {
+        source->releaseResources();
+    }
+
+    void getNextAudioBlock (const AudioSourceChannelInfo& info) override
+    {
+        const int64 newPosition = pendingPosition.exchange (-1);
+
+        if (newPosition >= 0)
+        {
+            nextPlayPos = newPosition;
+            resampler.reset();
+        }
+
+        const int numChannels = resampler.getNumChannels();
+        const int numInput = resampler.getNumInputSamplesNeeded (info.numSamples);
+
+        if (numInput > 0)
+        {
+            if (numInput > inputBuffer.getNumSamples())
+                inputBuffer.setSize (numChannels, numInput, false, false, true);   // a bigger block than prepared for
+
+            const int64 expectedSourcePos = source->getNextReadPosition() + numInput;
+
+            source->getNextAudioBlock (AudioSourceChannelInfo (&inputBuffer, 0, numInput));
+            resampler.pushInput (inputBuffer.getArrayOfReadPointers(), numInput);
+
+            const int64 jump = source->getNextReadPosition() - expectedSourcePos;
+
+            if (jump != 0)
+                nextPlayPos += (int64) (jump / resampler.getRatio());
+        }
+
+        float* outputs[maxChannels];
+        const int numOutputs = jmin (numChannels, (int) maxChannels, info.buffer->getNumChannels());
+
+        for (int chan = 0; chan < numOutputs; ++chan)
+            outputs[chan] = info.buffer->getWritePointer (chan, info.startSample);
+
+        if (numOutputs == numChannels)
+        {
+            resampler.process (outputs, info.numSamples);
+        }
+        else
+        {
+            // fewer output channels than the resampler keeps, so the rest go to scratch space
+            AudioSampleBuffer& scratch = inputBuffer;
+            scratch.setSize (numChannels, jmax (scratch.getNumSamples(), info.numSamples), true, false, true);
+
+            for (int chan = numOutputs; chan < numChannels; ++chan)
+                outputs[chan] = scratch.getWritePointer (chan);
+
+            resampler.process (outputs, info.numSamples);
+        }
+
+        for (int chan = numOutputs; chan < info.buffer->getNumChannels(); ++chan)
+            info.buffer->clear (chan, info.startSample, info.numSamples);
+
+        nextPlayPos += info.numSamples;
+    }
+
+    //==============================================================================
+    void setNextReadPosition (int64 newPosition) override
+    {
+        // the source goes first, so that a block read before the reset is dropped
+        // rather than the reset being followed by a block from the old position
+        source->setNextReadPosition ((int64) (newPosition * resampler.getRatio()));
+        pendingPosition = jmax ((int64) 0, newPosition);
+    }
+
+    int64 getNextReadPosition() const override
+    {
+        const int64 pending = pendingPosition.get();
+        return pending >= 0 ? pending : nextPlayPos;
+    }
+
+    int64 getTotalLength() const override
+    {
+        return (int64) (source->getTotalLength() / resampler.getRatio());
+    }
+
+    bool isLooping() const override                 { return source->isLooping(); }
+    void setLooping (bool shouldLoop) override      { source->setLooping (shouldLoop); }
+
+private:
+    //==============================================================================
+    enum { maxChannels = 32 };
+
+    OptionalScopedPointer<PositionableAudioSource> source;
+    const double sourceSampleRate;
+    SincResampler resampler;
+    AudioSampleBuffer inputBuffer;
+    int64 nextPlayPos;
+    Atomic<int64> pendingPosition;   // -1 when there's no seek waiting for the audio thread
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SincResamplingAudioSource)
+};
+
+#endif  // SINCRESAMPLER_H_INCLUDED
@@ -0,0 +1,819 @@
+/*
+  ==============================================================================
+
+    Spectrogram.h
+
+  ==============================================================================
+*/
+
+#ifndef SPECTROGRAM_H_INCLUDED
+#define SPECTROGRAM_H_INCLUDED
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "DiskCacheBudget.h"
+
+//==============================================================================
+/**
+    One tile of a spectrogram: numColumns consecutive columns at one level's hop
+    size, each holding numRows magnitudes as 8-bit values on a decibel scale,
+    lowest frequency first.
+
+    The bytes are stored a column at a time, so drawing a column reads one run.
+*/
+class SpectrogramTile  : public ReferenceCountedObject
+{
+public:
+    typedef ReferenceCountedObjectPtr<SpectrogramTile> Ptr;
+
+    enum
+    {
+        numColumns = 256,
+        numRows = 256
+    };
+
+    /** Identifies a tile: the file's hash code, the level, and which run of
+        numColumns columns of that level it is.
+    */
+    struct Key
+    {
+        Key() : hashCode (0), level (0), index (0) {}
+        Key (int64 hash, int levelToUse, int64 indexToUse) : hashCode (hash), level (levelToUse), index (indexToUse) {}
+
+        bool operator== (const Key& other) const noexcept
+        {
+            return hashCode == other.hashCode && level == other.level && index == other.index;
+        }
+
+        bool operator!= (const Key& other) const noexcept    { return ! operator== (other); }
+
+        int64 hashCode;
+        int level;
+        int64 index;
+    };
+
+    SpectrogramTile (const Key& keyToUse, int numValidColumnsToUse)
+        : key (keyToUse),
+          numValidColumns (numValidColumnsToUse),
+          data ((size_t) numColumns * (size_t) numRows, true),
+          lastUsed (0)
+    {
+    }
+
+    //==============================================================================
+    const Key& getKey() const noexcept                  { return key; }
+
+    /** The last tile of a file usually runs off its end; the columns past this are empty. */
+    int getNumValidColumns() const noexcept             { return numValidColumns; }
+
+    const uint8* getColumn (int column) const noexcept
+    {
+        jassert (isPositiveAndBelow (column, (int) numColumns));
+        return data + (size_t) column * numRows;
+    }
+
+    uint8* getWritableColumn (int column) noexcept
+    {
+        jassert (isPositiveAndBelow (column, (int) numColumns));
+        return data + (size_t) column * numRows;
+    }
+
+    /** The memory that a tile takes up. */
+    static size_t getNumBytes() noexcept                { return sizeof (SpectrogramTile) + (size_t) numColumns * numRows; }
+
+    //==============================================================================
+    void writeTo (OutputStream& out) const
+    {
+        out.write ("jspt", 4);
+        out.writeInt (formatVersion);
+        out.writeInt64 (key.hashCode);
+        out.writeInt (key.level);
+        out.writeInt64 (key.index);
+        out.writeInt (numValidColumns);
+        out.write (data, (size_t) numColumns * numRows);
+    }
+
+    /** Reads a tile written by writeTo(), or returns nullptr if the stream holds
+        something else, or a different tile.
+    */
+    static SpectrogramTile* readFrom (InputStream& in, const Key& expectedKey)
+    {
+        char magic[4];
+
+        if (in.read (magic, 4) != 4 || memcmp (magic, "jspt", 4) != 0
+             || in.readInt() != formatVersion
+             || in.readInt64() != expectedKey.hashCode
+             || in.readInt() != expectedKey.level
+             || in.readInt64() != expectedKey.index)
+            return nullptr;
+
+        const int numValid = in.readInt();
+
+        if (! isPositiveAndNotGreaterThan (numValid, (int) numColumns))
+            return nullptr;
+
+        ScopedPointer<SpectrogramTile> tile (new SpectrogramTile (expectedKey, numValid));
+
+        if (in.read (tile->data, numColumns * numRows) != numColumns * numRows)
+            return nullptr;
+
+        return tile.release();
+    }
+
+private:
+    //==============================================================================
+    friend class SpectrogramTileCache;
+
+    enum { formatVersion = 1 };
+
+    const Key key;
+    const int numValidColumns;
+    HeapBlock<uint8> data;
+    uint32 lastUsed;    // only touched by the cache, under its lock
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SpectrogramTile)
+};
+
+//==============================================================================
+/**
+    Keeps finished spectrogram tiles in memory, up to a byte budget, and in a
+    directory on disk, up to another. When either is over its budget, the tiles
+    least recently stored or used are dropped.
+
+    Looking a tile up in memory is quick enough to do while painting. Only the
+    jobs that make the tiles look on disk, so that a paint never waits for a read.
+*/
+class SpectrogramTileCache
+{
+public:
+    SpectrogramTileCache (const File& directoryToUse, int64 maxBytesOnDiskToUse, int64 maxBytesInMemoryToUse)
+        : directory (directoryToUse),
+          maxBytesInMemory (maxBytesInMemoryToUse),
+          diskBudget (directoryToUse, "*" + String (getFileSuffix()), maxBytesOnDiskToUse),
+          useCounter (0)
+    {
+        directory.createDirectory();
+    }
+
+    //==============================================================================
+    /** Returns the tile if it's in memory, or nullptr. */
+    SpectrogramTile::Ptr findInMemory (const SpectrogramTile::Key& key)
+    {
+        const ScopedLock sl (memoryLock);
+
+        for (int i = tiles.size(); --i >= 0;)
+        {
+            SpectrogramTile* const tile = tiles.getObjectPointerUnchecked (i);
+
+            if (tile->key == key)
+            {
+                tile->lastUsed = ++useCounter;
+                return tile;
+            }
+        }
+
+        return nullptr;
+    }
+
+    /** Reads a tile from disk into memory, returning nullptr if it isn't there. */
+    SpectrogramTile::Ptr loadFromDisk (const SpectrogramTile::Key& key)
+    {
+        const File file (getFileFor (key));
+        SpectrogramTile::Ptr tile;
+
+        {
+            FileInputStream in (file);
+
+            if (in.openedOk())
+                tile = SpectrogramTile::readFrom (in, key);
+        }
+
+        if (tile != nullptr)
+        {
+            DiskCacheBudget::markUsed (file);
+            addToMemory (tile);
+        }
+
+        return tile;
+    }
+
+    /** Keeps a newly made tile in memory, and writes it to disk. */
+    void store (SpectrogramTile* tile)
+    {
+        addToMemory (tile);
+
+        const File file (getFileFor (tile->getKey()));
+        const int64 oldSize = file.getSize();
+        TemporaryFile temp (file);
+
+        {
+            FileOutputStream out (temp.getFile());
+
+            if (out.failedToOpen())
+                return;
+
+            tile->writeTo (out);
+            out.flush();
+
+            if (out.getStatus().failed())
+                return;
+        }
+
+        if (temp.overwriteTargetFileWithTemporary())
+            diskBudget.fileWritten (file.getSize(), oldSize);
+    }
+
+    //==============================================================================
+    const File& getDirectory() const noexcept           { return directory; }
+
+    int64 getNumBytesInMemory() const
+    {
+        const ScopedLock sl (memoryLock);
+        return (int64) tiles.size() * (int64) SpectrogramTile::getNumBytes();
+    }
+
+private:
+    //==============================================================================
+    const File directory;
+    const int64 maxBytesInMemory;
+    DiskCacheBudget diskBudget;
+
+    CriticalSection memoryLock;
+    ReferenceCountedArray<SpectrogramTile> tiles;
+    uint32 useCounter;
+
+    static const char* getFileSuffix() noexcept         { return ".spectile"; }
+
+    File getFileFor (const SpectrogramTile::Key& key) const
+    {
+        return directory.getChildFile (String::toHexString (key.hashCode) + "_" + String (key.level)
+                                         + "_" + String (key.index) + getFileSuffix());
+    }
+
+    void addToMemory (SpectrogramTile* tile)
+    {
+        const ScopedLock sl (memoryLock);
+
+        for (int i = tiles.size(); --i >= 0;)
+            if (tiles.getObjectPointerUnchecked (i)->key == tile->key)
+                tiles.remove (i);
+
+        tile->lastUsed = ++useCounter;
+        tiles.add (tile);
+
+        // a tile that's dropped here stays alive for as long as anything is drawing it
+        while ((int64) tiles.size() * (int64) SpectrogramTile::getNumBytes() > maxBytesInMemory && tiles.size() > 1)
+        {
+            int oldest = 0;
+
+            for (int i = 1; i < tiles.size(); ++i)
+                if (tiles.getObjectPointerUnchecked (i)->lastUsed < tiles.getObjectPointerUnchecked (oldest)->lastUsed)
+                    oldest = i;
+
+            tiles.remove (oldest);
+        }
+    }
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SpectrogramTileCache)
+};
+
+//==============================================================================
+/**
+    The spectrogram of an audio file, worked out a tile at a time on a ThreadPool.
+
+    There are numLevels levels, each with a hop between columns levelRatio times
+    longer than the one before, so that at any zoom there's a level with between
+    one and levelRatio columns to a pixel. Where a level's hop is longer than the
+    FFT, a column is the average power of a few windows spread across the hop
+    rather than of every sample in it. That keeps the cost of a tile about the
+    same at every level, so the first tiles of a view of a file hours long are
+    ready about as soon as those of a view of a few seconds.
+
+    setVisibleRange() says what's on screen. The tiles of the right level that
+    cover it, and one either side, are made from the middle outwards, with no
+    more jobs in the pool at once than it has threads, and the jobs for tiles
+    that have scrolled out of view are dropped. Each job looks in the
+    SpectrogramTileCache before doing any work, and stores what it makes there.
+    Listeners get a change message as each tile lands, and until a tile is ready
+    render() fills in with a coarser one if the cache has it.
+
+    Everything apart from the jobs happens on the message thread.
+*/
+class Spectrogram  : public ChangeBroadcaster,
+                     private AsyncUpdater
+{
+public:
+    enum
+    {
+        fftOrder = 9,
+        fftSize = 1 << fftOrder,
+        finestHop = 128,
+        levelRatio = 4,
+        numLevels = 6,
+        maxWindowsPerColumn = 4,
+        minDecibels = -100
+    };
+
+    //==============================================================================
+    Spectrogram (AudioFormatManager& formatManagerToUse,
+                 SpectrogramTileCache& cacheToUse,
+                 ThreadPool& threadPoolToUse)
+        : formatManager (formatManagerToUse),
+          cache (cacheToUse),
+          threadPool (threadPoolToUse),
+          hashCode (0),
+          sampleRate (0.0),
+          totalSamples (0),
+          visibleWidth (0),
+          readFailed (0)
+    {
+        static_jassert ((int) SpectrogramTile::numRows == (int) fftSize / 2);  // a row for each bin
+
+        // black through blue, red and yellow to white
+        const Colour colours[] = { Colours::black, Colour (0xff20208a), Colour (0xffc0203a),
+                                   Colour (0xfff0c020), Colours::white };
+        const int numSteps = numElementsInArray (colours) - 1;
+
+        for (int i = 0; i < 256; ++i)
+        {
+            const float position = i * numSteps / 255.0f;
+            const int step = jmin (numSteps - 1, (int) position);
+
+            colourMap[i] = colours[step].interpolatedWith (colours[step + 1], position - step).getPixelARGB();
+        }
+    }
+
+    ~Spectrogram()
+    {
+        stopJobs (-1);
+        cancelPendingUpdate();
+    }
+
+    //==============================================================================
+    /** Starts showing a file. The hash code identifies its tiles in the cache, so it
+        should change whenever the file does, as DiskThumbnailCache::getHashFor()'s does.
+    */
+    void setFile (const File& newFile, int64 newHashCode, double newSampleRate, int64 newTotalSamples)
+    {
+        clear();
+
+        if (newHashCode == 0 || newSampleRate <= 0 || newTotalSamples <= 0)
+            return;
+
+        file = newFile;
+        hashCode = newHashCode;
+        sampleRate = newSampleRate;
+        totalSamples = newTotalSamples;
+
+        updateWantedTiles();
+    }
+
+    void clear()
+    {
+        stopJobs (-1);
+
+        file = File();
+        hashCode = 0;
+        sampleRate = 0.0;
+        totalSamples = 0;
+        wanted.clearQuick();
+        readFailed = 0;
+
+        sendChangeMessage();
+    }
+
+    /** Tells the spectrogram which part of the file is on screen, and how many
+        pixels wide it is, so that it can make the tiles for it.
+    */
+    void setVisibleRange (Range<double> newRange, int widthInPixels)
+    {
+        if (newRange == visibleRange && widthInPixels == visibleWidth)
+            return;
+
+        visibleRange = newRange;
+        visibleWidth = widthInPixels;
+        updateWantedTiles();
+    }
+
+    double getTotalLength() const noexcept      { return sampleRate > 0 ? totalSamples / sampleRate : 0.0; }
+
+    /** The number of tiles that have been asked for but aren't in the cache yet. */
+    int getNumTilesWanted() const noexcept      { return wanted.size(); }
+
+    //==============================================================================
+    static int64 getHop (int level) noexcept
+    {
+        int64 hop = finestHop;
+
+        while (--level >= 0)
+            hop *= levelRatio;
+
+        return hop;
+    }
+
+    /** Returns the coarsest level that still has at least one column per pixel. */
+    static int getLevelForDensity (double samplesPerPixel) noexcept
+    {
+        int level = 0;
+
+        while (level < numLevels - 1 && getHop (level + 1) <= samplesPerPixel)
+            ++level;
+
+        return level;
+    }
+
+    //==============================================================================
+    /** Draws the given time range into an RGB image, a column per pixel, with the
+        lowest frequencies at the bottom. Columns that no tile in memory covers yet
+        are left black.
+
+        Returns true if every column came from a tile of the level that the range
+        needs, rather than a coarser one or none.
+    */
+    bool render (Image& image, Range<double> timeRange)
+    {
+        jassert (image.getFormat() == Image::RGB);
+
+        const int width = image.getWidth();
+        const int height = image.getHeight();
+
+        image.clear (image.getBounds(), Colours::black);
+
+        if (hashCode == 0 || timeRange.isEmpty() || width <= 0 || height <= 0)
+            return true;
+
+        const double samplesPerPixel = timeRange.getLength() * sampleRate / width;
+        const int level = getLevelForDensity (samplesPerPixel);
+
+        HeapBlock<int> rowForY ((size_t) height);
+
+        for (int y = 0; y < height; ++y)
+            rowForY[y] = ((height - 1 - y) * (int) SpectrogramTile::numRows) / height;
+
+        Image::BitmapData bitmap (image, Image::BitmapData::writeOnly);
+        TileFinder finder (*this);
+        bool isComplete = true;
+
+        for (int x = 0; x < width; ++x)
+        {
+            const int64 sample = (int64) ((timeRange.getStart() + (x + 0.5) * timeRange.getLength() / width) * sampleRate);
+
+            if (! isPositiveAndBelow (sample, totalSamples))
+                continue;
+
+            int levelUsed;
+            const uint8* const column = finder.findColumn (sample, level, levelUsed);
+
+            if (levelUsed != level)
+                isComplete = false;
+
+            if (column == nullptr)
+                continue;
+
+            for (int y = 0; y < height; ++y)
+                reinterpret_cast<PixelRGB*> (bitmap.getPixelPointer (x, y))->set (colourMap [column [rowForY[y]]]);
+        }
+
+        return isComplete;
+    }
+
+private:
+    //==============================================================================
+    AudioFormatManager& formatManager;
+    SpectrogramTileCache& cache;
+    ThreadPool& threadPool;
+
+    File file;
+    int64 hashCode;
+    double sampleRate;
+    int64 totalSamples;
+
+    Range<double> visibleRange;
+    int visibleWidth;
+    Array<SpectrogramTile::Key> wanted;     // in the order they should be made
+
+    CriticalSection lock;
+    Array<SpectrogramTile::Key> inProgress; // guarded by the lock, as the jobs remove themselves
+    Atomic<int> readFailed;
+
+    PixelARGB colourMap[256];
+
+    //==============================================================================
+    /** Remembers the last tile it found at each level, as neighbouring columns
+        nearly always come from the same one.
+    */
+    struct TileFinder
+    {
+        TileFinder (Spectrogram& s) : spectrogram (s)
+        {
+            for (int i = 0; i < numLevels; ++i)
+                lastIndex[i] = -1;
+        }
+
+        /** Returns the column covering a sample from the given level, or from the
+            nearest coarser one if that tile isn't in memory.
+        */
+        const uint8* findColumn (int64 sample, int level, int& levelUsed)
+        {
+            for (levelUsed = level; levelUsed < numLevels; ++levelUsed)
+            {
+                const int64 column = sample / getHop (levelUsed);
+                const int64 index = column / SpectrogramTile::numColumns;
+
+                if (index != lastIndex[levelUsed])
+                {
+                    lastIndex[levelUsed] = index;
+                    lastTile[levelUsed] = spectrogram.cache.findInMemory (SpectrogramTile::Key (spectrogram.hashCode, levelUsed, index));
+                }
+
+                const SpectrogramTile* const tile = lastTile[levelUsed];
+                const int columnInTile = (int) (column - index * SpectrogramTile::numColumns);
+
+                if (tile != nullptr && columnInTile < tile->getNumValidColumns())
+                    return tile->getColumn (columnInTile);
+            }
+
+            return nullptr;
+        }
+
+        Spectrogram& spectrogram;
+        int64 lastIndex[numLevels];
+        SpectrogramTile::Ptr lastTile[numLevels];
+    };
+
+    //==============================================================================
+    /** Makes one tile, unless it turns out to be on disk already. */
+    class TileJob  : public ThreadPoolJob
+    {
+    public:
+        TileJob (Spectrogram& ownerToUse, const SpectrogramTile::Key& keyToUse)
+            : ThreadPoolJob ("Spectrogram tile"),
+              owner (ownerToUse),
+              key (keyToUse),
+              file (ownerToUse.file),
+              totalSamples (ownerToUse.totalSamples),
+              fft (fftOrder, false),
+              window ((size_t) fftSize),
+              fftData ((size_t) fftSize * 2),
+              power ((size_t) SpectrogramTile::numRows),
+              bufferStart (0),
+              bufferLength (0)
+        {
+            for (int i = 0; i < fftSize; ++i)
+                window[i] = 0.5f - 0.5f * std::cos (2.0f * float_Pi * i / fftSize);
+        }
+
+        /** Runs whether the job finished or was dropped before it started. */
+        ~TileJob()
+        {
+            owner.tileJobFinished (key);
+        }
+
+        JobStatus runJob() override
+        {
+            if (shouldExit() || owner.cache.loadFromDisk (key) != nullptr)
+                return jobHasFinished;
+
+            reader = owner.formatManager.createReaderFor (file);
+
+            if (reader == nullptr)
+            {
+                owner.readFailed = 1;
+                return jobHasFinished;
+            }
+
+            const SpectrogramTile::Ptr tile (calculateTile());
+
+            if (tile != nullptr)
+                owner.cache.store (tile);
+
+            reader = nullptr;
+            return jobHasFinished;
+        }
+
+        Spectrogram& owner;
+        const SpectrogramTile::Key key;
+
+    private:
+        enum
+        {
+            readBlockSize = 32768,
+            columnsBetweenExitChecks = 16
+        };
+
+        const File file;
+        const int64 totalSamples;
+        ScopedPointer<AudioFormatReader> reader;
+        FFT fft;
+        HeapBlock<float> window, fftData, power;
+
+        AudioSampleBuffer buffer;
+        HeapBlock<float> mono;
+        int64 bufferStart;
+        int bufferLength;
+
+        /** Returns nullptr if the job was told to stop part-way through. */
+        SpectrogramTile* calculateTile()
+        {
+            const int64 hop = getHop (key.level);
+            const int64 firstColumn = key.index * SpectrogramTile::numColumns;
+            const int numValidColumns = (int) jmin ((int64) SpectrogramTile::numColumns,
+                                                    (totalSamples + hop - 1) / hop - firstColumn);
+
+            if (numValidColumns <= 0)
+                return nullptr;
+
+            ScopedPointer<SpectrogramTile> tile (new SpectrogramTile (key, numValidColumns));
+
+            const int windowsPerColumn = (int) jlimit ((int64) 1, (int64) maxWindowsPerColumn, hop / fftSize);
+            const int64 windowSpacing = hop / windowsPerColumn;
+
+            // windows that overlap are read a block at a time, so that each sample is
+            // only read once and readers that can't seek backwards cheaply never need to;
+            // windows that are far apart are read on their own
+            const int readSize = windowSpacing < fftSize ? (int) readBlockSize : (int) fftSize;
+            buffer.setSize (jmin (2, (int) reader->numChannels), readSize, false, false, true);
+            mono.malloc ((size_t) readSize);
+            bufferLength = 0;
+
+            // a full-scale sine comes out of a Hann-windowed FFT at a quarter of the size
+            const float scale = 4.0f / fftSize;
+
+            for (int c = 0; c < numValidColumns; ++c)
+            {
+                if (c % columnsBetweenExitChecks == 0 && shouldExit())
+                    return nullptr;
+
+                FloatVectorOperations::clear (power, SpectrogramTile::numRows);
+
+                for (int w = 0; w < windowsPerColumn; ++w)
+                {
+                    const int64 centre = (firstColumn + c) * hop + (int64) ((w + 0.5) * windowSpacing);
+                    const float* const samples = getSamples (centre - fftSize / 2, readSize);
+
+                    FloatVectorOperations::multiply (fftData, samples, window, fftSize);
+                    FloatVectorOperations::clear (fftData + fftSize, fftSize);
+                    fft.performFrequencyOnlyForwardTransform (fftData);
+
+                    for (int bin = 0; bin < SpectrogramTile::numRows; ++bin)
+                        power[bin] += fftData[bin] * fftData[bin];
+                }
+
+                uint8* const dest = tile->getWritableColumn (c);
+
+                for (int bin = 0; bin < SpectrogramTile::numRows; ++bin)
+                {
+                    const float magnitude = std::sqrt (power[bin] / windowsPerColumn) * scale;
+                    const float decibels = Decibels::gainToDecibels (magnitude, (float) minDecibels);
+
+                    dest[bin] = (uint8) jlimit (0, 255, roundToInt ((decibels - minDecibels) * 255.0f / -minDecibels));
+                }
+            }
+
+            return tile.release();
+        }
+
+        /** Returns fftSize samples of the mix of the first two channels starting at
+            the given position, reading more if they aren't in the buffer already.
+        */
+        const float* getSamples (int64 start, int readSize)
+        {
+            if (start < bufferStart || start + fftSize > bufferStart + bufferLength)
+            {
+                bufferStart = start;
+                bufferLength = readSize;
+
+                // the reader fills anything outside the file with silence
+                reader->read (&buffer, 0, readSize, start, true, true);
+
+                FloatVectorOperations::copy (mono, buffer.getReadPointer (0), readSize);
+
+                if (buffer.getNumChannels() > 1)
+                {
+                    FloatVectorOperations::add (mono, buffer.getReadPointer (1), readSize);
+                    FloatVectorOperations::multiply (mono, 0.5f, readSize);
+                }
+            }
+
+            return mono + (start - bufferStart);
+        }
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TileJob)
+    };
+
+    struct UnwantedTileJobSelector  : public ThreadPool::JobSelector
+    {
+        UnwantedTileJobSelector (Spectrogram& s, bool all) : spectrogram (s), selectAll (all) {}
+
+        bool isJobSuitable (ThreadPoolJob* job) override
+        {
+            TileJob* const tileJob = dynamic_cast<TileJob*> (job);
+
+            return tileJob != nullptr && &(tileJob->owner) == &spectrogram
+                    && (selectAll || ! spectrogram.wanted.contains (tileJob->key));
+        }
+
+        Spectrogram& spectrogram;
+        const bool selectAll;
+    };
+
+    //==============================================================================
+    /** Works out which tiles the visible range needs that aren't in memory, most
+        central first, drops the jobs for any that aren't needed any more, and
+        starts jobs for the first few of the rest.
+    */
+    void updateWantedTiles()
+    {
+        wanted.clearQuick();
+
+        if (hashCode != 0 && ! visibleRange.isEmpty() && visibleWidth > 0)
+        {
+            const double samplesPerPixel = visibleRange.getLength() * sampleRate / visibleWidth;
+            const int level = getLevelForDensity (samplesPerPixel);
+            const int64 samplesPerTile = getHop (level) * SpectrogramTile::numColumns;
+
+            const int64 lastTileInFile = (totalSamples - 1) / samplesPerTile;
+            const int64 first = jmax ((int64) 0, (int64) (visibleRange.getStart() * sampleRate) / samplesPerTile - 1);
+            const int64 last = jmin (lastTileInFile, (int64) (visibleRange.getEnd() * sampleRate) / samplesPerTile + 1);
+            const double middleTime = (visibleRange.getStart() + visibleRange.getEnd()) * 0.5;
+            const int64 middle = jlimit (first, last, (int64) (middleTime * sampleRate) / samplesPerTile);
+
+            for (int64 distance = 0; middle - distance >= first || middle + distance <= last; ++distance)
+            {
+                if (middle + distance <= last)
+                    addWantedTile (SpectrogramTile::Key (hashCode, level, middle + distance));
+
+                if (distance > 0 && middle - distance >= first)
+                    addWantedTile (SpectrogramTile::Key (hashCode, level, middle - distance));
+            }
+        }
+
+        UnwantedTileJobSelector selector (*this, false);
+        threadPool.removeAllJobs (true, 0, &selector);
+
+        startJobs();
+    }
+
+    void addWantedTile (const SpectrogramTile::Key& key)
+    {
+        if (cache.findInMemory (key) == nullptr)
+            wanted.add (key);
+    }
+
+    void startJobs()
+    {
+        if (readFailed.get() != 0)
+            return;
+
+        const int maxJobs = jmax (1, threadPool.getNumThreads());
+        const ScopedLock sl (lock);
+
+        for (int i = 0; i < wanted.size() && inProgress.size() < maxJobs;)
+        {
+            const SpectrogramTile::Key key (wanted.getReference (i));
+
+            if (cache.findInMemory (key) != nullptr)
+            {
+                wanted.remove (i);
+                continue;
+            }
+
+            if (! inProgress.contains (key))
+            {
+                inProgress.add (key);
+                threadPool.addJob (new TileJob (*this, key), true);
+            }
+
+            ++i;
+        }
+    }
+
+    /** Waits for this spectrogram's jobs to stop, or with a timeout of 0, just tells
+        them to.
+    */
+    void stopJobs (int timeOutMs)
+    {
+        UnwantedTileJobSelector selector (*this, true);
+        threadPool.removeAllJobs (true, timeOutMs, &selector);
+    }
+
+    /** Called from a TileJob's destructor, on whichever thread deleted it. */
+    void tileJobFinished (const SpectrogramTile::Key& key)
+    {
+        {
+            const ScopedLock sl (lock);
+            inProgress.removeFirstMatchingValue (key);
+        }
+
+        triggerAsyncUpdate();
+    }
+
+    void handleAsyncUpdate() override
+    {
+        startJobs();
+        sendChangeMessage();
+    }
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Spectrogram)
+};
+
+#endif  // SPECTROGRAM_H_INCLUDED
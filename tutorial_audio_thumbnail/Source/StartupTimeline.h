@@ -0,0 +1,152 @@
+/*
+  ==============================================================================
+
+    StartupTimeline.h
+
+  ==============================================================================
+*/
+
+#ifndef STARTUPTIMELINE_H_INCLUDED
+#define STARTUPTIMELINE_H_INCLUDED
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+#if JUCE_LINUX
+ #include <unistd.h>
+#endif
+
+//==============================================================================
+/**
+    Records when each stage of the app's startup was reached, measured from when
+    the process started, so that changes to startup can be tracked.
+
+    On Linux the process's real start time comes from /proc, so the time spent
+    loading the executable and its libraries is counted too. Elsewhere, the clock
+    starts when the timeline is first used, which Main.cpp arranges to be during
+    static initialisation.
+
+    Stages can be marked from any thread. Each one is only recorded the first
+    time it's marked, so paint() and the like can mark one unconditionally.
+*/
+class StartupTimeline
+{
+public:
+    /** The app's one timeline. It must first be called before any other threads
+        are started, as it's created on first use.
+    */
+    static StartupTimeline& getInstance()
+    {
+        static StartupTimeline timeline;
+        return timeline;
+    }
+
+    //==============================================================================
+    /** Records that a stage has been reached, unless it's been marked already. */
+    void mark (const String& stage)
+    {
+        const double now = Time::getMillisecondCounterHiRes();
+        const ScopedLock sl (lock);
+
+        if (! stages.contains (stage))
+        {
+            stages.add (stage);
+            times.add (now - processStartTime);
+        }
+    }
+
+    bool hasReached (const String& stage) const
+    {
+        const ScopedLock sl (lock);
+        return stages.contains (stage);
+    }
+
+    /** Returns the milliseconds from process start to a stage, or -1 if it hasn't
+        been reached.
+    */
+    double getMillisecondsTo (const String& stage) const
+    {
+        const ScopedLock sl (lock);
+        const int index = stages.indexOf (stage);
+        return index >= 0 ? times.getUnchecked (index) : -1.0;
+    }
+
+    /** The stages in the order they were reached, e.g.
+        "process start 0.0 ms -> window shown 48.2 ms -> first paint 61.7 ms"
+    */
+    String toString() const
+    {
+        const ScopedLock sl (lock);
+        String s ("process start 0.0 ms");
+
+        for (int i = 0; i < stages.size(); ++i)
+            s << " -> " << stages[i] << " " << String (times.getUnchecked (i), 1) << " ms";
+
+        return s;
+    }
+
+    /** Writes the timeline to the log, once, as soon as every one of the given
+        stages has been reached. Call it after marking any of them.
+    */
+    void logOnceReached (const StringArray& finalStages)
+    {
+        {
+            const ScopedLock sl (lock);
+
+            if (hasBeenLogged)
+                return;
+
+            for (int i = 0; i < finalStages.size(); ++i)
+                if (! stages.contains (finalStages[i]))
+                    return;
+
+            hasBeenLogged = true;
+        }
+
+        Logger::writeToLog ("Startup: " + toString());
+    }
+
+private:
+    //==============================================================================
+    CriticalSection lock;
+    StringArray stages;
+    Array<double> times;
+    double processStartTime;
+    bool hasBeenLogged;
+
+    StartupTimeline()
+        : processStartTime (findProcessStartTime()),
+          hasBeenLogged (false)
+    {
+    }
+
+    /** The process's start time on the getMillisecondCounterHiRes() clock. */
+    static double findProcessStartTime()
+    {
+        const double now = Time::getMillisecondCounterHiRes();
+
+       #if JUCE_LINUX
+        // both are measured from boot, so their difference is the process's age
+        // whatever clock getMillisecondCounterHiRes() uses
+        const StringArray statFields (StringArray::fromTokens (File ("/proc/self/stat").loadFileAsString()
+                                                                   .fromLastOccurrenceOf (")", false, false), true));
+        const double uptimeSeconds = File ("/proc/uptime").loadFileAsString().getDoubleValue();
+        const long ticksPerSecond = sysconf (_SC_CLK_TCK);
+
+        // starttime is the 22nd field, and the 20th after the command name
+        if (statFields.size() > 19 && uptimeSeconds > 0 && ticksPerSecond > 0)
+        {
+            const double ageSeconds = uptimeSeconds - statFields[19].getLargeIntValue() / (double) ticksPerSecond;
+
+            if (ageSeconds >= 0 && ageSeconds < 60.0)
+                return now - ageSeconds * 1000.0;
+        }
+       #endif
+
+        return now;
+    }
+
+    // no leak detector, as the instance is a static that outlives it
+    JUCE_DECLARE_NON_COPYABLE (StartupTimeline)
+};
+
+#endif  // STARTUPTIMELINE_H_INCLUDED
@@ -0,0 +1,251 @@
+/*
+  ==============================================================================
+
+    ThumbnailGenerationQueue.h
+
+  ==============================================================================
+*/
+
+#ifndef THUMBNAILGENERATIONQUEUE_H_INCLUDED
+#define THUMBNAILGENERATIONQUEUE_H_INCLUDED
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "MultiResolutionThumbnail.h"
+#include "DiskThumbnailCache.h"
+
+//==============================================================================
+/**
+    Generates thumbnails into a DiskThumbnailCache for a list of files that keeps
+    changing, such as the rows around the visible part of a long list.
+
+    setWantedFiles() gives the files in order of priority: the ones on screen,
+    then the ones nearest to it. A few are generated at a time, in that order,
+    each by a MultiResolutionThumbnail whose chunk jobs run on the shared
+    ThreadPool. Files that are already in the cache are skipped. A file that drops
+    out of the list is forgotten, and if it was being generated its jobs are
+    cancelled, so the pool only ever works on what's near the view. Cancelling
+    never waits for a job that's running; its generator is only used again once
+    its jobs have gone.
+
+    Listeners are told as each thumbnail lands in the cache, and can then load it
+    from there. Everything here happens on the message thread.
+*/
+class ThumbnailGenerationQueue  : private ChangeListener,
+                                  private AsyncUpdater
+{
+public:
+    //==============================================================================
+    /** A file, with the hash code that its thumbnail is stored under. */
+    struct Request
+    {
+        Request() : hashCode (0) {}
+        Request (const File& f, int64 hash) : file (f), hashCode (hash) {}
+
+        bool operator== (const Request& other) const noexcept    { return hashCode == other.hashCode; }
+
+        File file;
+        int64 hashCode;
+    };
+
+    class Listener
+    {
+    public:
+        virtual ~Listener() {}
+
+        /** Called when a file's thumbnail has been stored in the cache. */
+        virtual void thumbnailGenerated (const Request& request) = 0;
+    };
+
+    //==============================================================================
+    ThumbnailGenerationQueue (int finestSamplesPerThumbSample, int numLevels,
+                              AudioFormatManager& formatManager,
+                              DiskThumbnailCache& cacheToUse,
+                              ThreadPool& threadPool,
+                              int numFilesAtOnce)
+        : cache (cacheToUse),
+          numCancelled (0)
+    {
+        for (int i = 0; i < jmax (1, numFilesAtOnce); ++i)
+            generators.add (new Generator (finestSamplesPerThumbSample, numLevels, formatManager, cacheToUse, threadPool))
+                ->thumbnail.addChangeListener (this);
+    }
+
+    ~ThumbnailGenerationQueue()
+    {
+        cancelPendingUpdate();
+
+        for (int i = 0; i < generators.size(); ++i)
+        {
+            generators.getUnchecked (i)->thumbnail.removeChangeListener (this);
+            generators.getUnchecked (i)->thumbnail.clear();
+        }
+    }
+
+    void addListener (Listener* l)          { listeners.add (l); }
+    void removeListener (Listener* l)       { listeners.remove (l); }
+
+    //==============================================================================
+    /** Replaces the files that are wanted, most urgent first. Any that are being
+        generated but aren't in the new list are cancelled.
+    */
+    void setWantedFiles (const Array<Request>& requestsInPriorityOrder)
+    {
+        wanted = requestsInPriorityOrder;
+
+        for (int i = 0; i < generators.size(); ++i)
+        {
+            Generator& g = *generators.getUnchecked (i);
+
+            if (g.request.hashCode != 0 && ! wanted.contains (g.request))
+            {
+                g.thumbnail.stopWithoutWaiting();
+                g.request = Request();
+                g.isStopping = true;
+                ++numCancelled;
+            }
+        }
+
+        startWaitingFiles();
+    }
+
+    /** The number of files that are being generated right now. */
+    int getNumInProgress() const
+    {
+        int num = 0;
+
+        for (int i = 0; i < generators.size(); ++i)
+            if (generators.getUnchecked (i)->request.hashCode != 0)
+                ++num;
+
+        return num;
+    }
+
+    /** How many files have been cancelled because they stopped being wanted. */
+    int getNumCancelled() const noexcept    { return numCancelled; }
+
+private:
+    //==============================================================================
+    struct Generator
+    {
+        Generator (int finestSamplesPerThumbSample, int numLevels, AudioFormatManager& formatManager,
+                   AudioThumbnailCache& cache, ThreadPool& threadPool)
+            : thumbnail (finestSamplesPerThumbSample, numLevels, formatManager, cache, threadPool),
+              isStopping (false)
+        {
+        }
+
+        bool isBusy() const noexcept        { return request.hashCode != 0 || isStopping; }
+
+        MultiResolutionThumbnail thumbnail;
+        Request request;
+        bool isStopping;    // cancelled, but its jobs haven't all gone yet
+    };
+
+    DiskThumbnailCache& cache;
+    OwnedArray<Generator> generators;
+    Array<Request> wanted;
+    SortedSet<int64> unreadableFiles;
+    ListenerList<Listener> listeners;
+    int numCancelled;
+
+    void changeListenerCallback (ChangeBroadcaster*) override
+    {
+        triggerAsyncUpdate();
+    }
+
+    void handleAsyncUpdate() override
+    {
+        for (int i = 0; i < generators.size(); ++i)
+        {
+            Generator& g = *generators.getUnchecked (i);
+
+            if (g.isStopping)
+            {
+                // clearing it doesn't wait now, as there's nothing left to wait for
+                if (! g.thumbnail.hasChunkJobs())
+                {
+                    g.thumbnail.clear();
+                    g.isStopping = false;
+                }
+
+                continue;
+            }
+
+            if (! g.isBusy() || g.thumbnail.isGenerating())
+                continue;
+
+            const Request finished (g.request);
+            const bool succeeded = g.thumbnail.isFullyLoaded();
+
+            // its levels are in the cache now, so the memory can go
+            g.thumbnail.clear();
+            g.request = Request();
+            wanted.removeFirstMatchingValue (finished);
+
+            if (succeeded)
+                listeners.call (&Listener::thumbnailGenerated, finished);
+            else
+                unreadableFiles.add (finished.hashCode);
+        }
+
+        startWaitingFiles();
+    }
+
+    /** Hands the most urgent files that aren't cached yet to any idle generators. */
+    void startWaitingFiles()
+    {
+        for (int i = 0; i < wanted.size();)
+        {
+            Generator* const idle = findIdleGenerator();
+
+            if (idle == nullptr)
+                return;
+
+            const Request request (wanted.getReference (i));
+
+            if (isInProgress (request))
+            {
+                ++i;
+                continue;
+            }
+
+            if (unreadableFiles.contains (request.hashCode) || cache.contains (request.hashCode))
+            {
+                wanted.remove (i);
+                continue;
+            }
+
+            idle->request = request;
+            idle->thumbnail.setSource (new FileInputSource (request.file), request.hashCode);
+
+            // a file that can't be opened, or turned out to be cached after all,
+            // won't send a change message
+            if (! idle->thumbnail.isGenerating())
+                triggerAsyncUpdate();
+
+            ++i;
+        }
+    }
+
+    Generator* findIdleGenerator() const noexcept
+    {
+        for (int i = 0; i < generators.size(); ++i)
+            if (! generators.getUnchecked (i)->isBusy())
+                return generators.getUnchecked (i);
+
+        return nullptr;
+    }
+
+    bool isInProgress (const Request& request) const noexcept
+    {
+        for (int i = 0; i < generators.size(); ++i)
+            if (generators.getUnchecked (i)->request == request)
+                return true;
+
+        return false;
+    }
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ThumbnailGenerationQueue)
+};
+
+#endif  // THUMBNAILGENERATIONQUEUE_H_INCLUDED
@@ -0,0 +1,1180 @@
+/*
+  ==============================================================================
+
+    Main.cpp
+
+    Benchmarks for the thumbnail hot paths: building, drawing, scaling with the
+    channel count, cache lookups, storage size, click-to-seek, playback
+    resampling and loop playback. Results are printed, can be written out as
+    JSON, and can be checked against a JSON baseline from an earlier run.
+
+  ==============================================================================
+*/
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+// The shared thumbnail headers include the app's JuceHeader.h as well, which
+// would otherwise declare a second ProjectInfo namespace.
+#define JUCE_DONT_DECLARE_PROJECTINFO 1
+#include "../../Source/MultiResolutionThumbnail.h"
+#include "../../Source/DiskThumbnailCache.h"
+#include "../../Source/ReadAheadAudioSource.h"
+#include "../../Source/SincResampler.h"
+#include "../../Source/LoopRegionAudioSource.h"
+
+#include <iostream>
+
+//==============================================================================
+namespace
+{
+    // The same thumbnail settings as the app.
+    enum
+    {
+        finestSamplesPerThumbSample = 64,
+        numThumbnailLevels = 5
+    };
+
+    String getOption (const StringArray& args, const String& name, const String& defaultValue)
+    {
+        const int index = args.indexOf (name);
+        return isPositiveAndBelow (index + 1, args.size()) ? args[index + 1] : defaultValue;
+    }
+
+    void printUsage()
+    {
+        std::cout << "Usage: ThumbnailBenchmark [options]" << std::endl
+                  << std::endl
+                  << "  --json <file>          write the results to a JSON file" << std::endl
+                  << "  --baseline <file>      compare against the results of an earlier run" << std::endl
+                  << "  --tolerance <percent>  how much slower than the baseline counts as a regression (default: 10)" << std::endl
+                  << "  --audio <file>         the real recording to use (default: the bundled Nylon Guitar.wav)" << std::endl
+                  << "  --quick                shorter synthetic files and fewer iterations" << std::endl
+                  << std::endl
+                  << "Only timings in ms are compared with the baseline; counts such as read-ahead" << std::endl
+                  << "underruns are reported but not checked." << std::endl;
+    }
+
+    /** Looks upwards from the executable for the tutorial's Audio folder. */
+    File findBundledAudioFile()
+    {
+        for (File dir (File::getSpecialLocation (File::currentExecutableFile).getParentDirectory());
+             dir.getParentDirectory() != dir; dir = dir.getParentDirectory())
+        {
+            const File f (dir.getChildFile ("Audio").getChildFile ("05. Nylon Guitar.wav"));
+
+            if (f.existsAsFile())
+                return f;
+        }
+
+        return File();
+    }
+
+    double getMedian (Array<double> values)
+    {
+        if (values.size() == 0)
+            return 0.0;
+
+        DefaultElementComparator<double> comparator;
+        values.sort (comparator);
+        return values[values.size() / 2];
+    }
+
+    double getMaximum (const Array<double>& values)
+    {
+        double result = 0.0;
+
+        for (int i = 0; i < values.size(); ++i)
+            result = jmax (result, values.getUnchecked (i));
+
+        return result;
+    }
+
+    //==============================================================================
+    /** Collects the named measurements, and reads and writes them as JSON. */
+    class BenchmarkResults
+    {
+    public:
+        BenchmarkResults() : metrics (new DynamicObject()) {}
+
+        /** Adds a measurement. Anything in milliseconds is treated as lower-is-better
+            when comparing with a baseline; other units are just reported.
+        */
+        void add (const String& name, double value, const String& unit)
+        {
+            DynamicObject* const metric = new DynamicObject();
+            metric->setProperty ("value", value);
+            metric->setProperty ("unit", unit);
+            metrics->setProperty (name, var (metric));
+
+            std::cout << "  " << name.paddedRight (' ', 52) << String (value, 3) << " " << unit << std::endl;
+        }
+
+        String toJSON() const
+        {
+            DynamicObject* const root = new DynamicObject();
+            root->setProperty ("benchmark", "ThumbnailBenchmark");
+            root->setProperty ("formatVersion", 1);
+            root->setProperty ("date", Time::getCurrentTime().toISO8601 (true));
+            root->setProperty ("numCpus", SystemStats::getNumCpus());
+            root->setProperty ("kernels", MinMaxKernels::getInstructionSetName());
+            root->setProperty ("resamplerKernels", SincResampler::getInstructionSetName());
+            root->setProperty ("metrics", var (metrics.get()));
+
+            return JSON::toString (var (root));
+        }
+
+        /** Prints each timing that's more than the given fraction slower than its
+            baseline value, and returns how many there were.
+        */
+        int compareWith (const var& baseline, double tolerance) const
+        {
+            DynamicObject* const baselineMetrics = baseline.getProperty ("metrics", var()).getDynamicObject();
+
+            if (baselineMetrics == nullptr)
+            {
+                std::cerr << "The baseline file has no metrics" << std::endl;
+                return 1;
+            }
+
+            const NamedValueSet& ours = metrics->getProperties();
+            const NamedValueSet& theirs = baselineMetrics->getProperties();
+            int numRegressions = 0;
+
+            std::cout << std::endl << "Compared with baseline (tolerance " << roundToInt (tolerance * 100.0) << "%):" << std::endl;
+
+            for (int i = 0; i < theirs.size(); ++i)
+            {
+                const Identifier name (theirs.getName (i));
+                const var& before = theirs.getValueAt (i);
+                const var* const after = ours.getVarPointer (name);
+
+                if (after == nullptr || before["unit"].toString() != "ms")
+                    continue;
+
+                const double oldValue = before["value"];
+                const double newValue = (*after)["value"];
+
+                if (oldValue <= 0.0)
+                    continue;
+
+                const double change = newValue / oldValue - 1.0;
+                const bool regressed = change > tolerance;
+
+                if (regressed)
+                    ++numRegressions;
+
+                std::cout << (regressed ? "! " : "  ") << name.toString().paddedRight (' ', 52)
+                          << (change >= 0 ? "+" : "") << String (change * 100.0, 1) << "%" << std::endl;
+            }
+
+            std::cout << numRegressions << " regression" << (numRegressions == 1 ? "" : "s") << std::endl;
+            return numRegressions;
+        }
+
+    private:
+        DynamicObject::Ptr metrics;
+    };
+
+    //==============================================================================
+    /** Writes a 16-bit WAV file of a swept sine with some noise on it, the same
+        every time for a given length and channel count.
+    */
+    bool writeSyntheticFile (const File& file, double sampleRate, int numChannels, int64 numSamples)
+    {
+        file.deleteFile();
+
+        WavAudioFormat wav;
+        ScopedPointer<AudioFormatWriter> writer (wav.createWriterFor (new FileOutputStream (file), sampleRate,
+                                                                      (unsigned int) numChannels, 16,
+                                                                      StringPairArray(), 0));
+        if (writer == nullptr)
+            return false;
+
+        Random random (0x5eed + numChannels);
+        AudioSampleBuffer buffer (numChannels, 65536);
+        double phase = 0.0;
+
+        for (int64 pos = 0; pos < numSamples; pos += buffer.getNumSamples())
+        {
+            const int numThisTime = (int) jmin ((int64) buffer.getNumSamples(), numSamples - pos);
+
+            for (int i = 0; i < numThisTime; ++i)
+            {
+                const double progress = (double) (pos + i) / (double) numSamples;
+                phase += 2.0 * double_Pi * (50.0 + 5000.0 * progress) / sampleRate;
+
+                const float envelope = 0.5f + 0.4f * (float) std::sin (2.0 * double_Pi * progress * 7.0);
+                const float tone = envelope * (float) std::sin (phase);
+
+                for (int chan = 0; chan < numChannels; ++chan)
+                    buffer.setSample (chan, i, tone * (1.0f - 0.1f * chan / numChannels)
+                                                 + 0.05f * (random.nextFloat() * 2.0f - 1.0f));
+            }
+
+            if (! writer->writeFromAudioSampleBuffer (buffer, 0, numThisTime))
+                return false;
+        }
+
+        return true;
+    }
+
+    File getSyntheticFile (const File& dir, int seconds, int numChannels)
+    {
+        const double sampleRate = 44100.0;
+        const File file (dir.getChildFile ("synthetic_" + String (seconds) + "s_" + String (numChannels) + "ch.wav"));
+        const int64 numSamples = (int64) (seconds * sampleRate);
+
+        // the data is deterministic, so a file of the right size can be reused
+        if (file.getSize() != 44 + numSamples * numChannels * 2)
+            writeSyntheticFile (file, sampleRate, numChannels, numSamples);
+
+        return file;
+    }
+
+    //==============================================================================
+    /** Builds a thumbnail of the whole file, bypassing every cache, and returns
+        how long it took in milliseconds. Like the app's, it collects the RMS and
+        clip counts too.
+    */
+    double timeBuild (const File& file, AudioFormatManager& formatManager, ThreadPool& threadPool)
+    {
+        AudioThumbnailCache cache (1);
+        MultiResolutionThumbnail thumbnail (finestSamplesPerThumbSample, numThumbnailLevels,
+                                            formatManager, cache, threadPool);
+        thumbnail.setCollectsEnergy (true);
+
+        const double start = Time::getMillisecondCounterHiRes();
+        thumbnail.setSource (new FileInputSource (file), Random::getSystemRandom().nextInt64());
+
+        while (thumbnail.isGenerating())
+            Thread::yield();
+
+        return Time::getMillisecondCounterHiRes() - start;
+    }
+
+    void benchmarkBuild (BenchmarkResults& results, AudioFormatManager& formatManager,
+                         const Array<File>& files, int iterations)
+    {
+        std::cout << std::endl << "Thumbnail build" << std::endl;
+
+        Array<int> threadCounts;
+
+        for (int n = 1; n < SystemStats::getNumCpus(); n *= 2)
+            threadCounts.add (n);
+
+        threadCounts.add (SystemStats::getNumCpus());
+
+        for (int i = 0; i < files.size(); ++i)
+        {
+            const File& file = files.getReference (i);
+            const double megabytes = file.getSize() / (1024.0 * 1024.0);
+
+            for (int t = 0; t < threadCounts.size(); ++t)
+            {
+                ThreadPool threadPool (threadCounts[t]);
+                Array<double> times;
+
+                for (int n = 0; n < iterations; ++n)
+                    times.add (timeBuild (file, formatManager, threadPool));
+
+                const String name ("build/" + file.getFileNameWithoutExtension() + "/threads_" + String (threadCounts[t]));
+                const double ms = getMedian (times);
+
+                results.add (name, ms, "ms");
+                results.add (name + "/throughput", megabytes / jmax (0.001, ms / 1000.0), "MB/s");
+            }
+        }
+    }
+
+    //==============================================================================
+    void benchmarkDraw (BenchmarkResults& results, AudioFormatManager& formatManager,
+                        const File& file, int iterations)
+    {
+        std::cout << std::endl << "drawChannels (" << file.getFileName() << ")" << std::endl;
+
+        AudioThumbnailCache cache (1);
+        ThreadPool threadPool;
+        MultiResolutionThumbnail thumbnail (finestSamplesPerThumbSample, numThumbnailLevels,
+                                            formatManager, cache, threadPool);
+
+        thumbnail.setSource (new FileInputSource (file));
+
+        while (thumbnail.isGenerating())
+            Thread::yield();
+
+        const int widths[] = { 256, 1024, 4096 };
+        const int zoomDivisors[] = { 1, 16, 256 };
+        const double length = thumbnail.getTotalLength();
+
+        for (int w = 0; w < numElementsInArray (widths); ++w)
+        {
+            Image image (Image::RGB, widths[w], 256, true);
+
+            for (int z = 0; z < numElementsInArray (zoomDivisors); ++z)
+            {
+                // draw the middle part of the file, as if zoomed in on it
+                const double visible = length / zoomDivisors[z];
+                const double start = (length - visible) * 0.5;
+                Array<double> times;
+
+                for (int n = 0; n < iterations * 10; ++n)
+                {
+                    Graphics g (image);
+                    const double t0 = Time::getMillisecondCounterHiRes();
+                    thumbnail.drawChannels (g, image.getBounds(), start, start + visible, 1.0f);
+                    times.add (Time::getMillisecondCounterHiRes() - t0);
+                }
+
+                results.add ("draw/width_" + String (widths[w]) + "/zoom_" + String (zoomDivisors[z]),
+                             getMedian (times), "ms");
+            }
+        }
+    }
+
+    //==============================================================================
+    /** Builds and draws files with 16 to 128 channels, reporting the time per
+        channel, which should stay flat as the count goes up: the build reads each
+        file in one interleaved pass, and the draw looks at each channel's points
+        once per column whether the channels get lanes of their own or share them.
+    */
+    void benchmarkChannelScaling (BenchmarkResults& results, AudioFormatManager& formatManager,
+                                  const File& workDir, int iterations)
+    {
+        std::cout << std::endl << "Channel scaling" << std::endl;
+
+        const int channelCounts[] = { 16, 64, 128 };
+        ThreadPool threadPool;
+
+        for (int c = 0; c < numElementsInArray (channelCounts); ++c)
+        {
+            const int numChannels = channelCounts[c];
+            const File file (getSyntheticFile (workDir, 10, numChannels));
+            const String prefix ("channels/" + String (numChannels) + "/");
+            Array<double> buildTimes;
+
+            for (int n = 0; n < iterations; ++n)
+                buildTimes.add (timeBuild (file, formatManager, threadPool));
+
+            results.add (prefix + "build_per_channel", getMedian (buildTimes) / numChannels, "ms");
+
+            AudioThumbnailCache cache (1);
+            MultiResolutionThumbnail thumbnail (finestSamplesPerThumbSample, numThumbnailLevels,
+                                                formatManager, cache, threadPool);
+            thumbnail.setSource (new FileInputSource (file));
+
+            while (thumbnail.isGenerating())
+                Thread::yield();
+
+            Image image (Image::RGB, 1024, 512, true);
+            const int lanings[] = { 1, 8 };
+
+            for (int l = 0; l < numElementsInArray (lanings); ++l)
+            {
+                Array<double> times;
+
+                for (int n = 0; n < iterations * 10; ++n)
+                {
+                    Graphics g (image);
+                    const double t0 = Time::getMillisecondCounterHiRes();
+                    thumbnail.drawChannelGroups (g, image.getBounds(), 0.0, thumbnail.getTotalLength(), 1.0f, lanings[l]);
+                    times.add (Time::getMillisecondCounterHiRes() - t0);
+                }
+
+                results.add (prefix + "draw_" + String (lanings[l]) + "_per_lane_per_channel",
+                             getMedian (times) / numChannels, "ms");
+            }
+        }
+    }
+
+    //==============================================================================
+    /** Times a full paint of the waveform component both ways: drawing the
+        thumbnail into the window every time, as it used to, and blitting the
+        image of it that the component now keeps until something changes.
+    */
+    void benchmarkPaint (BenchmarkResults& results, AudioFormatManager& formatManager,
+                         const File& file, int iterations)
+    {
+        std::cout << std::endl << "Waveform paint (" << file.getFileName() << ")" << std::endl;
+
+        AudioThumbnailCache cache (1);
+        ThreadPool threadPool;
+        MultiResolutionThumbnail thumbnail (finestSamplesPerThumbSample, numThumbnailLevels,
+                                            formatManager, cache, threadPool);
+
+        thumbnail.setSource (new FileInputSource (file));
+
+        while (thumbnail.isGenerating())
+            Thread::yield();
+
+        const int widths[] = { 1024, 3840 };
+
+        for (int w = 0; w < numElementsInArray (widths); ++w)
+        {
+            Image window (Image::RGB, widths[w], 600, true);
+            Image waveform (Image::RGB, widths[w], 600, true);
+            Array<double> uncached, cached;
+
+            {
+                Graphics g (waveform);
+                g.fillAll (Colours::white);
+                g.setColour (Colours::red);
+                thumbnail.drawChannels (g, waveform.getBounds(), 0.0, thumbnail.getTotalLength(), 1.0f);
+            }
+
+            for (int n = 0; n < iterations * 10; ++n)
+            {
+                Graphics g (window);
+
+                double t0 = Time::getMillisecondCounterHiRes();
+                g.fillAll (Colours::white);
+                g.setColour (Colours::red);
+                thumbnail.drawChannels (g, window.getBounds(), 0.0, thumbnail.getTotalLength(), 1.0f);
+                uncached.add (Time::getMillisecondCounterHiRes() - t0);
+
+                t0 = Time::getMillisecondCounterHiRes();
+                g.drawImageAt (waveform, 0, 0);
+                cached.add (Time::getMillisecondCounterHiRes() - t0);
+            }
+
+            results.add ("paint/width_" + String (widths[w]) + "/uncached", getMedian (uncached), "ms");
+            results.add ("paint/width_" + String (widths[w]) + "/cached_image", getMedian (cached), "ms");
+        }
+    }
+
+    //==============================================================================
+    /** Compares the two ways of moving the playhead across a 4K-wide waveform at the
+        overlay's 25 frames per second: repainting the whole thing every frame, as the
+        overlay used to, or only the strips that the playhead leaves and enters.
+    */
+    void benchmarkPlayhead (BenchmarkResults& results, AudioFormatManager& formatManager,
+                            const File& file, int iterations)
+    {
+        std::cout << std::endl << "Playhead repaint, 3840 pixels wide (" << file.getFileName() << ")" << std::endl;
+
+        AudioThumbnailCache cache (1);
+        ThreadPool threadPool;
+        MultiResolutionThumbnail thumbnail (finestSamplesPerThumbSample, numThumbnailLevels,
+                                            formatManager, cache, threadPool);
+
+        thumbnail.setSource (new FileInputSource (file));
+
+        while (thumbnail.isGenerating())
+            Thread::yield();
+
+        const int framesPerSecond = 25;
+        const double length = thumbnail.getTotalLength();
+        Image image (Image::RGB, 3840, 600, true);
+
+        for (int strips = 0; strips < 2; ++strips)
+        {
+            Array<double> times;
+            int playheadX = 0;
+
+            for (int n = 0; n < iterations * framesPerSecond; ++n)
+            {
+                // how far the playhead moves in one frame when the whole file spans the width
+                const int newX = (playheadX + jmax (1, roundToInt (image.getWidth() / (length * framesPerSecond))))
+                                    % image.getWidth();
+
+                const double t0 = Time::getMillisecondCounterHiRes();
+
+                {
+                    Graphics g (image);
+
+                    if (strips != 0)
+                    {
+                        RectangleList<int> dirty;
+                        dirty.add (Rectangle<int> (playheadX - 2, 0, 5, image.getHeight()));
+                        dirty.add (Rectangle<int> (newX - 2, 0, 5, image.getHeight()));
+                        g.reduceClipRegion (dirty);
+                    }
+
+                    g.fillAll (Colours::white);
+                    g.setColour (Colours::red);
+                    thumbnail.drawChannels (g, image.getBounds(), 0.0, length, 1.0f);
+                    g.setColour (Colours::green);
+                    g.drawLine ((float) newX, 0.0f, (float) newX, (float) image.getHeight(), 2.0f);
+                }
+
+                times.add (Time::getMillisecondCounterHiRes() - t0);
+                playheadX = newX;
+            }
+
+            const String name (strips != 0 ? "playhead/strip_repaint" : "playhead/full_repaint");
+            const double frameMs = getMedian (times);
+
+            results.add (name + "/frame", frameMs, "ms");
+            results.add (name + "/cpu_per_second", frameMs * framesPerSecond, "ms/s");
+        }
+
+        // stopped, the old overlay still repainted everything 25 times a second; the new one doesn't repaint at all
+        std::cout << "  (when stopped, the full repaint costs the same, and the strip repaint nothing)" << std::endl;
+    }
+
+    //==============================================================================
+    /** Builds the thumbnail with each kind of storage, and reports how much memory
+        it takes, how far its values are out, how many pixels of a drawing of it
+        differ from the same drawing of the float version, and how long that
+        drawing takes now that the points are decoded as they're read.
+    */
+    void benchmarkStorage (BenchmarkResults& results, AudioFormatManager& formatManager,
+                           const File& file, int iterations)
+    {
+        std::cout << std::endl << "Thumbnail storage (" << file.getFileName() << ")" << std::endl;
+
+        struct StorageMode
+        {
+            const char* name;
+            CompactMinMaxChannel::Format format;
+            bool compressRuns;
+        };
+
+        const StorageMode modes[] =
+        {
+            { "float",              CompactMinMaxChannel::floatFormat,      false },
+            { "float_runs",         CompactMinMaxChannel::floatFormat,      true },
+            { "half_float",         CompactMinMaxChannel::halfFloatFormat,  false },
+            { "half_float_runs",    CompactMinMaxChannel::halfFloatFormat,  true },
+            { "eight_bit",          CompactMinMaxChannel::eightBitFormat,   false },
+            { "eight_bit_runs",     CompactMinMaxChannel::eightBitFormat,   true }
+        };
+
+        Image reference (Image::RGB, 1024, 400, true);
+
+        for (int m = 0; m < numElementsInArray (modes); ++m)
+        {
+            AudioThumbnailCache cache (1);
+            ThreadPool threadPool;
+            MultiResolutionThumbnail thumbnail (finestSamplesPerThumbSample, numThumbnailLevels,
+                                                formatManager, cache, threadPool);
+
+            thumbnail.setStorage (modes[m].format, modes[m].compressRuns);
+            thumbnail.setSource (new FileInputSource (file), Random::getSystemRandom().nextInt64());
+
+            while (thumbnail.isGenerating())
+                Thread::yield();
+
+            Image image (Image::RGB, reference.getWidth(), reference.getHeight(), true);
+            Array<double> times;
+
+            for (int n = 0; n < iterations * 10; ++n)
+            {
+                Graphics g (image);
+                const double t0 = Time::getMillisecondCounterHiRes();
+                g.fillAll (Colours::white);
+                g.setColour (Colours::black);
+                thumbnail.drawChannels (g, image.getBounds(), 0.0, thumbnail.getTotalLength(), 1.0f);
+                times.add (Time::getMillisecondCounterHiRes() - t0);
+            }
+
+            if (m == 0)
+                reference = image.createCopy();
+
+            int numDifferent = 0;
+
+            for (int y = 0; y < image.getHeight(); ++y)
+                for (int x = 0; x < image.getWidth(); ++x)
+                    if (image.getPixelAt (x, y) != reference.getPixelAt (x, y))
+                        ++numDifferent;
+
+            const String name (String ("storage/") + modes[m].name);
+
+            results.add (name + "/per_channel_hour", thumbnail.getBytesPerChannelHour() / 1024.0, "KB");
+            // the error as it would look on a 200 pixel high channel, where full scale is 100 pixels
+            results.add (name + "/max_error_200px_channel", thumbnail.getMaxStorageError() * 100.0, "px");
+            results.add (name + "/pixels_changed", 100.0 * numDifferent / (image.getWidth() * image.getHeight()), "%");
+            results.add (name + "/draw_1024", getMedian (times), "ms");
+        }
+    }
+
+    //==============================================================================
+    void benchmarkCache (BenchmarkResults& results, AudioFormatManager& formatManager,
+                         const File& file, const File& cacheDir, int iterations)
+    {
+        std::cout << std::endl << "Thumbnail cache (" << file.getFileName() << ")" << std::endl;
+
+        cacheDir.deleteRecursively();
+
+        const int64 bigBudget = (int64) 1024 * 1024 * 1024;
+        const int64 hash = DiskThumbnailCache::getHashFor (file);
+        ThreadPool threadPool;
+
+        {
+            // build it once, which stores it in both tiers
+            DiskThumbnailCache cache (cacheDir, bigBudget, 5);
+            MultiResolutionThumbnail thumbnail (finestSamplesPerThumbSample, numThumbnailLevels,
+                                                formatManager, cache, threadPool);
+
+            thumbnail.setCollectsEnergy (true);   // as the app's are
+            thumbnail.setSource (new FileInputSource (file), hash);
+
+            while (thumbnail.isGenerating())
+                Thread::yield();
+
+            Array<double> misses, memoryHits;
+
+            for (int n = 0; n < iterations * 10; ++n)
+            {
+                MultiResolutionThumbnail other (finestSamplesPerThumbSample, numThumbnailLevels,
+                                                formatManager, cache, threadPool);
+                other.setCollectsEnergy (true);
+
+                double t0 = Time::getMillisecondCounterHiRes();
+                cache.loadThumb (other, hash + 1 + n);
+                misses.add (Time::getMillisecondCounterHiRes() - t0);
+
+                t0 = Time::getMillisecondCounterHiRes();
+                cache.loadThumb (other, hash);
+                memoryHits.add (Time::getMillisecondCounterHiRes() - t0);
+            }
+
+            results.add ("cache/miss", getMedian (misses), "ms");
+            results.add ("cache/memory_hit", getMedian (memoryHits), "ms");
+        }
+
+        {
+            // a new cache has nothing in memory, so everything comes off the disk
+            DiskThumbnailCache cache (cacheDir, bigBudget, 5);
+            Array<double> diskHits, reopens;
+
+            for (int n = 0; n < iterations * 10; ++n)
+            {
+                MultiResolutionThumbnail thumbnail (finestSamplesPerThumbSample, numThumbnailLevels,
+                                                    formatManager, cache, threadPool);
+                thumbnail.setCollectsEnergy (true);
+
+                double t0 = Time::getMillisecondCounterHiRes();
+                cache.loadThumb (thumbnail, hash);
+                diskHits.add (Time::getMillisecondCounterHiRes() - t0);
+
+                // what the app does when a file is opened again, hashing included
+                t0 = Time::getMillisecondCounterHiRes();
+                thumbnail.setSource (new FileInputSource (file), DiskThumbnailCache::getHashFor (file));
+                reopens.add (Time::getMillisecondCounterHiRes() - t0);
+
+                jassert (! thumbnail.isGenerating());
+            }
+
+            results.add ("cache/disk_hit", getMedian (diskHits), "ms");
+            results.add ("cache/reopen_from_disk", getMedian (reopens), "ms");
+        }
+
+        cacheDir.deleteRecursively();
+    }
+
+    //==============================================================================
+    /** Times updating the thumbnail of a file that's had a short section rewritten,
+        from the thumbnail of the version before, against building it from nothing.
+        The two results are compared too, as they ought to be identical, and the
+        rebuilt one is saved and loaded again to check that it comes back the same.
+    */
+    void benchmarkIncrementalUpdate (BenchmarkResults& results, AudioFormatManager& formatManager,
+                                     const File& file, const File& cacheDir, int iterations)
+    {
+        std::cout << std::endl << "Incremental update (" << file.getFileName() << ")" << std::endl;
+
+        cacheDir.deleteRecursively();
+
+        const File edited (cacheDir.getSiblingFile ("edited_" + file.getFileName()));
+        const int64 bigBudget = (int64) 1024 * 1024 * 1024;
+        const int headerBytes = 44, editBytes = 4096;
+        ThreadPool threadPool;
+        DiskThumbnailCache cache (cacheDir, bigBudget, 5);
+        Random random (42);
+        Array<double> updates, rebuilds;
+        int numMismatches = 0;
+
+        for (int n = 0; n < iterations; ++n)
+        {
+            // the hash codes stand in for getHashFor(), as the copies' times may clash
+            const int64 originalHash = 1000 + 3 * n, updatedHash = originalHash + 1, rebuiltHash = originalHash + 2;
+
+            edited.deleteFile();
+            file.copyFileTo (edited);
+
+            {
+                MultiResolutionThumbnail original (finestSamplesPerThumbSample, numThumbnailLevels,
+                                                   formatManager, cache, threadPool);
+                original.setCollectsEnergy (true);
+                original.setSource (new FileInputSource (edited), originalHash);
+
+                while (original.isGenerating())
+                    Thread::yield();
+            }
+
+            {
+                MemoryBlock noise ((size_t) editBytes);
+                random.fillBitsRandomly (noise.getData(), noise.getSize());
+
+                FileOutputStream out (edited);
+                out.setPosition (headerBytes + (random.nextInt64() & 0x7fffffffffffLL) % (edited.getSize() - headerBytes - editBytes) / 4 * 4);
+                out.write (noise.getData(), noise.getSize());
+            }
+
+            MultiResolutionThumbnail updated (finestSamplesPerThumbSample, numThumbnailLevels,
+                                              formatManager, cache, threadPool);
+            MultiResolutionThumbnail rebuilt (finestSamplesPerThumbSample, numThumbnailLevels,
+                                              formatManager, cache, threadPool);
+            updated.setCollectsEnergy (true);
+            rebuilt.setCollectsEnergy (true);
+
+            double t0 = Time::getMillisecondCounterHiRes();
+            updated.setSource (new FileInputSource (edited), updatedHash, cache.getLatestVersionOf (edited));
+
+            while (updated.isGenerating())
+                Thread::yield();
+
+            updates.add (Time::getMillisecondCounterHiRes() - t0);
+
+            t0 = Time::getMillisecondCounterHiRes();
+            rebuilt.setSource (new FileInputSource (edited), rebuiltHash);
+
+            while (rebuilt.isGenerating())
+                Thread::yield();
+
+            rebuilds.add (Time::getMillisecondCounterHiRes() - t0);
+
+            MemoryOutputStream updatedData, rebuiltData;
+            updated.saveTo (updatedData);
+            rebuilt.saveTo (rebuiltData);
+
+            // and the saved data has to load back into the same thumbnail
+            MultiResolutionThumbnail reloaded (finestSamplesPerThumbSample, numThumbnailLevels,
+                                               formatManager, cache, threadPool);
+            reloaded.setCollectsEnergy (true);
+
+            MemoryInputStream rebuiltInput (rebuiltData.getData(), rebuiltData.getDataSize(), false);
+            MemoryOutputStream reloadedData;
+
+            if (reloaded.loadFrom (rebuiltInput))
+                reloaded.saveTo (reloadedData);
+
+            if (updatedData.getDataSize() != rebuiltData.getDataSize()
+                 || memcmp (updatedData.getData(), rebuiltData.getData(), updatedData.getDataSize()) != 0
+                 || reloadedData.getDataSize() != rebuiltData.getDataSize()
+                 || memcmp (reloadedData.getData(), rebuiltData.getData(), rebuiltData.getDataSize()) != 0)
+                ++numMismatches;
+        }
+
+        results.add ("incremental/update_4kb_edit", getMedian (updates), "ms");
+        results.add ("incremental/full_rebuild", getMedian (rebuilds), "ms");
+        results.add ("incremental/mismatched_thumbnails", numMismatches, "count");
+
+        edited.deleteFile();
+        cacheDir.deleteRecursively();
+    }
+
+    //==============================================================================
+    void benchmarkSeek (BenchmarkResults& results, const String& name, AudioFormatReader* reader,
+                        bool deleteReader, int iterations)
+    {
+        if (reader == nullptr)
+            return;
+
+        const int blockSize = 512;
+        ScopedPointer<AudioFormatReaderSource> source (new AudioFormatReaderSource (reader, deleteReader));
+        AudioTransportSource transport;
+
+        transport.setSource (source, 0, nullptr, reader->sampleRate);
+        transport.prepareToPlay (blockSize, reader->sampleRate);
+        transport.start();
+
+        AudioSampleBuffer buffer (2, blockSize);
+        const AudioSourceChannelInfo info (&buffer, 0, blockSize);
+        const double length = transport.getLengthInSeconds();
+
+        Random random (42);
+        Array<double> seeks, seeksWithFirstBlock;
+
+        for (int n = 0; n < iterations * 50; ++n)
+        {
+            const double t0 = Time::getMillisecondCounterHiRes();
+            transport.setPosition (random.nextDouble() * length);
+            const double t1 = Time::getMillisecondCounterHiRes();
+            transport.getNextAudioBlock (info);
+            const double t2 = Time::getMillisecondCounterHiRes();
+
+            seeks.add (t1 - t0);
+            seeksWithFirstBlock.add (t2 - t0);
+        }
+
+        transport.stop();
+        transport.setSource (nullptr);
+
+        results.add ("seek/" + name + "/setPosition", getMedian (seeks), "ms");
+        results.add ("seek/" + name + "/setPosition_and_first_block", getMedian (seeksWithFirstBlock), "ms");
+        results.add ("seek/" + name + "/setPosition_and_first_block_max", getMaximum (seeksWithFirstBlock), "ms");
+    }
+
+    /** Seeks through a ReadAheadAudioSource, timing how long the buffer takes to
+        refill, then plays for a couple of seconds at the real-time rate and reports
+        what the read-ahead counters saw.
+    */
+    void benchmarkReadAhead (BenchmarkResults& results, const String& name, AudioFormatReader* reader,
+                             bool deleteReader, TimeSliceThread& readAheadThread, int iterations)
+    {
+        if (reader == nullptr)
+            return;
+
+        const int blockSize = 512;
+        const double sampleRate = reader->sampleRate;
+        AudioFormatReaderSource readerSource (reader, deleteReader);
+        ReadAheadAudioSource readAhead (&readerSource, false, readAheadThread, 2);
+
+        readAhead.prepareToPlay (blockSize, sampleRate);
+
+        AudioSampleBuffer buffer (2, blockSize);
+        const AudioSourceChannelInfo info (&buffer, 0, blockSize);
+        const int64 length = readAhead.getTotalLength();
+
+        Random random (42);
+        Array<double> seeks, refills;
+
+        for (int n = 0; n < iterations * 10; ++n)
+        {
+            const double t0 = Time::getMillisecondCounterHiRes();
+            readAhead.setNextReadPosition ((int64) (random.nextDouble() * jmax (0.0, length - sampleRate)));
+            const double t1 = Time::getMillisecondCounterHiRes();
+
+            while (readAhead.getNumSamplesBuffered() < blockSize)
+                Thread::yield();
+
+            seeks.add (t1 - t0);
+            refills.add (Time::getMillisecondCounterHiRes() - t0);
+        }
+
+        results.add ("seek/" + name + "/setPosition", getMedian (seeks), "ms");
+        results.add ("seek/" + name + "/refill_first_block", getMedian (refills), "ms");
+        results.add ("seek/" + name + "/refill_first_block_max", getMaximum (refills), "ms");
+
+        // play from the start, pacing the blocks like an audio device would
+        readAhead.setNextReadPosition (0);
+
+        while (readAhead.getNumSamplesBuffered() < readAhead.getBufferSize() / 2)
+            Thread::yield();
+
+        readAhead.resetCounters();
+
+        const double blockMs = 1000.0 * blockSize / sampleRate;
+        const int numBlocks = jmin ((int) (length / blockSize), (int) (2000.0 / blockMs));
+        Array<double> blockTimes;
+        double nextBlockTime = Time::getMillisecondCounterHiRes();
+
+        for (int n = 0; n < numBlocks; ++n)
+        {
+            const double t0 = Time::getMillisecondCounterHiRes();
+            readAhead.getNextAudioBlock (info);
+            blockTimes.add (Time::getMillisecondCounterHiRes() - t0);
+
+            nextBlockTime += blockMs;
+            const double wait = nextBlockTime - Time::getMillisecondCounterHiRes();
+
+            if (wait > 1.0)
+                Thread::sleep ((int) wait);
+        }
+
+        results.add ("playback/" + name + "/block", getMedian (blockTimes), "ms");
+        results.add ("playback/" + name + "/block_max", getMaximum (blockTimes), "ms");
+        results.add ("playback/" + name + "/underruns", readAhead.getNumUnderruns(), "count");
+        results.add ("playback/" + name + "/lowest_fill", readAhead.getMinSamplesBuffered(), "samples");
+        results.add ("playback/" + name + "/reads_off_read_ahead_thread", readAhead.getNumReadsOffBackgroundThread(), "count");
+
+        readAhead.releaseResources();
+    }
+
+    void benchmarkSeeks (BenchmarkResults& results, AudioFormatManager& formatManager,
+                         const File& file, int iterations)
+    {
+        std::cout << std::endl << "Click-to-seek (" << file.getFileName() << ")" << std::endl;
+
+        benchmarkSeek (results, "streamed", formatManager.createReaderFor (file), true, iterations);
+
+        WavAudioFormat wav;
+        ScopedPointer<MemoryMappedAudioFormatReader> mapped (wav.createMemoryMappedReader (file));
+
+        if (mapped != nullptr && mapped->mapEntireFile())
+            benchmarkSeek (results, "memory_mapped", mapped, false, iterations);
+
+        TimeSliceThread readAheadThread ("Audio read-ahead");
+        readAheadThread.startThread (8);
+
+        benchmarkReadAhead (results, "streamed_read_ahead", formatManager.createReaderFor (file), true,
+                            readAheadThread, iterations);
+    }
+
+    //==============================================================================
+    /** Plays a buffer over and over, for feeding a resampler without a disk. */
+    class LoopingBufferSource  : public AudioSource
+    {
+    public:
+        LoopingBufferSource (const AudioSampleBuffer& bufferToPlay)  : buffer (bufferToPlay), position (0) {}
+
+        void prepareToPlay (int, double) override   {}
+        void releaseResources() override            {}
+
+        void getNextAudioBlock (const AudioSourceChannelInfo& info) override
+        {
+            for (int done = 0; done < info.numSamples;)
+            {
+                const int numThisTime = jmin (info.numSamples - done, buffer.getNumSamples() - position);
+
+                for (int chan = 0; chan < info.buffer->getNumChannels(); ++chan)
+                    info.buffer->copyFrom (chan, info.startSample + done, buffer, chan % buffer.getNumChannels(),
+                                           position, numThisTime);
+
+                done += numThisTime;
+                position = (position + numThisTime) % buffer.getNumSamples();
+            }
+        }
+
+    private:
+        const AudioSampleBuffer& buffer;
+        int position;
+    };
+
+    /** Resamples a few seconds of noisy tone to 48kHz in 512-sample blocks, as the
+        app does when a file doesn't match the device, and reports how long each
+        channel-second of output takes with the transport's interpolator and with
+        each quality of sinc resampler.
+    */
+    void benchmarkResampler (BenchmarkResults& results, double inputRate, int iterations)
+    {
+        const int blockSize = 512;
+        const int numChannels = 2;
+        const double outputRate = 48000.0;
+        const int outputSeconds = 5;
+        const int numBlocks = (int) (outputSeconds * outputRate / blockSize);
+        const String prefix ("resample/" + String ((int) inputRate) + "_to_" + String ((int) outputRate) + "/");
+
+        AudioSampleBuffer input (numChannels, (int) inputRate);
+        Random random (42);
+
+        for (int i = 0; i < input.getNumSamples(); ++i)
+            for (int chan = 0; chan < numChannels; ++chan)
+                input.setSample (chan, i, 0.5f * (float) std::sin (2.0 * double_Pi * 1000.0 * i / inputRate)
+                                            + 0.05f * (random.nextFloat() * 2.0f - 1.0f));
+
+        AudioSampleBuffer output (numChannels, blockSize);
+        const AudioSourceChannelInfo info (&output, 0, blockSize);
+        const double channelSeconds = (double) numChannels * numBlocks * blockSize / outputRate;
+
+        {
+            LoopingBufferSource source (input);
+            ResamplingAudioSource interpolator (&source, false, numChannels);
+            interpolator.setResamplingRatio (inputRate / outputRate);
+            interpolator.prepareToPlay (blockSize, outputRate);
+
+            Array<double> times;
+
+            for (int n = 0; n < iterations; ++n)
+            {
+                const double start = Time::getMillisecondCounterHiRes();
+
+                for (int b = 0; b < numBlocks; ++b)
+                    interpolator.getNextAudioBlock (info);
+
+                times.add ((Time::getMillisecondCounterHiRes() - start) / channelSeconds);
+            }
+
+            results.add (prefix + "interpolating/ms_per_channel_second", getMedian (times), "ms");
+        }
+
+        for (int q = 0; q < SincResampler::numQualities; ++q)
+        {
+            const SincResampler::Quality quality = (SincResampler::Quality) q;
+            SincResampler resampler (quality, numChannels);
+            resampler.setRatio (inputRate / outputRate);
+            resampler.prepare (blockSize);
+
+            LoopingBufferSource source (input);
+            AudioSampleBuffer inputBlock (numChannels, resampler.getMaxInputSamples (blockSize));
+            Array<double> times;
+
+            for (int n = 0; n < iterations; ++n)
+            {
+                const double start = Time::getMillisecondCounterHiRes();
+
+                for (int b = 0; b < numBlocks; ++b)
+                {
+                    const int numInput = resampler.getNumInputSamplesNeeded (blockSize);
+                    source.getNextAudioBlock (AudioSourceChannelInfo (&inputBlock, 0, numInput));
+                    resampler.pushInput (inputBlock.getArrayOfReadPointers(), numInput);
+                    resampler.process (output.getArrayOfWritePointers(), blockSize);
+                }
+
+                times.add ((Time::getMillisecondCounterHiRes() - start) / channelSeconds);
+            }
+
+            results.add (prefix + "sinc_" + SincResampler::getQualityName (quality) + "/ms_per_channel_second",
+                         getMedian (times), "ms");
+        }
+    }
+
+    void benchmarkResamplers (BenchmarkResults& results, int iterations)
+    {
+        std::cout << std::endl << "Playback resampling (" << SincResampler::getInstructionSetName() << ")" << std::endl;
+
+        benchmarkResampler (results, 44100.0, iterations);
+        benchmarkResampler (results, 96000.0, iterations);
+    }
+
+    //==============================================================================
+    /** Decodes a region of a file into memory and loops it through a
+        LoopRegionAudioSource, as the app does, reporting how long the region takes
+        to decode, how far any wrap was from the right sample, and how long the
+        blocks that wrapped took next to the others. The blocks aren't paced, so
+        wrap jitter, which needs a device's clock, is left to the app's log.
+    */
+    void benchmarkLoopPlayback (BenchmarkResults& results, AudioFormatManager& formatManager,
+                                const File& file, int iterations)
+    {
+        std::cout << std::endl << "Loop playback (" << file.getFileName() << ")" << std::endl;
+
+        AudioFormatReader* const reader = formatManager.createReaderFor (file);
+
+        if (reader == nullptr)
+            return;
+
+        const int blockSize = 512;
+        const double sampleRate = reader->sampleRate;
+
+        // an odd length, so that the wraps land all over the blocks
+        const int64 loopLength = jmin (reader->lengthInSamples / 2, (int64) (sampleRate * 0.75)) | 1;
+        const int64 loopStart = jmin ((int64) sampleRate, reader->lengthInSamples - loopLength);
+        const Range<int64> region (loopStart, loopStart + loopLength);
+
+        AudioFormatReaderSource readerSource (reader, true);
+        TimeSliceThread decodeThread ("Loop decoding");
+        decodeThread.startThread (8);
+
+        LoopRegionAudioSource loop (&readerSource, false, formatManager, file, decodeThread, 2);
+        loop.prepareToPlay (blockSize, sampleRate);
+
+        // nothing's played until the last decode, so each new buffer replaces the one before
+        Array<double> decodes;
+
+        for (int n = 0; n < iterations; ++n)
+        {
+            loop.setLoopRegion (Range<int64>());
+            loop.setLoopRegion (region);
+
+            while (! loop.isLoopReady())
+                Thread::yield();
+
+            decodes.add (loop.getStatistics().lastDecodeMilliseconds);
+        }
+
+        AudioSampleBuffer buffer (2, blockSize);
+        const AudioSourceChannelInfo info (&buffer, 0, blockSize);
+        const int numBlocks = (int) (loopLength * 20 / blockSize);
+
+        loop.setNextReadPosition (loopStart);
+        loop.resetStatistics();
+
+        for (int n = 0; n < numBlocks; ++n)
+            loop.getNextAudioBlock (info);
+
+        const LoopRegionAudioSource::Statistics stats (loop.getStatistics());
+
+        results.add ("loop/decode_region", getMedian (decodes), "ms");
+        results.add ("loop/block_with_wrap", stats.meanWrapCallbackMicroseconds / 1000.0, "ms");
+        results.add ("loop/block_without_wrap", stats.meanOtherCallbackMicroseconds / 1000.0, "ms");
+        results.add ("loop/block_with_wrap_max", stats.maxWrapCallbackMicroseconds / 1000.0, "ms");
+        results.add ("loop/wraps", stats.numWraps, "count");
+        results.add ("loop/wrap_error", stats.maxWrapErrorSamples, "samples");
+
+        loop.releaseResources();
+    }
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    const StringArray args (argv + 1, argc - 1);
+
+    if (args.contains ("--help"))
+    {
+        printUsage();
+        return 1;
+    }
+
+    const bool quick = args.contains ("--quick");
+    const int iterations = quick ? 3 : 7;
+    const double tolerance = getOption (args, "--tolerance", "10").getDoubleValue() / 100.0;
+
+    const File cwd (File::getCurrentWorkingDirectory());
+    const File audioFile (args.contains ("--audio") ? cwd.getChildFile (getOption (args, "--audio", String()))
+                                                    : findBundledAudioFile());
+
+    // Images and the thumbnails' change messages need the GUI side of JUCE to be
+    // initialised, though nothing is ever shown.
+    ScopedJuceInitialiser_GUI juceInitialiser;
+
+    AudioFormatManager formatManager;
+    formatManager.registerBasicFormats();
+
+    const File workDir (File::getSpecialLocation (File::tempDirectory).getChildFile ("ThumbnailBenchmark"));
+    workDir.createDirectory();
+
+    std::cout << "Preparing synthetic audio in " << workDir.getFullPathName() << std::endl;
+
+    Array<File> buildFiles;
+    const int lengths[] = { 10, 60, 300 };
+    const int channelCounts[] = { 1, 2, 8 };
+
+    for (int l = 0; l < (quick ? 2 : numElementsInArray (lengths)); ++l)
+        for (int c = 0; c < numElementsInArray (channelCounts); ++c)
+            buildFiles.add (getSyntheticFile (workDir, lengths[l], channelCounts[c]));
+
+    const File longStereoFile (getSyntheticFile (workDir, quick ? 60 : 300, 2));
+
+    if (audioFile.existsAsFile())
+        buildFiles.insert (0, audioFile);
+    else
+        std::cerr << "Couldn't find Nylon Guitar.wav; use --audio to point at it" << std::endl;
+
+    //==============================================================================
+    BenchmarkResults results;
+
+    benchmarkBuild (results, formatManager, buildFiles, iterations);
+
+    if (audioFile.existsAsFile())
+        benchmarkDraw (results, formatManager, audioFile, iterations);
+
+    benchmarkDraw (results, formatManager, longStereoFile, iterations);
+    benchmarkPaint (results, formatManager, audioFile.existsAsFile() ? audioFile : longStereoFile, iterations);
+    benchmarkPlayhead (results, formatManager, audioFile.existsAsFile() ? audioFile : longStereoFile, iterations);
+    benchmarkStorage (results, formatManager, audioFile.existsAsFile() ? audioFile : longStereoFile, iterations);
+    benchmarkCache (results, formatManager, longStereoFile, workDir.getChildFile ("cache"), iterations);
+    benchmarkIncrementalUpdate (results, formatManager, longStereoFile, workDir.getChildFile ("cache"), iterations);
+    benchmarkChannelScaling (results, formatManager, workDir, iterations);
+    benchmarkSeeks (results, formatManager, audioFile.existsAsFile() ? audioFile : longStereoFile, iterations);
+    benchmarkResamplers (results, iterations);
+    benchmarkLoopPlayback (results, formatManager, audioFile.existsAsFile() ? audioFile : longStereoFile, iterations);
+
+    //==============================================================================
+    if (args.contains ("--json"))
+    {
+        const File jsonFile (cwd.getChildFile (getOption (args, "--json", "benchmark.json")));
+
+        if (! jsonFile.replaceWithText (results.toJSON()))
+            std::cerr << "Couldn't write " << jsonFile.getFullPathName() << std::endl;
+    }
+
+    if (args.contains ("--baseline"))
+    {
+        const File baselineFile (cwd.getChildFile (getOption (args, "--baseline", String())));
+        const var baseline (JSON::parse (baselineFile));
+
+        if (baseline.isVoid())
+        {
+            std::cerr << "Couldn't read the baseline " << baselineFile.getFullPathName() << std::endl;
+            return 1;
+        }
+
+        if (results.compareWith (baseline, tolerance) > 0)
+            return 3;
+    }
+
+    return 0;
+}